@@ -1,32 +1,303 @@
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <deque>
+#include <filesystem>
+#include <iomanip>
 #include <iostream>
 #include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __linux__
+#include <arpa/inet.h>
+#include <csignal>
+#include <linux/perf_event.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#endif
+
+// Built with -std=c++20: puzzles can also run as coroutines
+// with real time limits (--timed)
+#if __cplusplus >= 202002L && defined(__cpp_impl_coroutine) &&            \
+    __has_include(<coroutine>)
+#include <coroutine>
+#define HAVE_COROUTINES 1
+#endif
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#if defined(ESCAPE_METRICS) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#endif
 
 using namespace std;
 
+/* =========================
+ALLOCATION COUNTER
+(every heap allocation bumps a per-thread
+ counter; the benchmarks report it per game)
+========================= */
+static thread_local long long HEAP_ALLOCS = 0;
+
+// noinline: keeps GCC from pairing the inlined malloc/free with
+// new/delete expressions (-Wmismatched-new-delete false positives)
+#if defined(__GNUC__)
+#define ALLOC_HOOK __attribute__((noinline))
+#else
+#define ALLOC_HOOK
+#endif
+
+ALLOC_HOOK void *operator new(size_t n) {
+  HEAP_ALLOCS++;
+  if (void *p = malloc(n ? n : 1))
+    return p;
+  throw bad_alloc();
+}
+ALLOC_HOOK void *operator new[](size_t n) { return operator new(n); }
+ALLOC_HOOK void operator delete(void *p) noexcept { free(p); }
+ALLOC_HOOK void operator delete[](void *p) noexcept { free(p); }
+ALLOC_HOOK void operator delete(void *p, size_t) noexcept { free(p); }
+ALLOC_HOOK void operator delete[](void *p, size_t) noexcept { free(p); }
+
+/* =========================
+METRICS
+Built with -DESCAPE_METRICS: spans of the hot paths go into
+per-thread log2 histograms and per-thread counters, each
+written only by its own thread, so recording takes no lock
+and no atomic read-modify-write. --metrics FILE writes them
+all, summed over threads, as Prometheus text. Without the
+flag METRIC_SPAN / METRIC_COUNT expand to nothing.
+========================= */
+enum MetricSpan {
+  SPAN_BUILD_MAP,  // buildMap / buildMapFromGraph / buildMapTemplate
+  SPAN_PICK_CLUE,  // pickRandomClueIndexForRoom
+  SPAN_SOLVE_CLUE, // applyAttempt (one answer to a puzzle)
+  SPAN_TRAP,       // getTrapMessage
+  SPAN_TURN,       // feedSession (one input line), a simulated turn
+  SPAN_PATH,       // pushPath / popPath / the session's path stack
+  SPAN_COUNT
+};
+
+enum MetricCounter {
+  METRIC_CLUES_DRAWN,
+  METRIC_POOL_FALLBACK, // no clue of the room's difficulty left
+  METRIC_POOL_EMPTY,    // no unused clue left at all (cnt == 0)
+  METRIC_HINTS,
+  METRIC_TIMEOUTS,
+  METRIC_TRAPS,
+  METRIC_COUNTER_COUNT
+};
+
+#ifdef ESCAPE_METRICS
+static const int METRIC_BUCKETS = 40; // bucket b: < 2^b ticks (last: the rest)
+
+// Span clock: the TSC on x86 (a few ns to read), steady_clock ns
+// elsewhere; ticks become seconds only when the metrics are written
+#if defined(__x86_64__) || defined(__i386__)
+static inline uint64_t metricTicks() { return __rdtsc(); }
+#else
+static inline uint64_t metricTicks() {
+  return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+#endif
+static const uint64_t METRIC_TICKS0 = metricTicks();
+static const chrono::steady_clock::time_point METRIC_CLOCK0 =
+    chrono::steady_clock::now();
+
+struct ThreadMetrics {
+  atomic<uint64_t> hist[SPAN_COUNT][METRIC_BUCKETS];
+  atomic<uint64_t> sumTicks[SPAN_COUNT];
+  atomic<uint64_t> counters[METRIC_COUNTER_COUNT];
+  ThreadMetrics *next; // all threads' blocks, newest first
+};
+
+static atomic<ThreadMetrics *> METRICS_THREADS{nullptr};
+
+// This thread's block; blocks outlive their threads so the export
+// still sees finished simulator workers
+static ThreadMetrics &threadMetrics() {
+  static thread_local ThreadMetrics *mine = nullptr;
+  if (!mine) {
+    // calloc: not counted in HEAP_ALLOCS; zero is a valid atomic<uint64_t>
+    mine = (ThreadMetrics *)calloc(1, sizeof(ThreadMetrics));
+    if (!mine)
+      throw bad_alloc();
+    mine->next = METRICS_THREADS.load(memory_order_relaxed);
+    while (!METRICS_THREADS.compare_exchange_weak(
+        mine->next, mine, memory_order_release, memory_order_relaxed)) {
+    }
+  }
+  return *mine;
+}
+
+// Single writer: a relaxed load + store, no locked instruction
+static inline void metricAdd(atomic<uint64_t> &v, uint64_t n) {
+  v.store(v.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+static inline void metricCount(MetricCounter c, uint64_t n = 1) {
+  metricAdd(threadMetrics().counters[c], n);
+}
+
+struct MetricSpanTimer {
+  MetricSpan span;
+  uint64_t t0;
+
+  explicit MetricSpanTimer(MetricSpan s) : span(s), t0(metricTicks()) {}
+  ~MetricSpanTimer() {
+    uint64_t ticks = metricTicks() - t0;
+    int b = ticks ? 64 - __builtin_clzll(ticks) : 0;
+    if (b > METRIC_BUCKETS - 1)
+      b = METRIC_BUCKETS - 1;
+    ThreadMetrics &m = threadMetrics();
+    metricAdd(m.hist[span][b], 1);
+    metricAdd(m.sumTicks[span], ticks);
+  }
+};
+
+#define METRIC_SPAN(s) MetricSpanTimer metricSpan(s)
+#define METRIC_COUNT(c) metricCount(c)
+#else
+#define METRIC_SPAN(s) ((void)0)
+#define METRIC_COUNT(c) ((void)0)
+#endif
+
+// --metrics FILE: Prometheus text exposition of everything so far,
+// written to FILE.tmp and renamed so readers never see half a file
+bool writeMetrics(const char *path, string &err) {
+#ifdef ESCAPE_METRICS
+  static const char *spanNames[SPAN_COUNT] = {
+      "build_map", "pick_clue", "solve_clue", "trap", "turn", "path"};
+  static const char *counterNames[METRIC_COUNTER_COUNT][2] = {
+      {"clues_drawn", "Clues drawn from the pools"},
+      {"pool_fallbacks", "Draws with no clue of the room's difficulty left"},
+      {"pool_empty", "Draws with no unused clue left (random reuse)"},
+      {"hints", "Hints used"},
+      {"timeouts", "Attempts that ran past the time limit"},
+      {"trap_hits", "Trap doors walked through"}};
+  uint64_t hist[SPAN_COUNT][METRIC_BUCKETS] = {}, sumTicks[SPAN_COUNT] = {},
+           counters[METRIC_COUNTER_COUNT] = {};
+  for (ThreadMetrics *m = METRICS_THREADS.load(memory_order_acquire); m;
+       m = m->next) {
+    for (int s = 0; s < SPAN_COUNT; s++) {
+      for (int b = 0; b < METRIC_BUCKETS; b++)
+        hist[s][b] += m->hist[s][b].load(memory_order_relaxed);
+      sumTicks[s] += m->sumTicks[s].load(memory_order_relaxed);
+    }
+    for (int c = 0; c < METRIC_COUNTER_COUNT; c++)
+      counters[c] += m->counters[c].load(memory_order_relaxed);
+  }
+  // seconds per tick, measured over the life of the process
+  uint64_t ticks = metricTicks() - METRIC_TICKS0;
+  double secs = chrono::duration<double>(chrono::steady_clock::now() -
+                                         METRIC_CLOCK0)
+                    .count();
+  double tick = ticks && secs > 0 ? secs / (double)ticks : 1e-9;
+
+  string tmp = string(path) + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (!f) {
+    err = "cannot write " + tmp + ": " + strerror(errno);
+    return false;
+  }
+  fputs("# HELP escape_span_seconds Time spent in engine hot paths\n"
+        "# TYPE escape_span_seconds histogram\n",
+        f);
+  for (int s = 0; s < SPAN_COUNT; s++) {
+    uint64_t total = 0;
+    for (int b = 0; b < METRIC_BUCKETS - 1; b++) {
+      total += hist[s][b];
+      fprintf(f, "escape_span_seconds_bucket{span=\"%s\",le=\"%.9g\"} %llu\n",
+              spanNames[s], (double)(1ULL << b) * tick,
+              (unsigned long long)total);
+    }
+    total += hist[s][METRIC_BUCKETS - 1];
+    fprintf(f, "escape_span_seconds_bucket{span=\"%s\",le=\"+Inf\"} %llu\n",
+            spanNames[s], (unsigned long long)total);
+    fprintf(f, "escape_span_seconds_sum{span=\"%s\"} %.9f\n", spanNames[s],
+            (double)sumTicks[s] * tick);
+    fprintf(f, "escape_span_seconds_count{span=\"%s\"} %llu\n", spanNames[s],
+            (unsigned long long)total);
+  }
+  for (int c = 0; c < METRIC_COUNTER_COUNT; c++)
+    fprintf(f, "# HELP escape_%s_total %s\n# TYPE escape_%s_total counter\n"
+               "escape_%s_total %llu\n",
+            counterNames[c][0], counterNames[c][1], counterNames[c][0],
+            counterNames[c][0], (unsigned long long)counters[c]);
+  bool ok = fclose(f) == 0 && rename(tmp.c_str(), path) == 0;
+  if (!ok)
+    err = string("cannot write ") + path;
+  return ok;
+#else
+  (void)path;
+  err = "--metrics needs a build with -DESCAPE_METRICS";
+  return false;
+#endif
+}
+
 /* =========================
 CONFIG
 ========================= */
 static const int MAX_OPTIONS = 4;
 static const int MAX_CLUES_PER_ROOM = 2;
 static const int DEFAULT_ATTEMPTS = 3;
-static const int HINT_PENALTY = 5;
-static const int WRONG_PENALTY = 10;
+// Tunable from the command line in simulation mode (see runSimulation)
+static int HINT_PENALTY = 5;
+static int WRONG_PENALTY = 10;
+// --fuzzy: TEXT answers within a few edits of the solution count
+static bool FUZZY_ANSWERS = false;
 
 /* =========================
 CLUE / PUZZLE
 ========================= */
 enum ClueType { TEXT_ANSWER, MCQ };
 enum ClueDifficulty { EASY_CLUE, HARD_CLUE, ANY_CLUE };
+// Text fields are views: into string literals for the built-in bank,
+// or into the mapped clue file (see CLUE FILES)
 struct Clue {
   ClueType type;
-  string problem;
-  string solution;
-  string hint;
+  string_view problem;
+  string_view solution;
+  string_view hint;
 
-  string options[MAX_OPTIONS];
+  string_view options[MAX_OPTIONS];
   char correctOption;
 
   int attempts;
@@ -35,14 +306,227 @@ struct Clue {
   bool usedHint;
 
   ClueDifficulty diffTag;
+
+  // TEXT_ANSWER: solution after normalizeAnswer, '|' between the
+  // accepted answers (set by loadBankClue)
+  string_view answer = {};
+  // TEXT_ANSWER with --fuzzy: edits still accepted (-1 = by length)
+  int typos = -1;
 };
-                              //A->a
-static inline string toLowerStr(string s) {
-  for (size_t i = 0; i < s.size(); i++) {
-    if (s[i] >= 'A' && s[i] <= 'Z')
-      s[i] = char(s[i] - 'A' + 'a');
+
+/* Answers are compared after folding ASCII case and turning every run
+   of ASCII spaces / punctuation into one space (none at either end), so
+   "Dr. Mohamed  Ali" matches "dr mohamed ali". Bytes >= 0x80 (UTF-8)
+   are kept as they are. In place, no allocation; returns the new length */
+static inline bool isAnswerByte(unsigned char c) {
+  return c >= 0x80 || (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') ||
+         (c >= 'A' && c <= 'Z');
+}
+
+size_t normalizeAnswer(char *s, size_t n) {
+  size_t r = 0, w = 0;
+  bool gap = false; // a separator since the last byte kept
+#ifdef __SSE2__
+  // 16 bytes at a time: classify and fold with SSE2; a block of
+  // letters/digits is moved in one store (w <= r, so nothing unread is
+  // overwritten), mixed blocks are compacted from the folded copy
+  const __m128i zero = _mm_setzero_si128();
+  while (r + 16 <= n) {
+    __m128i c = _mm_loadu_si128((const __m128i *)(s + r));
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)),
+                                  _mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(c, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    __m128i keep = _mm_or_si128(_mm_or_si128(upper, lower),
+                                _mm_or_si128(digit, _mm_cmplt_epi8(c, zero)));
+    __m128i folded =
+        _mm_add_epi8(c, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+    unsigned bits = (unsigned)_mm_movemask_epi8(keep);
+    if (bits == 0xFFFF) {
+      if (gap && w)
+        s[w++] = ' ';
+      gap = false;
+      _mm_storeu_si128((__m128i *)(s + w), folded);
+      w += 16;
+    } else {
+      char block[16];
+      _mm_storeu_si128((__m128i *)block, folded);
+      for (int i = 0; i < 16; i++) {
+        if (!(bits >> i & 1)) {
+          gap = true;
+          continue;
+        }
+        if (gap && w)
+          s[w++] = ' ';
+        gap = false;
+        s[w++] = block[i];
+      }
+    }
+    r += 16;
   }
-  return s;
+#endif
+  for (; r < n; r++) {
+    unsigned char c = (unsigned char)s[r];
+    if (!isAnswerByte(c)) {
+      gap = true;
+      continue;
+    }
+    if (gap && w)
+      s[w++] = ' ';
+    gap = false;
+    s[w++] = (char)(c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c);
+  }
+  return w;
+}
+
+// Appends solution to out in normalised form; '|' separates accepted
+// answers (answers that normalise to nothing are dropped)
+void appendAnswers(string &out, string_view solution) {
+  size_t first = out.size(), start = 0;
+  while (start <= solution.size()) {
+    size_t bar = solution.find('|', start);
+    if (bar == string_view::npos)
+      bar = solution.size();
+    size_t at = out.size();
+    if (at > first)
+      out += '|';
+    size_t from = out.size();
+    out.append(solution.data() + start, bar - start);
+    out.resize(from + normalizeAnswer(&out[from], bar - start));
+    if (out.size() == from)
+      out.resize(at);
+    start = bar + 1;
+  }
+}
+
+static const int MAX_ANSWER_TYPOS = 9;
+
+// Edits --fuzzy accepts in an answer of len bytes when the clue sets none
+static inline int defaultTypos(size_t len) {
+  return len < 3 ? 0 : len < 8 ? 1 : len < 16 ? 2 : 3;
+}
+
+/* Levenshtein distance of a and b when it is <= k, else k + 1.
+   a up to 64 bytes: Myers' bit-parallel algorithm (Hyyro's variant for
+   the distance of whole strings), one column of the DP matrix per byte
+   of b in a dozen word operations; longer a: the DP restricted to the
+   2k + 1 diagonals around the main one (Ukkonen). No allocation */
+int boundedEditDistance(string_view a, string_view b, int k) {
+  if (k > MAX_ANSWER_TYPOS) // the band below holds 2 * MAX_ANSWER_TYPOS + 1
+    k = MAX_ANSWER_TYPOS;
+  int m = (int)a.size(), n = (int)b.size();
+  if (m - n > k || n - m > k)
+    return k + 1;
+  // a common prefix / suffix never changes the distance: a typo leaves
+  // only the few bytes around it for the kernel
+  int pre = 0;
+  while (pre < m && pre < n && a[pre] == b[pre])
+    pre++;
+  while (pre < m && pre < n && a[m - 1] == b[n - 1]) {
+    m--;
+    n--;
+  }
+  a = a.substr(pre, m - pre);
+  b = b.substr(pre, n - pre);
+  m -= pre;
+  n -= pre;
+  if (m == 0 || n == 0)
+    return m + n;
+
+  if (m <= 64) {
+    uint64_t peq[256]; // bit i: a[i] == c (only bytes of a and b are set)
+    for (int j = 0; j < n; j++)
+      peq[(unsigned char)b[j]] = 0;
+    for (int i = 0; i < m; i++)
+      peq[(unsigned char)a[i]] = 0;
+    for (int i = 0; i < m; i++)
+      peq[(unsigned char)a[i]] |= 1ULL << i;
+    uint64_t pv = ~0ULL, mv = 0, last = 1ULL << (m - 1);
+    int score = m;
+    for (int j = 0; j < n; j++) {
+      uint64_t eq = peq[(unsigned char)b[j]];
+      uint64_t xv = eq | mv;
+      uint64_t xh = (((eq & pv) + pv) ^ pv) | eq;
+      uint64_t ph = mv | ~(xh | pv);
+      uint64_t mh = pv & xh;
+      score += (int)((ph & last) != 0) - (int)((mh & last) != 0);
+      ph = (ph << 1) | 1; // row 0 grows by one per column
+      mh <<= 1;
+      pv = mh | ~(xv | ph);
+      mv = ph & xv;
+      // each byte left can lower the score by at most one
+      if (score - (n - 1 - j) > k)
+        return k + 1;
+    }
+    return score <= k ? score : k + 1;
+  }
+
+  // band: row[d + k] = D[i][i + d] for -k <= d <= k
+  const int inf = k + 1;
+  int rows[2][2 * MAX_ANSWER_TYPOS + 1];
+  int *prev = rows[0], *cur = rows[1];
+  for (int d = -k; d <= k; d++)
+    prev[d + k] = d >= 0 && d <= n ? d : inf;
+  for (int i = 1; i <= m; i++) {
+    int best = inf;
+    for (int d = -k; d <= k; d++) {
+      int j = i + d, v = inf;
+      if (j == 0) {
+        v = i <= k ? i : inf;
+      } else if (j > 0 && j <= n) {
+        v = prev[d + k] + (a[i - 1] != b[j - 1]);
+        if (d < k && prev[d + k + 1] + 1 < v)
+          v = prev[d + k + 1] + 1;
+        if (d > -k && cur[d + k - 1] + 1 < v)
+          v = cur[d + k - 1] + 1;
+      }
+      cur[d + k] = v < inf ? v : inf;
+      if (cur[d + k] < best)
+        best = cur[d + k];
+    }
+    if (best > k)
+      return k + 1;
+    swap(prev, cur);
+  }
+  return prev[n - m + k];
+}
+
+// input: already normalised
+static inline bool matchAnswer(string_view answers, string_view input) {
+  if (input.empty())
+    return false;
+  size_t start = 0;
+  while (start < answers.size()) {
+    size_t bar = answers.find('|', start);
+    if (bar == string_view::npos)
+      bar = answers.size();
+    if (bar - start == input.size() &&
+        memcmp(answers.data() + start, input.data(), input.size()) == 0)
+      return true;
+    start = bar + 1;
+  }
+  return false;
+}
+
+// --fuzzy: input within typos edits (-1 = defaultTypos) of an answer
+static inline bool matchAnswerClose(string_view answers, string_view input,
+                                    int typos) {
+  if (input.empty())
+    return false;
+  size_t start = 0;
+  while (start < answers.size()) {
+    size_t bar = answers.find('|', start);
+    if (bar == string_view::npos)
+      bar = answers.size();
+    string_view a = answers.substr(start, bar - start);
+    int k = typos < 0 ? defaultTypos(a.size()) : min(typos, MAX_ANSWER_TYPOS);
+    if (boundedEditDistance(a, input, k) <= k)
+      return true;
+    start = bar + 1;
+  }
+  return false;
 }
 
 static inline void flushInputLine() {
@@ -55,30 +539,192 @@ static inline bool isChoiceChar(char c) {
   return (c == 'A' || c == 'B' || c == 'C' || c == 'D');
 }
 
+/* =========================
+RANDOM NUMBERS
+One GameRng per session (a game, a simulation thread, a
+benchmark), passed to everything that rolls dice: the same
+seed replays the same map and clues, and sessions never
+share generator state.
+xoshiro256**, seeded through splitmix64.
+========================= */
+static inline uint64_t splitmix64(unsigned long long &state) {
+  unsigned long long z = (state += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+struct GameRng {
+  uint64_t s[4];
+};
+
+void seedRng(GameRng &rng, unsigned long long seed) {
+  for (int i = 0; i < 4; i++)
+    rng.s[i] = splitmix64(seed);
+}
+
+// Stream k of a seed: independent generator for session/thread k
+void seedRngStream(GameRng &rng, unsigned long long seed,
+                   unsigned long long stream) {
+  seedRng(rng, seed ^ splitmix64(stream));
+}
+
+static inline uint64_t rotl64(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rngNext(GameRng &rng) {
+  uint64_t *s = rng.s;
+  uint64_t result = rotl64(s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotl64(s[3], 45);
+  return result;
+}
+
+// uniform in [0, n) for n > 0 (multiply-shift, no division)
+static inline uint32_t rngBelow(GameRng &rng, uint32_t n) {
+  return (uint32_t)(((rngNext(rng) >> 32) * (uint64_t)n) >> 32);
+}
+
+// uniform in [0, 1)
+static inline double rngUnit(GameRng &rng) {
+  return (rngNext(rng) >> 11) * (1.0 / 9007199254740992.0);
+}
+
 /* =========================
 ROOM NODE (LINKED LIST)
 ========================= */
+enum RoomType : unsigned char { ROOM_ENTRANCE, ROOM_INTERMEDIATE, ROOM_EXIT };
+enum RoomDifficulty : unsigned char { DIFF_NONE, DIFF_EASY, DIFF_HARD };
+
+static inline const char *roomTypeName(RoomType t) {
+  return t == ROOM_ENTRANCE ? "ENTRANCE"
+         : t == ROOM_EXIT   ? "EXIT"
+                            : "INTERMEDIATE";
+}
+
+static inline const char *difficultyName(RoomDifficulty d) {
+  return d == DIFF_EASY ? "EASY" : d == DIFF_HARD ? "HARD" : "";
+}
+
+// What happens when a door is taken (see getTrapMessage)
+enum TrapKind : unsigned char {
+  TRAP_NONE,
+  TRAP_SENT_BACK, // back to the beginning of the sector
+  TRAP_LOOP,      // running in circles
+  TRAP_HARD_PATH  // into a high-difficulty zone
+};
+
 struct Room {
+  // hot: read on every turn
   int roomID;
-  string roomType;   // ENTRANCE / INTERMEDIATE / EXIT / TRAP (optional)
-  string difficulty; // EASY / HARD (for intermediate)
+  RoomType roomType;         // ENTRANCE / INTERMEDIATE / EXIT
+  RoomDifficulty difficulty; // EASY / HARD (for intermediate)
+  unsigned char clueCount;   // 1 or 2
+  bool visited;
+  bool cleared;
 
   Room *next1; // door 1
   Room *next2; // door 2 (only for EASY)
   Room *prev;  // for back
 
+  int clueIndex[MAX_CLUES_PER_ROOM];      // CLUE_BANK index behind each door
+  TrapKind trap[MAX_CLUES_PER_ROOM];      // trap behind each door
+
+  // cold: only touched when a door puzzle is played
   Clue clues[MAX_CLUES_PER_ROOM]; // one per door
-  int clueCount;                  // 1 or 2
+};
 
-  bool visited;
-  bool cleared;
+/* =========================
+HISTORY STACK NODE (LINKED LIST)
+========================= */
+struct PathNode {
+  Room *r;
+  PathNode *next;
+};
+
+/* =========================
+GAME ARENA
+Session-scoped storage for Room and PathNode:
+- rooms live in one array and are reused game after game
+  (sized for the biggest map seen so far)
+- path nodes come from fixed blocks + a free list
+- resetArena() forgets everything in O(1)
+========================= */
+static const int PATH_BLOCK = 256;
+
+struct GameArena {
+  vector<Room> rooms;   // grown only between games (reserveArenaRooms)
+  int roomsUsed;
+  vector<Room *> lists; // entrance/exit/room lists of the current map
+
+  vector<PathNode *> pathBlocks; // kept across resets
+  int pathBlock;                 // block currently bumped
+  int pathUsed;                  // nodes used in that block
+  PathNode *freePaths;           // popped nodes, reused first
 };
 
+void resetArena(GameArena &a) {
+  a.roomsUsed = 0;
+  a.pathBlock = 0;
+  a.pathUsed = 0;
+  a.freePaths = nullptr;
+}
+
+GameArena *createArena() {
+  GameArena *a = new GameArena;
+  resetArena(*a);
+  return a;
+}
+
+void destroyArena(GameArena *a) {
+  for (size_t i = 0; i < a->pathBlocks.size(); i++)
+    delete[] a->pathBlocks[i];
+  delete a;
+}
+
+// Before the first room of a map: make room for n of them
+void reserveArenaRooms(GameArena &a, int n) {
+  if (a.roomsUsed == 0 && (int)a.rooms.size() < n)
+    vector<Room>(n).swap(a.rooms);
+}
+
+Room *arenaRoom(GameArena &a) {
+  if (a.roomsUsed >= (int)a.rooms.size())
+    return nullptr;
+  return &a.rooms[a.roomsUsed++];
+}
+
+PathNode *arenaPathNode(GameArena &a) {
+  if (a.freePaths) {
+    PathNode *n = a.freePaths;
+    a.freePaths = n->next;
+    return n;
+  }
+  if (a.pathUsed == PATH_BLOCK) {
+    a.pathBlock++;
+    a.pathUsed = 0;
+  }
+  if (a.pathBlock == (int)a.pathBlocks.size())
+    a.pathBlocks.push_back(new PathNode[PATH_BLOCK]);
+  return &a.pathBlocks[a.pathBlock][a.pathUsed++];
+}
+
+void arenaReleasePath(GameArena &a, PathNode *n) {
+  n->next = a.freePaths;
+  a.freePaths = n;
+}
+
 /* =========================
 HELPERS: Create rooms
+(arena == nullptr -> plain new)
 ========================= */
-Room *createRoom(int id, const string &type, const string &diff) {
-  Room *r = new Room;
+void initRoom(Room *r, int id, RoomType type, RoomDifficulty diff) {
   r->roomID = id;
   r->roomType = type;
   r->difficulty = diff;
@@ -86,132 +732,1168 @@ Room *createRoom(int id, const string &type, const string &diff) {
   r->next2 = nullptr;
   r->prev = nullptr;
   r->clueCount = 0;
+  r->clueIndex[0] = -1;
+  r->clueIndex[1] = -1;
+  r->trap[0] = TRAP_NONE;
+  r->trap[1] = TRAP_NONE;
   r->visited = false;
   r->cleared = false;
+}
+
+Room *createRoom(int id, RoomType type, RoomDifficulty diff,
+                 GameArena *arena = nullptr) {
+  Room *r = arena ? arenaRoom(*arena) : new Room;
+  initRoom(r, id, type, diff);
   return r;
 }
 
 /* =========================
 BUILD SAMPLE CLUE BANK
-(No STL containers: fixed arrays)
+(the last clue of a bank is always the final gate)
 ========================= */
-static const int CLUE_BANK_SIZE = 53;
-static const int FINAL_CLUE_INDEX = CLUE_BANK_SIZE - 1; // = 52
-Clue CLUE_BANK[CLUE_BANK_SIZE];
-bool USED_CLUES[FINAL_CLUE_INDEX];
+static const int BUILTIN_CLUE_COUNT = 53;
+static int FINAL_CLUE_INDEX = BUILTIN_CLUE_COUNT - 1; // = 52 for the sample
+vector<Clue> CLUE_BANK; // built-in or text bank (binary banks stay mapped)
 
-void resetUsedClues() {
-  for (int i = 0; i < FINAL_CLUE_INDEX; i++)
-    USED_CLUES[i] = false;
+/* =========================
+CLUE POOLS
+Unused clue indices per difficulty, kept between picks:
+  POOL_EASY = EASY_CLUE + ANY_CLUE
+  POOL_HARD = HARD_CLUE + ANY_CLUE
+  POOL_ALL  = every clue except the final one
+Each pool is a shared, read-only base order (ClueBuckets: one sorted
+bucket per diffTag, possibly straight from a binary bank file) plus a
+small per-game overlay of the slots that swap-removal has changed.
+Slots [0, live[p]) are still unused; taking a clue swaps it past the
+live end of every pool that holds it. Nothing is copied per thread
+and a reset only forgets the overlay.
+========================= */
+enum CluePool { POOL_EASY, POOL_HARD, POOL_ALL, POOL_COUNT };
+
+// Read-only bucket view, shared by every thread
+struct ClueBuckets {
+  const uint32_t *bucket[3]; // clue indices per ClueDifficulty, ascending
+  uint32_t count[3];
+  const uint32_t *slot;      // slot[clue] = position inside its bucket
+  const uint8_t *tags;       // tags[clue] = ClueDifficulty
+  uint32_t clues;            // pickable clues (final excluded)
+};
+
+// Backing storage for banks that do not carry buckets in the file
+struct ClueBucketStore {
+  vector<uint32_t> bucket[3];
+  vector<uint32_t> slot;
+  vector<uint8_t> tags;
+};
+
+// tags[i] = diffTag of clue i, for the n pickable clues (final excluded)
+void buildClueBuckets(ClueBucketStore &st, ClueBuckets &cb,
+                      const ClueDifficulty *tags, int n) {
+  for (int b = 0; b < 3; b++)
+    st.bucket[b].clear();
+  st.slot.resize(n);
+  st.tags.resize(n);
+  for (int i = 0; i < n; i++) {
+    st.tags[i] = (uint8_t)tags[i];
+    st.slot[i] = (uint32_t)st.bucket[tags[i]].size();
+    st.bucket[tags[i]].push_back((uint32_t)i);
+  }
+  for (int b = 0; b < 3; b++) {
+    cb.bucket[b] = st.bucket[b].data();
+    cb.count[b] = (uint32_t)st.bucket[b].size();
+  }
+  cb.slot = st.slot.data();
+  cb.tags = st.tags.data();
+  cb.clues = (uint32_t)n;
 }
 
-    void initClueBank() {
-        CLUE_BANK[0] = { MCQ,
-            "What does CPU stand for?",
-            "", "It's the main processor of the computer.",
-            {"Central Processing Unit","Computer Processing User","Central Program Utility","Core Power Unit"},
-            'A', DEFAULT_ATTEMPTS, 10, 20, false,
-            EASY_CLUE
-        };
+// Overlay entry: valid only while stamp == the pools' current stamp.
+// The arrays are zero pages handed out lazily by the OS (huge pages
+// off, so the first touch clears 4 KiB, not 2 MiB): a 1M-clue pool
+// costs nothing until a game actually touches it.
+struct OverlayEntry {
+  uint32_t stamp;
+  uint32_t val;
+};
 
-        CLUE_BANK[1] = { MCQ,
-            "Which planet is known as the Red Planet?",
-            "", "It looks reddish from space.",
-            {"Mercury","Venus","Earth","Mars"},
-            'D', DEFAULT_ATTEMPTS, 10, 20, false,
-            EASY_CLUE
-        };
+static OverlayEntry *allocOverlay(size_t n) {
+  size_t bytes = (n + 1) * sizeof(OverlayEntry);
+#ifdef _WIN32
+  void *p = calloc(1, bytes);
+#else
+  void *p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED)
+    p = nullptr;
+#ifdef MADV_NOHUGEPAGE
+  else
+    madvise(p, bytes, MADV_NOHUGEPAGE);
+#endif
+#endif
+  if (!p)
+    throw bad_alloc();
+  return (OverlayEntry *)p;
+}
 
-        CLUE_BANK[2] = { TEXT_ANSWER,
-            "Type the word: stack",
-            "stack", "It's a data structure: LIFO.",
-            {"","","",""},
-            'A', DEFAULT_ATTEMPTS, 10, 20, false,
-            ANY_CLUE
-        };
+static void freeOverlay(OverlayEntry *e, size_t n) {
+  if (!e)
+    return;
+#ifdef _WIN32
+  (void)n;
+  free(e);
+#else
+  munmap(e, (n + 1) * sizeof(OverlayEntry));
+#endif
+}
 
-        CLUE_BANK[3] = { TEXT_ANSWER,
-            "What is the chemical formula of water?",
-            "h2o", "Hydrogen + Oxygen.",
-            {"","","",""},
-            'A', DEFAULT_ATTEMPTS, 10, 20, false,
-            EASY_CLUE
-        };
+struct CluePools {
+  const ClueBuckets *base;
+  uint32_t size[POOL_COUNT];
+  uint32_t live[POOL_COUNT];
+  OverlayEntry *moved[POOL_COUNT]; // slot -> clue, where it differs from base
+  OverlayEntry *where[POOL_COUNT]; // clue -> slot, where it differs from base
+  uint32_t whereSize;              // entries in each where[] array
+  uint32_t stamp;
+  int generation; // bank generation the pools belong to
+
+  constexpr CluePools()
+      : base(nullptr), size(), live(), moved(), where(), whereSize(0),
+        stamp(0), generation(0) {}
+  CluePools(const CluePools &) = delete;
+  CluePools &operator=(const CluePools &) = delete;
+  ~CluePools() {
+    for (int p = 0; p < POOL_COUNT; p++) {
+      freeOverlay(moved[p], size[p]);
+      freeOverlay(where[p], whereSize);
+    }
+  }
+};
 
-        CLUE_BANK[4] = { MCQ,
-            "In C++, which symbol ends a statement?",
-            "", "End of line in code.",
-            {":",";",",","."},
-            'B', DEFAULT_ATTEMPTS, 10, 20, false,
-            EASY_CLUE
-        };
+static inline bool overlayGet(const CluePools &cp, const OverlayEntry *e,
+                              uint32_t key, uint32_t &val) {
+  if (e[key].stamp != cp.stamp)
+    return false;
+  val = e[key].val;
+  return true;
+}
 
-        CLUE_BANK[5] = { MCQ,
-            "Which data structure follows LIFO?",
-            "", "Last In First Out.",
-            {"Queue","Array","Stack","Tree"},
-            'C', DEFAULT_ATTEMPTS, 10, 20, false,
-            HARD_CLUE
-        };
+static inline void overlayPut(const CluePools &cp, OverlayEntry *e,
+                              uint32_t key, uint32_t val) {
+  e[key].stamp = cp.stamp;
+  e[key].val = val;
+}
 
-        CLUE_BANK[6] = { TEXT_ANSWER,
-            "What keyword allocates memory in C++? (one word)",
-            "new", "Used with pointers.",
-            {"","","",""},
-            'A', DEFAULT_ATTEMPTS, 10, 20, false,
-            ANY_CLUE
-        };
+// first bucket of a pool (ANY_CLUE follows it), POOL_ALL has none
+static inline int poolFirstBucket(int p) {
+  return p == POOL_EASY ? EASY_CLUE : HARD_CLUE;
+}
 
-        CLUE_BANK[7] = { MCQ,
-            "Which number is even?",
-            "", "Divisible by 2.",
-            {"9","14","21","35"},
-            'B', DEFAULT_ATTEMPTS, 10, 20, false,
-            EASY_CLUE
-        };
+static inline uint32_t poolBaseItem(const ClueBuckets &cb, int p,
+                                    uint32_t slot) {
+  if (p == POOL_ALL)
+    return slot;
+  int first = poolFirstBucket(p);
+  return slot < cb.count[first] ? cb.bucket[first][slot]
+                                : cb.bucket[ANY_CLUE][slot - cb.count[first]];
+}
 
-        CLUE_BANK[8] = { MCQ,
-            "What is 7 + 8?",
-            "", "Simple addition.",
-            {"12","13","15","16"},
-            'C', DEFAULT_ATTEMPTS, 10, 20, false,
-            EASY_CLUE
-        };
+// base slot of a clue in pool p, -1 if the pool does not hold it
+static inline int64_t poolBaseSlot(const ClueBuckets &cb, int p,
+                                   uint32_t clue) {
+  if (p == POOL_ALL)
+    return clue;
+  int first = poolFirstBucket(p);
+  if (cb.tags[clue] == first)
+    return cb.slot[clue];
+  if (cb.tags[clue] == ANY_CLUE)
+    return cb.count[first] + cb.slot[clue];
+  return -1;
+}
 
-        CLUE_BANK[9] = { TEXT_ANSWER,
-            "Enter the password: SUT",
-            "sut", "It is your university initials.",
-            {"","","",""},
-            'A', DEFAULT_ATTEMPTS, 10, 20, false,
-            EASY_CLUE
-        };
+static inline uint32_t poolItem(const CluePools &cp, int p, uint32_t slot) {
+  uint32_t v;
+  if (overlayGet(cp, cp.moved[p], slot, v))
+    return v;
+  return poolBaseItem(*cp.base, p, slot);
+}
 
-        CLUE_BANK[10] = { MCQ,
-            "Which protocol is used for routing inside an AS? (Common answer)",
-            "", "Think OSPF/RIP/EIGRP.",
-            {"HTTP","OSPF","FTP","SMTP"},
-            'B', DEFAULT_ATTEMPTS, 10, 20, false,
-            HARD_CLUE
-        };
+// O(1): every clue becomes available again
+void resetCluePools(CluePools &cp) {
+  for (int p = 0; p < POOL_COUNT; p++)
+    cp.live[p] = cp.size[p];
+  if (++cp.stamp == 0) { // wrapped: really clear once
+    for (int p = 0; p < POOL_COUNT; p++) {
+      memset(cp.moved[p], 0, (size_t)cp.size[p] * sizeof(OverlayEntry));
+      memset(cp.where[p], 0, (size_t)cp.whereSize * sizeof(OverlayEntry));
+    }
+    cp.stamp = 1;
+  }
+}
 
-        CLUE_BANK[11] = { MCQ,
-            "Which operator is used to assign a value to a variable in C++?",
-            "", "It stores a value inside a variable.",
-            {"==","=","!=","<="},
-            'B', DEFAULT_ATTEMPTS, 10, 20, false,
-            EASY_CLUE
-        };
+void initCluePools(CluePools &cp, const ClueBuckets *base) {
+  for (int p = 0; p < POOL_COUNT; p++) {
+    freeOverlay(cp.moved[p], cp.size[p]);
+    freeOverlay(cp.where[p], cp.whereSize);
+  }
+  cp.base = base;
+  cp.size[POOL_EASY] = base->count[EASY_CLUE] + base->count[ANY_CLUE];
+  cp.size[POOL_HARD] = base->count[HARD_CLUE] + base->count[ANY_CLUE];
+  cp.size[POOL_ALL] = base->clues;
+  cp.whereSize = base->clues;
+  for (int p = 0; p < POOL_COUNT; p++) {
+    cp.moved[p] = allocOverlay(cp.size[p]);
+    cp.where[p] = allocOverlay(cp.whereSize);
+  }
+  cp.stamp = 0;
+  resetCluePools(cp);
+}
 
-        CLUE_BANK[12] = { MCQ,
-            "Which keyword is used to define a class in C++?",
-            "", "It defines user-defined data types.",
-            {"struct","class","define","object"},
-            'B', DEFAULT_ATTEMPTS, 10, 20, false,
-            EASY_CLUE
-        };
+// random unused clue from pool p, -1 if the pool is exhausted
+static inline int sampleCluePool(const CluePools &cp, CluePool p,
+                                 GameRng &rng) {
+  if (cp.live[p] == 0)
+    return -1;
+  return (int)poolItem(cp, p, rngBelow(rng, cp.live[p]));
+}
 
-        CLUE_BANK[13] = { MCQ,
-            "Which symbol is used to end a statement in C++?",
+// O(1) per pool: swap the clue with the last live slot and shrink
+void takeFromCluePools(CluePools &cp, int clue) {
+  for (int p = 0; p < POOL_COUNT; p++) {
+    uint32_t slot;
+    if (!overlayGet(cp, cp.where[p], (uint32_t)clue, slot)) {
+      int64_t s = poolBaseSlot(*cp.base, p, (uint32_t)clue);
+      if (s < 0)
+        continue;
+      slot = (uint32_t)s;
+    }
+    if (slot >= cp.live[p])
+      continue;
+    uint32_t last = --cp.live[p];
+    uint32_t movedClue = poolItem(cp, p, last);
+    overlayPut(cp, cp.moved[p], slot, movedClue);
+    overlayPut(cp, cp.where[p], movedClue, slot);
+    overlayPut(cp, cp.moved[p], last, (uint32_t)clue);
+    overlayPut(cp, cp.where[p], (uint32_t)clue, last);
+  }
+}
+
+static int CLUE_BANK_GENERATION = 0;      // bumped whenever a bank is loaded
+static ClueBuckets CLUE_BUCKETS;          // current bank, read-only
+static ClueBucketStore CLUE_BUCKET_STORE; // unless the file carries them
+static thread_local CluePools USED_CLUES; // per game, per thread
+
+void resetUsedClues() {
+  if (USED_CLUES.generation != CLUE_BANK_GENERATION) {
+    initCluePools(USED_CLUES, &CLUE_BUCKETS); // first game on this thread
+    USED_CLUES.generation = CLUE_BANK_GENERATION;
+    return;
+  }
+  resetCluePools(USED_CLUES);
+}
+
+void markClueUsed(int idx) { takeFromCluePools(USED_CLUES, idx); }
+
+/* =========================
+CLUE FILES
+Banks can be loaded at startup instead of the sample:
+- text: one clue per line, TAB-separated
+    type  difficulty  points  timeLimit  correct  problem  solution  hint
+    optA  optB  optC  optD
+  type = MCQ / TEXT, difficulty = EASY / HARD / ANY, '#' starts a comment
+- binary: header + fixed-size records + one string blob
+The file is memory-mapped and every text field is a view into it,
+so nothing is copied. The mapping lives until the bank is replaced.
+========================= */
+struct MappedFile {
+  const char *data;
+  size_t size;
+#ifdef _WIN32
+  vector<char> buffer;
+#endif
+};
+
+static MappedFile BANK_FILE = {nullptr, 0};
+
+bool mapFile(const char *path, MappedFile &mf, string &err) {
+#ifdef _WIN32
+  ifstream in(path, ios::binary);
+  if (!in) {
+    err = string("cannot open ") + path;
+    return false;
+  }
+  mf.buffer.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+  mf.data = mf.buffer.data();
+  mf.size = mf.buffer.size();
+  return true;
+#else
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    err = string("cannot open ") + path + ": " + strerror(errno);
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    err = string("cannot stat ") + path;
+    close(fd);
+    return false;
+  }
+  mf.size = (size_t)st.st_size;
+  mf.data = nullptr;
+  if (mf.size > 0) {
+    void *p = mmap(nullptr, mf.size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      err = string("cannot map ") + path + ": " + strerror(errno);
+      close(fd);
+      return false;
+    }
+    mf.data = (const char *)p;
+  }
+  close(fd); // the mapping stays valid
+  return true;
+#endif
+}
+
+void unmapFile(MappedFile &mf) {
+#ifdef _WIN32
+  vector<char>().swap(mf.buffer);
+#else
+  if (mf.data)
+    munmap((void *)mf.data, mf.size);
+#endif
+  mf.data = nullptr;
+  mf.size = 0;
+}
+
+/* Binary bank (all integers little-endian)
+   version 1: header, records with (offset, length) per text field,
+              one string blob
+   version 2: header, records with interned string ids, string offset
+              table, interned strings, then the pickable clues
+              pre-bucketed by ClueDifficulty (+ slot and tag arrays),
+              so opening it needs no parsing and no per-clue work
+   version 3: version 2 + the string id of every clue's normalised
+              answers (see normalizeAnswer), interned with the texts */
+static const char CLUE_FILE_MAGIC[4] = {'E', 'R', 'C', 'B'};
+static const uint32_t CLUE_FILE_VERSION = 3;
+static const int CLUE_TEXT_FIELDS = 3 + MAX_OPTIONS; // problem..options
+
+struct BinClueHeaderV1 {
+  char magic[4];
+  uint32_t version;
+  uint32_t clueCount;
+  uint32_t finalIndex;
+  uint64_t recordsOffset; // BinClueRecordV1[clueCount]
+  uint64_t stringsOffset; // text blob
+  uint64_t stringsSize;
+};
+
+struct BinClueRecordV1 {
+  uint8_t type;    // ClueType
+  uint8_t diffTag; // ClueDifficulty
+  char correctOption;
+  uint8_t typos; // Clue::typos + 1 (0 = by length)
+  int32_t points;
+  int32_t timeLimit;
+  // problem, solution, hint, options[0..3]: ranges in the blob
+  uint32_t textOffset[CLUE_TEXT_FIELDS];
+  uint32_t textLength[CLUE_TEXT_FIELDS];
+};
+
+struct BinClueHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t clueCount;
+  uint32_t finalIndex;         // always clueCount - 1
+  uint32_t stringCount;
+  uint32_t reserved;
+  uint64_t recordsOffset;       // BinClueRecord[clueCount]
+  uint64_t stringOffsetsOffset; // uint32_t[stringCount + 1]
+  uint64_t stringsOffset;       // interned strings, back to back
+  uint64_t stringsSize;
+  uint64_t bucketOffset[3];     // uint32_t[bucketCount[d]], ascending
+  uint32_t bucketCount[3];
+  uint32_t reserved2;
+  uint64_t slotsOffset; // uint32_t[finalIndex]: position inside its bucket
+  uint64_t tagsOffset;  // uint8_t[finalIndex]: ClueDifficulty
+  // version 3 only (a version 2 header ends here)
+  uint64_t answersOffset; // uint32_t[clueCount]: string id of the answers
+};
+static const size_t CLUE_HEADER_V2_SIZE =
+    offsetof(BinClueHeader, answersOffset);
+
+struct BinClueRecord {
+  uint8_t type;    // ClueType
+  uint8_t diffTag; // ClueDifficulty
+  char correctOption;
+  uint8_t typos; // Clue::typos + 1 (0 = by length)
+  int32_t points;
+  int32_t timeLimit;
+  uint32_t text[CLUE_TEXT_FIELDS]; // string ids: problem, solution, hint,
+                                   // options[0..3]
+};
+
+// Binary banks are read in place: no Clue array is built for them
+static uint32_t BANK_VERSION = 0; // 0 = CLUE_BANK vector
+static const BinClueRecordV1 *BANK_RECORDS_V1 = nullptr;
+static const BinClueRecord *BANK_RECORDS = nullptr;
+static const uint32_t *BANK_STRING_OFFSETS = nullptr;
+static uint32_t BANK_STRING_COUNT = 0;
+static const char *BANK_STRINGS = nullptr;
+static uint64_t BANK_STRINGS_SIZE = 0;
+static int BANK_RECORD_COUNT = 0;
+
+// Normalised TEXT_ANSWER solutions of the current bank: string ids in a
+// version 3 file, else built once in finishClueBank (clue i's answers
+// are [offsets[i], offsets[i + 1]) of BANK_ANSWERS)
+static const uint32_t *BANK_ANSWER_IDS = nullptr;
+static string BANK_ANSWERS;
+static vector<uint32_t> BANK_ANSWER_OFFSETS;
+
+int clueBankSize() {
+  return BANK_VERSION ? BANK_RECORD_COUNT : (int)CLUE_BANK.size();
+}
+
+static inline string_view blobText(uint64_t off, uint64_t len) {
+  if (off + len > BANK_STRINGS_SIZE) // corrupt range: empty text
+    return string_view();
+  return string_view(BANK_STRINGS + off, len);
+}
+
+static inline string_view internedText(uint32_t id) {
+  if (id >= BANK_STRING_COUNT)
+    return string_view();
+  uint32_t off = BANK_STRING_OFFSETS[id], end = BANK_STRING_OFFSETS[id + 1];
+  return end < off ? string_view() : blobText(off, end - off);
+}
+
+static inline string_view bankAnswer(int idx) {
+  if (BANK_ANSWER_IDS)
+    return internedText(BANK_ANSWER_IDS[idx]);
+  if ((size_t)idx + 1 >= BANK_ANSWER_OFFSETS.size())
+    return string_view();
+  uint32_t off = BANK_ANSWER_OFFSETS[idx];
+  return string_view(BANK_ANSWERS.data() + off,
+                     BANK_ANSWER_OFFSETS[idx + 1] - off);
+}
+
+// Copy of clue idx (text fields stay views into the bank)
+void loadBankClue(int idx, Clue &dst) {
+  if (BANK_VERSION == 0) {
+    dst = CLUE_BANK[idx];
+    dst.answer = bankAnswer(idx);
+    return;
+  }
+  string_view text[CLUE_TEXT_FIELDS];
+  if (BANK_VERSION == 1) {
+    const BinClueRecordV1 &r = BANK_RECORDS_V1[idx];
+    dst.type = (ClueType)r.type;
+    dst.diffTag = (ClueDifficulty)r.diffTag;
+    dst.correctOption = r.correctOption;
+    dst.typos = (int)r.typos - 1;
+    dst.points = r.points;
+    dst.timeLimit = r.timeLimit;
+    for (int t = 0; t < CLUE_TEXT_FIELDS; t++)
+      text[t] = blobText(r.textOffset[t], r.textLength[t]);
+  } else {
+    const BinClueRecord &r = BANK_RECORDS[idx];
+    dst.type = (ClueType)r.type;
+    dst.diffTag = (ClueDifficulty)r.diffTag;
+    dst.correctOption = r.correctOption;
+    dst.typos = (int)r.typos - 1;
+    dst.points = r.points;
+    dst.timeLimit = r.timeLimit;
+    for (int t = 0; t < CLUE_TEXT_FIELDS; t++)
+      text[t] = internedText(r.text[t]);
+  }
+  dst.attempts = DEFAULT_ATTEMPTS;
+  dst.usedHint = false;
+  dst.problem = text[0];
+  dst.solution = text[1];
+  dst.hint = text[2];
+  for (int o = 0; o < MAX_OPTIONS; o++)
+    dst.options[o] = text[3 + o];
+  dst.answer = bankAnswer(idx);
+}
+
+ClueDifficulty bankClueTag(int idx) {
+  if (BANK_VERSION == 1)
+    return (ClueDifficulty)BANK_RECORDS_V1[idx].diffTag;
+  if (BANK_VERSION == 2)
+    return (ClueDifficulty)BANK_RECORDS[idx].diffTag;
+  return CLUE_BANK[idx].diffTag;
+}
+
+// Drop the current bank and its mapping (rooms must not outlive this)
+void unloadClueBank() {
+  vector<Clue>().swap(CLUE_BANK);
+  BANK_VERSION = 0;
+  BANK_RECORDS_V1 = nullptr;
+  BANK_RECORDS = nullptr;
+  BANK_STRING_OFFSETS = nullptr;
+  BANK_STRING_COUNT = 0;
+  BANK_STRINGS = nullptr;
+  BANK_STRINGS_SIZE = 0;
+  BANK_RECORD_COUNT = 0;
+  BANK_ANSWER_IDS = nullptr;
+  string().swap(BANK_ANSWERS);
+  vector<uint32_t>().swap(BANK_ANSWER_OFFSETS);
+  unmapFile(BANK_FILE);
+}
+
+// Called once a bank is in place: final gate + clue buckets + answers
+// (haveBuckets: CLUE_BUCKETS already points into a version 2 or 3 file)
+void finishClueBank(bool haveBuckets = false) {
+  FINAL_CLUE_INDEX = clueBankSize() - 1;
+  BANK_ANSWERS.clear();
+  BANK_ANSWER_OFFSETS.clear();
+  if (!BANK_ANSWER_IDS) {
+    BANK_ANSWER_OFFSETS.reserve(FINAL_CLUE_INDEX + 2);
+    Clue c;
+    for (int i = 0; i <= FINAL_CLUE_INDEX; i++) {
+      loadBankClue(i, c);
+      BANK_ANSWER_OFFSETS.push_back((uint32_t)BANK_ANSWERS.size());
+      if (c.type == TEXT_ANSWER)
+        appendAnswers(BANK_ANSWERS, c.solution);
+    }
+    BANK_ANSWER_OFFSETS.push_back((uint32_t)BANK_ANSWERS.size());
+  }
+  if (!haveBuckets) {
+    vector<ClueDifficulty> tags(FINAL_CLUE_INDEX > 0 ? FINAL_CLUE_INDEX : 0);
+    for (int i = 0; i < FINAL_CLUE_INDEX; i++)
+      tags[i] = bankClueTag(i);
+    buildClueBuckets(CLUE_BUCKET_STORE, CLUE_BUCKETS, tags.data(),
+                     (int)tags.size());
+  }
+  ++CLUE_BANK_GENERATION;
+}
+
+static bool parseTextInt(string_view f, int &out) {
+  if (f.empty())
+    return false;
+  size_t i = 0;
+  bool neg = (f[0] == '-');
+  if (neg)
+    i = 1;
+  if (i == f.size())
+    return false;
+  long v = 0;
+  for (; i < f.size(); i++) {
+    if (f[i] < '0' || f[i] > '9' || v > 100000000)
+      return false;
+    v = v * 10 + (f[i] - '0');
+  }
+  out = (int)(neg ? -v : v);
+  return true;
+}
+
+static bool parseClueLine(string_view line, Clue &c, string &err) {
+  string_view f[5 + CLUE_TEXT_FIELDS];
+  int n = 0;
+  size_t start = 0;
+  while (n < 5 + CLUE_TEXT_FIELDS) {
+    size_t tab = line.find('\t', start);
+    f[n++] = line.substr(start, tab == string_view::npos ? tab : tab - start);
+    if (tab == string_view::npos)
+      break;
+    start = tab + 1;
+  }
+  if (n < 8) {
+    err = "expected at least 8 TAB-separated fields";
+    return false;
+  }
+
+  if (f[0] == "MCQ")
+    c.type = MCQ;
+  else if (f[0] == "TEXT")
+    c.type = TEXT_ANSWER;
+  else {
+    err = "type must be MCQ or TEXT";
+    return false;
+  }
+
+  if (f[1] == "EASY")
+    c.diffTag = EASY_CLUE;
+  else if (f[1] == "HARD")
+    c.diffTag = HARD_CLUE;
+  else if (f[1] == "ANY")
+    c.diffTag = ANY_CLUE;
+  else {
+    err = "difficulty must be EASY, HARD or ANY";
+    return false;
+  }
+
+  if (!parseTextInt(f[2], c.points) || !parseTextInt(f[3], c.timeLimit)) {
+    err = "points and timeLimit must be integers";
+    return false;
+  }
+
+  c.correctOption = f[4].empty() ? 'A' : (char)toupper((unsigned char)f[4][0]);
+  if (c.type == MCQ && !isChoiceChar(c.correctOption)) {
+    err = "correct option must be A, B, C or D";
+    return false;
+  }
+  // TEXT: a digit in the correct column = typos --fuzzy accepts
+  c.typos = -1;
+  if (c.type == TEXT_ANSWER && f[4].size() == 1 && f[4][0] >= '0' &&
+      f[4][0] <= '9')
+    c.typos = f[4][0] - '0';
+
+  c.problem = f[5];
+  c.solution = f[6];
+  c.hint = f[7];
+  for (int o = 0; o < MAX_OPTIONS; o++)
+    c.options[o] = (8 + o < n) ? f[8 + o] : string_view();
+  c.attempts = DEFAULT_ATTEMPTS;
+  c.usedHint = false;
+  return true;
+}
+
+static bool loadClueBankText(const MappedFile &mf, string &err) {
+  string_view text(mf.data ? mf.data : "", mf.size);
+  size_t pos = 0;
+  int lineNo = 0;
+  while (pos < text.size()) {
+    size_t nl = text.find('\n', pos);
+    if (nl == string_view::npos)
+      nl = text.size();
+    string_view line = text.substr(pos, nl - pos);
+    pos = nl + 1;
+    lineNo++;
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+    if (line.empty() || line[0] == '#')
+      continue;
+
+    Clue c;
+    if (!parseClueLine(line, c, err)) {
+      err = "line " + to_string(lineNo) + ": " + err;
+      return false;
+    }
+    CLUE_BANK.push_back(c);
+  }
+  if (CLUE_BANK.size() < 2) {
+    err = "a bank needs at least one clue plus the final gate";
+    return false;
+  }
+  return true;
+}
+
+// true if [off, off + count * elem) lies inside the file, elem-aligned
+static bool sectionFits(const MappedFile &mf, uint64_t off, uint64_t count,
+                        uint64_t elem, uint64_t align) {
+  return off % align == 0 && off <= mf.size &&
+         count <= (mf.size - off) / (elem ? elem : 1);
+}
+
+static bool loadClueBankBinaryV1(const MappedFile &mf, string &err) {
+  if (mf.size < sizeof(BinClueHeaderV1)) {
+    err = "file too small for a header";
+    return false;
+  }
+  const BinClueHeaderV1 *h = (const BinClueHeaderV1 *)mf.data;
+  if (h->clueCount < 2 || h->finalIndex != h->clueCount - 1 ||
+      !sectionFits(mf, h->recordsOffset, h->clueCount,
+                   sizeof(BinClueRecordV1), alignof(BinClueRecordV1)) ||
+      !sectionFits(mf, h->stringsOffset, h->stringsSize, 1, 1)) {
+    err = "header does not match the file";
+    return false;
+  }
+  BANK_VERSION = 1;
+  BANK_RECORDS_V1 = (const BinClueRecordV1 *)(mf.data + h->recordsOffset);
+  BANK_RECORD_COUNT = (int)h->clueCount;
+  BANK_STRINGS = mf.data + h->stringsOffset;
+  BANK_STRINGS_SIZE = h->stringsSize;
+  return true;
+}
+
+// O(1): every section of a version 2 / 3 file fits inside the file
+static bool checkClueHeaderV2(const MappedFile &mf, uint32_t version,
+                              string &err) {
+  if (mf.size < (version >= 3 ? sizeof(BinClueHeader) : CLUE_HEADER_V2_SIZE)) {
+    err = "file too small for a header";
+    return false;
+  }
+  const BinClueHeader *h = (const BinClueHeader *)mf.data;
+  uint32_t pickable = h->finalIndex;
+  bool ok = h->clueCount >= 2 && h->finalIndex == h->clueCount - 1 &&
+            (uint64_t)h->bucketCount[0] + h->bucketCount[1] +
+                    h->bucketCount[2] ==
+                pickable &&
+            sectionFits(mf, h->recordsOffset, h->clueCount,
+                        sizeof(BinClueRecord), alignof(BinClueRecord)) &&
+            sectionFits(mf, h->stringOffsetsOffset,
+                        (uint64_t)h->stringCount + 1, 4, 4) &&
+            sectionFits(mf, h->stringsOffset, h->stringsSize, 1, 1) &&
+            sectionFits(mf, h->slotsOffset, pickable, 4, 4) &&
+            sectionFits(mf, h->tagsOffset, pickable, 1, 1) &&
+            (version < 3 ||
+             sectionFits(mf, h->answersOffset, h->clueCount, 4, 4));
+  for (int d = 0; d < 3 && ok; d++)
+    ok = sectionFits(mf, h->bucketOffset[d], h->bucketCount[d], 4, 4);
+  if (!ok)
+    err = "header does not match the file";
+  return ok;
+}
+
+// Points straight into the mapping: records, strings, buckets and
+// (version 3) answers are used as they are
+static bool loadClueBankBinaryV2(const MappedFile &mf, uint32_t version,
+                                 string &err) {
+  if (!checkClueHeaderV2(mf, version, err))
+    return false;
+  const BinClueHeader *h = (const BinClueHeader *)mf.data;
+
+  BANK_VERSION = 2;
+  BANK_RECORDS = (const BinClueRecord *)(mf.data + h->recordsOffset);
+  BANK_RECORD_COUNT = (int)h->clueCount;
+  BANK_STRING_OFFSETS = (const uint32_t *)(mf.data + h->stringOffsetsOffset);
+  BANK_STRING_COUNT = h->stringCount;
+  BANK_STRINGS = mf.data + h->stringsOffset;
+  BANK_STRINGS_SIZE = h->stringsSize;
+
+  for (int d = 0; d < 3; d++) {
+    CLUE_BUCKETS.bucket[d] = (const uint32_t *)(mf.data + h->bucketOffset[d]);
+    CLUE_BUCKETS.count[d] = h->bucketCount[d];
+  }
+  CLUE_BUCKETS.slot = (const uint32_t *)(mf.data + h->slotsOffset);
+  CLUE_BUCKETS.tags = (const uint8_t *)(mf.data + h->tagsOffset);
+  CLUE_BUCKETS.clues = h->finalIndex;
+  if (version >= 3)
+    BANK_ANSWER_IDS = (const uint32_t *)(mf.data + h->answersOffset);
+  return true;
+}
+
+// O(clues): the fields loadBankClue trusts are in range; the same
+// per-record checks --validate-clues makes, short of the text contents
+static bool checkClueRecords(string &err) {
+  for (int i = 0; i < BANK_RECORD_COUNT; i++) {
+    uint8_t type, diffTag, typos;
+    char correct;
+    bool textOk = true;
+    if (BANK_VERSION == 1) {
+      const BinClueRecordV1 &r = BANK_RECORDS_V1[i];
+      type = r.type, diffTag = r.diffTag, typos = r.typos;
+      correct = r.correctOption;
+      for (int t = 0; t < CLUE_TEXT_FIELDS; t++)
+        textOk &= (uint64_t)r.textOffset[t] + r.textLength[t] <=
+                  BANK_STRINGS_SIZE;
+    } else {
+      const BinClueRecord &r = BANK_RECORDS[i];
+      type = r.type, diffTag = r.diffTag, typos = r.typos;
+      correct = r.correctOption;
+      for (int t = 0; t < CLUE_TEXT_FIELDS; t++)
+        textOk &= r.text[t] < BANK_STRING_COUNT;
+      if (BANK_ANSWER_IDS)
+        textOk &= BANK_ANSWER_IDS[i] < BANK_STRING_COUNT;
+    }
+    const char *bad = type != MCQ && type != TEXT_ANSWER ? "bad type"
+                      : diffTag > ANY_CLUE               ? "bad difficulty"
+                      : type == MCQ && !isChoiceChar(correct)
+                          ? "bad correct option"
+                      : typos > MAX_ANSWER_TYPOS + 1 ? "too many typos allowed"
+                      : !textOk                      ? "text out of range"
+                                                     : nullptr;
+    if (bad) {
+      err = "clue " + to_string(i) + ": " + bad;
+      return false;
+    }
+  }
+  return true;
+}
+
+/* O(clues): the buckets, slots and tags of a version 2 / 3 file agree
+   with the records, as --validate-clues checks. The header already
+   made the bucket sizes add up to the pickable clues, so ascending
+   buckets of clues tagged for them hold each clue exactly once */
+static bool checkClueBuckets(string &err) {
+  const ClueBuckets &p = CLUE_BUCKETS;
+  for (int d = 0; d < 3; d++)
+    for (uint32_t k = 0; k < p.count[d]; k++) {
+      uint32_t c = p.bucket[d][k];
+      const char *bad = c >= p.clues ? "clue out of range"
+                        : k > 0 && p.bucket[d][k - 1] >= c ? "not ascending"
+                        : BANK_RECORDS[c].diffTag != d || p.tags[c] != d
+                            ? "clue has another difficulty"
+                        : p.slot[c] != k ? "slot table disagrees"
+                                         : nullptr;
+      if (bad) {
+        err = "bucket " + to_string(d) + "[" + to_string(k) + "]: " + bad;
+        return false;
+      }
+    }
+  return true;
+}
+
+// Replaces the current bank with the file at path (text or binary)
+bool loadClueBankFile(const char *path, string &err) {
+  unloadClueBank();
+  if (!mapFile(path, BANK_FILE, err))
+    return false;
+
+  bool ok, haveBuckets = false;
+  if (BANK_FILE.size >= 8 && memcmp(BANK_FILE.data, CLUE_FILE_MAGIC, 4) == 0) {
+    uint32_t version;
+    memcpy(&version, BANK_FILE.data + 4, 4);
+    if (version == 1) {
+      ok = loadClueBankBinaryV1(BANK_FILE, err) && checkClueRecords(err);
+    } else if (version == 2 || version == 3) {
+      ok = loadClueBankBinaryV2(BANK_FILE, version, err) &&
+           checkClueRecords(err) && checkClueBuckets(err);
+      haveBuckets = ok;
+    } else {
+      err = "unsupported version " + to_string(version);
+      ok = false;
+    }
+  } else {
+    ok = loadClueBankText(BANK_FILE, err);
+  }
+
+  if (!ok) {
+    err = string(path) + ": " + err;
+    unloadClueBank();
+    return false;
+  }
+  finishClueBank(haveBuckets);
+  return true;
+}
+
+static inline uint64_t alignUp(uint64_t v, uint64_t a) {
+  return (v + a - 1) / a * a;
+}
+
+// Writes the current bank (whatever its source) as a version 3 bank
+bool saveClueBankBinary(const char *path, string &err) {
+  int n = clueBankSize();
+  if (n < 2) {
+    err = "nothing to save";
+    return false;
+  }
+  uint32_t pickable = (uint32_t)(n - 1);
+
+  // records + interned strings (identical texts are stored once)
+  vector<BinClueRecord> recs(n);
+  vector<uint32_t> stringOffsets(1, 0);
+  string strings;
+  unordered_map<string_view, uint32_t> ids;
+  vector<Clue> keep(n); // views must outlive ids
+  vector<uint32_t> answerIds(n);
+  auto intern = [&](string_view text) {
+    auto it = ids.find(text);
+    if (it == ids.end()) {
+      it = ids.emplace(text, (uint32_t)(stringOffsets.size() - 1)).first;
+      strings.append(text.data(), text.size());
+      stringOffsets.push_back((uint32_t)strings.size());
+    }
+    return it->second;
+  };
+  for (int i = 0; i < n; i++) {
+    Clue &c = keep[i];
+    loadBankClue(i, c);
+    BinClueRecord &r = recs[i];
+    memset(&r, 0, sizeof(r));
+    r.type = (uint8_t)c.type;
+    r.diffTag = (uint8_t)c.diffTag;
+    r.correctOption = c.correctOption;
+    r.typos = (uint8_t)(c.typos + 1);
+    r.points = c.points;
+    r.timeLimit = c.timeLimit;
+    string_view text[CLUE_TEXT_FIELDS] = {c.problem,    c.solution,
+                                          c.hint,       c.options[0],
+                                          c.options[1], c.options[2],
+                                          c.options[3]};
+    for (int t = 0; t < CLUE_TEXT_FIELDS; t++)
+      r.text[t] = intern(text[t]);
+    answerIds[i] = intern(c.answer);
+  }
+
+  // buckets of the pickable clues
+  vector<ClueDifficulty> tags(pickable);
+  for (uint32_t i = 0; i < pickable; i++)
+    tags[i] = (ClueDifficulty)recs[i].diffTag;
+  ClueBucketStore store;
+  ClueBuckets cb;
+  buildClueBuckets(store, cb, tags.data(), (int)pickable);
+
+  BinClueHeader h;
+  memset(&h, 0, sizeof(h));
+  memcpy(h.magic, CLUE_FILE_MAGIC, 4);
+  h.version = CLUE_FILE_VERSION;
+  h.clueCount = (uint32_t)n;
+  h.finalIndex = pickable;
+  h.stringCount = (uint32_t)(stringOffsets.size() - 1);
+  uint64_t at = sizeof(BinClueHeader);
+  h.recordsOffset = at = alignUp(at, 8);
+  at += (uint64_t)n * sizeof(BinClueRecord);
+  h.stringOffsetsOffset = at = alignUp(at, 8);
+  at += stringOffsets.size() * 4;
+  h.stringsOffset = at;
+  h.stringsSize = strings.size();
+  at += strings.size();
+  for (int d = 0; d < 3; d++) {
+    h.bucketOffset[d] = at = alignUp(at, 8);
+    h.bucketCount[d] = cb.count[d];
+    at += (uint64_t)cb.count[d] * 4;
+  }
+  h.slotsOffset = at = alignUp(at, 8);
+  at += (uint64_t)pickable * 4;
+  h.tagsOffset = at;
+  at += pickable;
+  h.answersOffset = at = alignUp(at, 8);
+
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    err = string("cannot create ") + path;
+    return false;
+  }
+  uint64_t written = 0;
+  bool ok = true;
+  // writes len bytes at offset off, zero-padding the gap before it
+  auto put = [&](uint64_t off, const void *data, uint64_t len) {
+    static const char zeros[8] = {0};
+    while (ok && written < off) {
+      ok = fwrite(zeros, 1, 1, f) == 1;
+      written++;
+    }
+    if (ok && len)
+      ok = fwrite(data, 1, len, f) == len;
+    written += len;
+  };
+  put(0, &h, sizeof(h));
+  put(h.recordsOffset, recs.data(), (uint64_t)n * sizeof(BinClueRecord));
+  put(h.stringOffsetsOffset, stringOffsets.data(), stringOffsets.size() * 4);
+  put(h.stringsOffset, strings.data(), strings.size());
+  for (int d = 0; d < 3; d++)
+    put(h.bucketOffset[d], store.bucket[d].data(), (uint64_t)cb.count[d] * 4);
+  put(h.slotsOffset, store.slot.data(), (uint64_t)pickable * 4);
+  put(h.tagsOffset, store.tags.data(), pickable);
+  put(h.answersOffset, answerIds.data(), (uint64_t)n * 4);
+  ok = (fclose(f) == 0) && ok;
+  if (!ok)
+    err = string("write failed: ") + path;
+  return ok;
+}
+
+// Full consistency check of a binary bank (loading only checks the
+// header); prints problems to out and returns how many it found
+int validateClueBankFile(const char *path, ostream &out) {
+  MappedFile mf = {nullptr, 0};
+  string err;
+  if (!mapFile(path, mf, err)) {
+    out << err << "\n";
+    return 1;
+  }
+  int problems = 0;
+  const int maxReported = 20;
+  auto report = [&](const string &msg) {
+    if (problems++ < maxReported)
+      out << "  " << msg << "\n";
+  };
+
+  uint32_t version = 0;
+  if (mf.size < 8 || memcmp(mf.data, CLUE_FILE_MAGIC, 4) != 0) {
+    report("not a binary clue bank (bad magic)");
+  } else {
+    memcpy(&version, mf.data + 4, 4);
+    if (version != CLUE_FILE_VERSION)
+      report("version " + to_string(version) + ", expected " +
+             to_string(CLUE_FILE_VERSION) + " (re-save to upgrade)");
+    else if (!checkClueHeaderV2(mf, version, err))
+      report(err);
+  }
+  if (problems) {
+    unmapFile(mf);
+    return problems;
+  }
+
+  const BinClueHeader *h = (const BinClueHeader *)mf.data;
+  const BinClueRecord *recs = (const BinClueRecord *)(mf.data + h->recordsOffset);
+  const uint32_t *offs = (const uint32_t *)(mf.data + h->stringOffsetsOffset);
+
+  const uint32_t *answerIds =
+      (const uint32_t *)(mf.data + h->answersOffset);
+  bool rangesOk = true;
+  for (uint32_t s = 0; s < h->stringCount; s++)
+    if (offs[s + 1] < offs[s] || offs[s + 1] > h->stringsSize) {
+      report("string " + to_string(s) + " has a bad range");
+      rangesOk = false;
+      break;
+    }
+  auto text = [&](uint32_t id) {
+    const char *base = mf.data + h->stringsOffset;
+    return rangesOk ? string_view(base + offs[id], offs[id + 1] - offs[id])
+                    : string_view();
+  };
+  string expected;
+
+  for (uint32_t i = 0; i < h->clueCount; i++) {
+    const BinClueRecord &r = recs[i];
+    string where = "clue " + to_string(i) + ": ";
+    if (r.type != MCQ && r.type != TEXT_ANSWER)
+      report(where + "bad type");
+    if (r.diffTag > ANY_CLUE)
+      report(where + "bad difficulty");
+    if (r.type == MCQ && !isChoiceChar(r.correctOption))
+      report(where + "bad correct option");
+    if (r.typos > MAX_ANSWER_TYPOS + 1)
+      report(where + "too many typos allowed");
+    for (int t = 0; t < CLUE_TEXT_FIELDS; t++)
+      if (r.text[t] >= h->stringCount)
+        report(where + "text id out of range");
+    if (answerIds[i] >= h->stringCount) {
+      report(where + "answer id out of range");
+    } else if (r.type == TEXT_ANSWER && r.text[1] < h->stringCount) {
+      expected.clear();
+      appendAnswers(expected, text(r.text[1]));
+      if (text(answerIds[i]) != expected)
+        report(where + "answer is not the normalised solution");
+    }
+  }
+
+  uint32_t pickable = h->finalIndex;
+  const uint32_t *slots = (const uint32_t *)(mf.data + h->slotsOffset);
+  const uint8_t *tagArr = (const uint8_t *)(mf.data + h->tagsOffset);
+  vector<char> seen(pickable, 0);
+  for (int d = 0; d < 3; d++) {
+    const uint32_t *b = (const uint32_t *)(mf.data + h->bucketOffset[d]);
+    for (uint32_t k = 0; k < h->bucketCount[d]; k++) {
+      uint32_t c = b[k];
+      string where = "bucket " + to_string(d) + "[" + to_string(k) + "]: ";
+      if (c >= pickable) {
+        report(where + "clue out of range");
+        continue;
+      }
+      if (k > 0 && b[k - 1] >= c)
+        report(where + "not ascending");
+      if (seen[c]++)
+        report(where + "clue listed twice");
+      if (recs[c].diffTag != d || tagArr[c] != d)
+        report(where + "clue has another difficulty");
+      if (slots[c] != k)
+        report(where + "slot table disagrees");
+    }
+  }
+  for (uint32_t c = 0; c < pickable; c++)
+    if (!seen[c]) {
+      report("clue " + to_string(c) + " is in no bucket");
+      break;
+    }
+
+  if (problems > maxReported)
+    out << "  ... " << problems - maxReported << " more\n";
+  unmapFile(mf);
+  return problems;
+}
+
+    void initClueBank() {
+        unloadClueBank();
+        CLUE_BANK.resize(BUILTIN_CLUE_COUNT);
+
+        CLUE_BANK[0] = { MCQ,
+            "What does CPU stand for?",
+            "", "It's the main processor of the computer.",
+            {"Central Processing Unit","Computer Processing User","Central Program Utility","Core Power Unit"},
+            'A', DEFAULT_ATTEMPTS, 10, 20, false,
+            EASY_CLUE
+        };
+
+        CLUE_BANK[1] = { MCQ,
+            "Which planet is known as the Red Planet?",
+            "", "It looks reddish from space.",
+            {"Mercury","Venus","Earth","Mars"},
+            'D', DEFAULT_ATTEMPTS, 10, 20, false,
+            EASY_CLUE
+        };
+
+        CLUE_BANK[2] = { TEXT_ANSWER,
+            "Type the word: stack",
+            "stack", "It's a data structure: LIFO.",
+            {"","","",""},
+            'A', DEFAULT_ATTEMPTS, 10, 20, false,
+            ANY_CLUE
+        };
+
+        CLUE_BANK[3] = { TEXT_ANSWER,
+            "What is the chemical formula of water?",
+            "h2o", "Hydrogen + Oxygen.",
+            {"","","",""},
+            'A', DEFAULT_ATTEMPTS, 10, 20, false,
+            EASY_CLUE
+        };
+
+        CLUE_BANK[4] = { MCQ,
+            "In C++, which symbol ends a statement?",
+            "", "End of line in code.",
+            {":",";",",","."},
+            'B', DEFAULT_ATTEMPTS, 10, 20, false,
+            EASY_CLUE
+        };
+
+        CLUE_BANK[5] = { MCQ,
+            "Which data structure follows LIFO?",
+            "", "Last In First Out.",
+            {"Queue","Array","Stack","Tree"},
+            'C', DEFAULT_ATTEMPTS, 10, 20, false,
+            HARD_CLUE
+        };
+
+        CLUE_BANK[6] = { TEXT_ANSWER,
+            "What keyword allocates memory in C++? (one word)",
+            "new", "Used with pointers.",
+            {"","","",""},
+            'A', DEFAULT_ATTEMPTS, 10, 20, false,
+            ANY_CLUE
+        };
+
+        CLUE_BANK[7] = { MCQ,
+            "Which number is even?",
+            "", "Divisible by 2.",
+            {"9","14","21","35"},
+            'B', DEFAULT_ATTEMPTS, 10, 20, false,
+            EASY_CLUE
+        };
+
+        CLUE_BANK[8] = { MCQ,
+            "What is 7 + 8?",
+            "", "Simple addition.",
+            {"12","13","15","16"},
+            'C', DEFAULT_ATTEMPTS, 10, 20, false,
+            EASY_CLUE
+        };
+
+        CLUE_BANK[9] = { TEXT_ANSWER,
+            "Enter the password: SUT",
+            "sut", "It is your university initials.",
+            {"","","",""},
+            'A', DEFAULT_ATTEMPTS, 10, 20, false,
+            EASY_CLUE
+        };
+
+        CLUE_BANK[10] = { MCQ,
+            "Which protocol is used for routing inside an AS? (Common answer)",
+            "", "Think OSPF/RIP/EIGRP.",
+            {"HTTP","OSPF","FTP","SMTP"},
+            'B', DEFAULT_ATTEMPTS, 10, 20, false,
+            HARD_CLUE
+        };
+
+        CLUE_BANK[11] = { MCQ,
+            "Which operator is used to assign a value to a variable in C++?",
+            "", "It stores a value inside a variable.",
+            {"==","=","!=","<="},
+            'B', DEFAULT_ATTEMPTS, 10, 20, false,
+            EASY_CLUE
+        };
+
+        CLUE_BANK[12] = { MCQ,
+            "Which keyword is used to define a class in C++?",
+            "", "It defines user-defined data types.",
+            {"struct","class","define","object"},
+            'B', DEFAULT_ATTEMPTS, 10, 20, false,
+            EASY_CLUE
+        };
+
+        CLUE_BANK[13] = { MCQ,
+            "Which symbol is used to end a statement in C++?",
             "", "Every statement must end with it.",
             {":",";",".",","},
             'B', DEFAULT_ATTEMPTS, 10, 20, false,
@@ -530,240 +2212,579 @@ void resetUsedClues() {
         'A', DEFAULT_ATTEMPTS, 15, 15, false,
         ANY_CLUE
     };
+
+        finishClueBank();
     }
 /* Pick a random clue from bank and copy it
 - HARD rooms: pick HARD_CLUE أو ANY_CLUE
 - غير كده: pick EASY_CLUE أو ANY_CLUE
 */
 
-int pickRandomClueIndexForRoom(const string &roomType,
-                               const string &roomDifficulty,
+int pickRandomClueIndexForRoom(GameRng &rng, RoomType roomType,
+                               RoomDifficulty roomDifficulty,
                                bool wantFinal = false) {
   if (wantFinal)
     return FINAL_CLUE_INDEX;
+  METRIC_SPAN(SPAN_PICK_CLUE);
+  METRIC_COUNT(METRIC_CLUES_DRAWN);
 
-  bool wantHard = (roomType == "INTERMEDIATE" && roomDifficulty == "HARD");
+  bool wantHard = (roomType == ROOM_INTERMEDIATE && roomDifficulty == DIFF_HARD);
 
-  int valid[FINAL_CLUE_INDEX]; // 0..51
-  int cnt = 0;
+  int idx =
+      sampleCluePool(USED_CLUES, wantHard ? POOL_HARD : POOL_EASY, rng);
 
-  for (int i = 0; i < FINAL_CLUE_INDEX; i++) {
-    if (USED_CLUES[i])
-      continue;
-
-    if (wantHard) {
-      if (CLUE_BANK[i].diffTag == HARD_CLUE || CLUE_BANK[i].diffTag == ANY_CLUE)
-        valid[cnt++] = i;
-    } else {
-      if (CLUE_BANK[i].diffTag == EASY_CLUE || CLUE_BANK[i].diffTag == ANY_CLUE)
-        valid[cnt++] = i;
-    }
+  if (idx < 0) { // no clue of this difficulty left: any unused clue
+    METRIC_COUNT(METRIC_POOL_FALLBACK);
+    idx = sampleCluePool(USED_CLUES, POOL_ALL, rng);
   }
 
-  if (cnt == 0) {
-    for (int i = 0; i < FINAL_CLUE_INDEX; i++)
-      if (!USED_CLUES[i])
-        valid[cnt++] = i;
+  if (idx < 0) {
+    METRIC_COUNT(METRIC_POOL_EMPTY);
+    return (int)rngBelow(rng, FINAL_CLUE_INDEX);
   }
 
-  if (cnt == 0)
-    return rand() % FINAL_CLUE_INDEX;
-
-  return valid[rand() % cnt];
+  return idx;
+}
+// Copy a bank clue into a room slot (text stays in the bank)
+void assignClue(Clue &dst, int idx) {
+  loadBankClue(idx, dst);
+  dst.usedHint = false;
+  dst.attempts = DEFAULT_ATTEMPTS;
 }
-Clue pickRandomClueForRoom(const string &roomType, const string &roomDifficulty,
+
+Clue pickRandomClueForRoom(GameRng &rng, RoomType roomType,
+                           RoomDifficulty roomDifficulty,
                            bool wantFinal = false) {
   if (wantFinal) {
-    Clue c = CLUE_BANK[FINAL_CLUE_INDEX];
-    c.usedHint = false;
-    c.attempts = DEFAULT_ATTEMPTS;
+    Clue c;
+    assignClue(c, FINAL_CLUE_INDEX);
     return c;
   }
 
-  int idx = pickRandomClueIndexForRoom(roomType, roomDifficulty, false);
+  int idx = pickRandomClueIndexForRoom(rng, roomType, roomDifficulty, false);
 
-  USED_CLUES[idx] = true;
+  markClueUsed(idx);
 
-  Clue c = CLUE_BANK[idx];
-  c.usedHint = false;
-  c.attempts = DEFAULT_ATTEMPTS;
+  Clue c;
+  assignClue(c, idx);
   return c;
 }
 
+/* =========================
+TURN FRAMES
+Everything one input line makes the game print (messages,
+room, puzzle, prompt) is formatted into one reusable
+buffer and written with a single call, instead of many
+small writes and a flush per read
+========================= */
+// Appends to a string that keeps its capacity from turn to turn
+struct FrameBuf : streambuf {
+  string text;
+
+protected:
+  int_type overflow(int_type c) override {
+    if (c != traits_type::eof())
+      text.push_back((char)c);
+    return traits_type::not_eof(c);
+  }
+  streamsize xsputn(const char *s, streamsize n) override {
+    text.append(s, (size_t)n);
+    return n;
+  }
+};
+
+struct TurnFrame {
+  FrameBuf buf;
+  ostream out; // what the game code writes to
+
+  TurnFrame() : out(&buf) { buf.text.reserve(4096); }
+};
+
+#ifndef _WIN32
+// false if fd stopped taking bytes
+static bool writeAll(int fd, const char *p, size_t n) {
+  while (n > 0) {
+    ssize_t w = write(fd, p, n);
+    if (w > 0) {
+      p += w;
+      n -= (size_t)w;
+    } else if (w < 0 && errno == EINTR) {
+      continue;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+#endif
+
+// Writes the frame to fd (stdout on Windows) in one call and empties it
+bool emitFrame(TurnFrame &f, int fd = 1) {
+  string &t = f.buf.text;
+#ifdef _WIN32
+  (void)fd;
+  bool ok = fwrite(t.data(), 1, t.size(), stdout) == t.size() &&
+            fflush(stdout) == 0;
+#else
+  bool ok = writeAll(fd, t.data(), t.size());
+#endif
+  t.clear();
+  return ok;
+}
+
+// Moves the frame to the end of out (a connection's send buffer)
+static inline void takeFrame(TurnFrame &f, string &out) {
+  out += f.buf.text;
+  f.buf.text.clear();
+}
+
 /* =========================
 PRINT ROOM INFO
 ========================= */
-void printRoom(const Room *r, int score) {
-  cout << "\n========================\n";
-  cout << "Score: " << score << "\n";
-  cout << "You are in Room ID: " << r->roomID << "\n";
-  cout << "Type: " << r->roomType;
-  if (r->roomType == "INTERMEDIATE") {
-    cout << " (" << r->difficulty << ")";
+// What the player sees of a room: doors as room IDs
+static const int NO_ROOM_ID = numeric_limits<int>::min();
+
+struct RoomView {
+  int roomID;
+  RoomType roomType;
+  RoomDifficulty difficulty;
+  int clueCount;
+  int next1ID; // NO_ROOM_ID = no room behind the door
+  int next2ID;
+};
+
+void printRoomView(const RoomView &r, int score, ostream &out) {
+  out << "\n========================\n";
+  out << "Score: " << score << "\n";
+  out << "You are in Room ID: " << r.roomID << "\n";
+  out << "Type: " << roomTypeName(r.roomType);
+  if (r.roomType == ROOM_INTERMEDIATE) {
+    out << " (" << difficultyName(r.difficulty) << ")";
   }
-  cout << "\n\nDoors:\n";
+  out << "\n\nDoors:\n";
 
   // EXIT: door 1 is final puzzle (not navigation)
-  if (r->roomType == "EXIT") {
-    cout << "  1) Final Door (solve to escape)\n";
-  } else if (r->clueCount == 1) {
-    cout << "  1) Door 1 -> ";
-    if (r->next1)
-      cout << "Room " << r->next1->roomID << "\n";
+  if (r.roomType == ROOM_EXIT) {
+    out << "  1) Final Door (solve to escape)\n";
+  } else if (r.clueCount == 1) {
+    out << "  1) Door 1 -> ";
+    if (r.next1ID != NO_ROOM_ID)
+      out << "Room " << r.next1ID << "\n";
     else
-      cout << "[NONE]\n";
+      out << "[NONE]\n";
   } else {
-    cout << "  1) Door 1 -> "
-         << (r->next1 ? ("Room " + to_string(r->next1->roomID)) : "[NONE]")
-         << "\n";
-    cout << "  2) Door 2 -> "
-         << (r->next2 ? ("Room " + to_string(r->next2->roomID)) : "[NONE]")
-         << "\n";
+    out << "  1) Door 1 -> ";
+    if (r.next1ID != NO_ROOM_ID)
+      out << "Room " << r.next1ID << "\n";
+    else
+      out << "[NONE]\n";
+    out << "  2) Door 2 -> ";
+    if (r.next2ID != NO_ROOM_ID)
+      out << "Room " << r.next2ID << "\n";
+    else
+      out << "[NONE]\n";
   }
-  cout << "\n\n[Abilities]:\n";
-  cout << "  0) << RETURN TO PREVIOUS ROOM (Undo Move)\n";
-  cout << "  9) Quit Game\n";
-  cout << "========================\n";
+  out << "\n\n[Abilities]:\n";
+  out << "  0) << RETURN TO PREVIOUS ROOM (Undo Move)\n";
+  out << "  9) Quit Game\n";
+  out << "========================\n";
+}
+
+void printRoom(const Room *r, int score, ostream &out = cout) {
+  RoomView v = {r->roomID,
+                r->roomType,
+                r->difficulty,
+                r->clueCount,
+                r->next1 ? r->next1->roomID : NO_ROOM_ID,
+                r->next2 ? r->next2->roomID : NO_ROOM_ID};
+  printRoomView(v, score, out);
 }
 
 /* =========================
-SOLVE A CLUE (with hint)
-returns: true if solved
+JOURNAL EVENTS
+--journal: every turn outcome of a session as a compact event
+(see JOURNAL FILES for the file and the replayer). The game
+code reports through journalEvent(); a driver that journals
+points JOURNAL at its buffer and JOURNAL_SESSION at the
+session it is about to feed, so a game that is not journaled
+pays one test per event. An event is
+  varint session, kind byte, varint seconds after the block's
+  base time (zigzag), then JOURNAL_ARGS[kind] varints
+========================= */
+enum JournalKind : uint8_t {
+  JE_START,    // seed, score: a game on the template `--seed seed` plays
+  JE_RESUME,   // seed, room (zigzag, -1: none yet), depth, score: a
+               // checkpointed game goes on
+  JE_ENTRANCE, // room
+  JE_DOOR,     // door, clue: the puzzle behind the door opened
+  JE_HINT,     // penalty
+  JE_WRONG,    // seconds since the puzzle (re)started
+  JE_TIMEOUT,  // seconds since the puzzle (re)started
+  JE_SOLVED,   // seconds, points
+  JE_LOCKED,   // penalty: out of attempts, the door stays shut
+  JE_TRAP,     // TrapKind, on the way through a solved door
+  JE_MOVE,     // room reached through the solved door
+  JE_UNDO,     // room gone back to
+  JE_ESCAPE,   // final score
+  JE_QUIT,     // score 0 (or an invalid entrance)
+  JE_END,      // the player left (connection closed)
+  JE_KINDS
+};
+// Rooms are room IDs, clues bank indices, scores zigzag
+static const uint8_t JOURNAL_ARGS[JE_KINDS] = {2, 4, 1, 2, 1, 1, 1, 2,
+                                               1, 1, 1, 1, 1, 0, 0};
+static const char *const JOURNAL_KIND_NAMES[JE_KINDS] = {
+    "start", "resume", "entrance", "door",   "hint",
+    "wrong", "timeout", "solved",  "locked", "trap",
+    "move",  "undo",    "escape",  "quit",   "end"};
+
+struct JournalBuffer {
+  string bytes;   // events since the last block was sealed
+  uint32_t events;
+  uint64_t run;   // session numbers are unique within a run
+  time_t base;    // event times count from here (first event)
+  time_t now;     // set by the driver before it feeds a session
+};
+
+static thread_local JournalBuffer *JOURNAL = nullptr;
+static thread_local uint64_t JOURNAL_SESSION = 0;
+
+static inline uint64_t zigzag(int64_t v) {
+  return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+static inline int64_t unzigzag(uint64_t v) {
+  return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline void putVarint(string &to, uint64_t v) {
+  char b[10];
+  int n = 0;
+  while (v >= 0x80) {
+    b[n++] = (char)(v | 0x80);
+    v >>= 7;
+  }
+  b[n++] = (char)v;
+  to.append(b, n);
+}
+
+// false at the end of the data or on an overlong varint
+static inline bool getVarint(const uint8_t *&p, const uint8_t *end,
+                             uint64_t &v) {
+  v = 0;
+  for (int shift = 0; p < end && shift < 64; shift += 7) {
+    uint8_t b = *p++;
+    v |= (uint64_t)(b & 0x7f) << shift;
+    if (!(b & 0x80))
+      return true;
+  }
+  return false;
+}
+
+static void journalEvent(JournalKind kind, uint64_t a = 0, uint64_t b = 0,
+                         uint64_t c = 0, uint64_t d = 0) {
+  JournalBuffer *j = JOURNAL;
+  if (!j)
+    return;
+  if (j->events == 0)
+    j->base = j->now;
+  putVarint(j->bytes, JOURNAL_SESSION);
+  j->bytes += (char)kind;
+  putVarint(j->bytes, zigzag((int64_t)(j->now - j->base)));
+  uint64_t args[4] = {a, b, c, d};
+  for (int i = 0; i < JOURNAL_ARGS[kind]; i++)
+    putVarint(j->bytes, args[i]);
+  j->events++;
+}
+
+/* =========================
+APPLY ONE ANSWER
+(the rules behind solveClue, no I/O;
+ shared with the headless simulator)
 ========================= */
-bool solveClue(Clue &clue, int &score) {
-  cout << "\n--- Puzzle ---\n";
-  cout << clue.problem << "\n\n";
+enum AttemptResult {
+  ATTEMPT_CORRECT,
+  ATTEMPT_WRONG,
+  ATTEMPT_TIMEOUT,
+  ATTEMPT_HINT,
+  ATTEMPT_HINT_REUSED,
+  ATTEMPT_INVALID
+};
+
+// input must be non-empty; elapsed = seconds since the puzzle (re)started
+AttemptResult applyAttempt(Clue &clue, const string &input, int elapsed,
+                           int &score) {
+  METRIC_SPAN(SPAN_SOLVE_CLUE);
+  if (clue.timeLimit > 0 && elapsed > clue.timeLimit) {
+    METRIC_COUNT(METRIC_TIMEOUTS);
+    clue.attempts--;
+    return ATTEMPT_TIMEOUT;
+  }
+
+  // Hint
+  if (input.size() == 1 && (input[0] == 'H' || input[0] == 'h')) {
+    if (clue.usedHint)
+      return ATTEMPT_HINT_REUSED;
+    METRIC_COUNT(METRIC_HINTS);
+    clue.usedHint = true;
+    score -= HINT_PENALTY;
+    return ATTEMPT_HINT;
+  }
+
+  bool correct = false;
 
   if (clue.type == MCQ) {
-    cout << "A) " << clue.options[0] << "\n";
-    cout << "B) " << clue.options[1] << "\n";
-    cout << "C) " << clue.options[2] << "\n";
-    cout << "D) " << clue.options[3] << "\n\n";
+    char c = (char)toupper((unsigned char)input[0]);
+    if (!isChoiceChar(c))
+      return ATTEMPT_INVALID;
+    correct = (c == clue.correctOption);
+  } else {
+    // normalised copy in a per-thread buffer (no allocation once warm)
+    static thread_local string typed;
+    typed.assign(input);
+    typed.resize(normalizeAnswer(&typed[0], typed.size()));
+    correct = matchAnswer(clue.answer, typed) ||
+              (FUZZY_ANSWERS &&
+               matchAnswerClose(clue.answer, typed, clue.typos));
   }
-  time_t startTime = time(nullptr);
-  while (clue.attempts > 0) {
-    cout << "(Attempts: " << clue.attempts << ")\n";
-    cout << "Your answer";
-    if (clue.type == MCQ)
-      cout << " (A/B/C/D)";
-    cout << " or H for hint: ";
 
-    string input;
-    getline(cin, input);
-    if (input.size() == 0)
-      continue;
+  if (correct) {
+    score += clue.points;
+    return ATTEMPT_CORRECT;
+  }
+  clue.attempts--;
+  return ATTEMPT_WRONG;
+}
 
-    if (clue.timeLimit > 0) {
-      int elapsed = (int)(time(nullptr) - startTime);
-      if (elapsed > clue.timeLimit) {
-        clue.attempts--;
-        cout << "Time out! Wrong.\n";
-        startTime = time(nullptr);
-        continue;
-      }
-    }
+/* =========================
+SOLVE A CLUE (with hint)
+Resumable: beginClue() shows the puzzle, then every
+input line goes to answerClue() until it is solved
+or out of attempts (no blocking reads, so one thread
+can drive many players)
+========================= */
+enum ClueStep { CLUE_PENDING, CLUE_SOLVED, CLUE_LOCKED };
 
-    // Hint
-    if (input.size() == 1 && (input[0] == 'H' || input[0] == 'h')) {
-      if (!clue.usedHint) {
-        clue.usedHint = true;
-        score -= HINT_PENALTY;
-        cout << "Hint (-" << HINT_PENALTY << "): " << clue.hint << "\n";
-      } else {
-        cout << "Hint already used.\n";
-      }
-      startTime = time(nullptr);
-      continue;
-    }
+// Clock of the time limits: a replay sets it to the second each
+// recorded line came (0 = the real clock)
+static thread_local time_t CLUE_CLOCK = 0;
 
-    bool correct = false;
+static inline time_t clueNow() {
+  return CLUE_CLOCK ? CLUE_CLOCK : time(nullptr);
+}
 
-    if (clue.type == MCQ) {
-      char c = (char)toupper((unsigned char)input[0]);
-      if (!isChoiceChar(c)) {
-        cout << "Invalid choice. Enter A/B/C/D or H.\n";
-        continue;
-      }
-      correct = (c == clue.correctOption);
-    } else {
-      string ans = toLowerStr(input);
-      correct = (ans == toLowerStr(clue.solution));
-    }
+static void promptClue(const Clue &clue, ostream &out) {
+  out << "(Attempts: " << clue.attempts << ")\n";
+  out << "Your answer";
+  if (clue.type == MCQ)
+    out << " (A/B/C/D)";
+  out << " or H for hint: ";
+}
 
-    if (correct) {
-      cout << "Correct!\n";
-      score += clue.points;
-      return true;
-    } else {
-      clue.attempts--;
-      cout << "Wrong.\n";
+static ClueStep clueLocked(ostream &out) {
+  out << "Door remains LOCKED. (No attempts left)\n";
+  out << "You are trapped inside the game!\n";
+  return CLUE_LOCKED;
+}
+
+// startTime: when the time limit started counting (kept by the caller)
+ClueStep beginClue(const Clue &clue, time_t &startTime, ostream &out) {
+  out << "\n--- Puzzle ---\n";
+  out << clue.problem << "\n\n";
+
+  if (clue.type == MCQ) {
+    out << "A) " << clue.options[0] << "\n";
+    out << "B) " << clue.options[1] << "\n";
+    out << "C) " << clue.options[2] << "\n";
+    out << "D) " << clue.options[3] << "\n\n";
+  }
+  startTime = clueNow();
+  if (clue.attempts <= 0)
+    return clueLocked(out);
+  promptClue(clue, out);
+  return CLUE_PENDING;
+}
+
+// One line typed at the answer prompt
+ClueStep answerClue(Clue &clue, const string &input, time_t &startTime,
+                    int &score, ostream &out) {
+  if (input.size() != 0) {
+    // never negative (as in expireClue): the wall clock can step back
+    int elapsed = (int)max<time_t>(0, clueNow() - startTime);
+    switch (applyAttempt(clue, input, elapsed, score)) {
+    case ATTEMPT_TIMEOUT:
+      journalEvent(JE_TIMEOUT, (uint64_t)elapsed);
+      out << "Time out! Wrong.\n";
+      startTime = clueNow();
+      break;
+    case ATTEMPT_HINT:
+      journalEvent(JE_HINT, (uint64_t)HINT_PENALTY);
+      out << "Hint (-" << HINT_PENALTY << "): " << clue.hint << "\n";
+      startTime = clueNow();
+      break;
+    case ATTEMPT_HINT_REUSED:
+      out << "Hint already used.\n";
+      startTime = clueNow();
+      break;
+    case ATTEMPT_INVALID:
+      out << "Invalid choice. Enter A/B/C/D or H.\n";
+      break;
+    case ATTEMPT_CORRECT:
+      journalEvent(JE_SOLVED, (uint64_t)elapsed, (uint64_t)clue.points);
+      out << "Correct!\n";
+      return CLUE_SOLVED;
+    case ATTEMPT_WRONG:
+      journalEvent(JE_WRONG, (uint64_t)elapsed);
+      out << "Wrong.\n";
+      break;
     }
   }
+  if (clue.attempts <= 0)
+    return clueLocked(out);
+  promptClue(clue, out);
+  return CLUE_PENDING;
+}
 
-  cout << "Door remains LOCKED. (No attempts left)\n";
-  cout << "You are trapped inside the game!\n";
-  return false;
+// The time limit ran out before any answer came (a real timer,
+// not the elapsed check in applyAttempt): same penalty, new try
+ClueStep expireClue(Clue &clue, time_t &startTime, ostream &out) {
+  METRIC_COUNT(METRIC_TIMEOUTS);
+  journalEvent(JE_TIMEOUT, (uint64_t)max<time_t>(0, clueNow() - startTime));
+  clue.attempts--;
+  out << "\nTime out! Wrong.\n";
+  startTime = clueNow();
+  if (clue.attempts <= 0)
+    return clueLocked(out);
+  promptClue(clue, out);
+  return CLUE_PENDING;
+}
+
+// Seconds-resolution deadline the elapsed check uses: the first
+// moment `time() - startTime > timeLimit` holds; 0 = no limit
+static inline time_t clueDeadline(const Clue &clue, time_t startTime) {
+  return clue.timeLimit > 0 ? startTime + clue.timeLimit + 1 : 0;
 }
 
 /* =========================
 RANDOMIZE EASY ROOM DOORS
 (swap next1/next2 + swap their clues)
 ========================= */
-void randomizeEasyDoors(Room *r) {
+void randomizeEasyDoors(GameRng &rng, Room *r) {
   if (!r || r->clueCount != 2)
     return;
-  if (rand() % 2 == 0) {
+  if (rngBelow(rng, 2) == 0) {
     Room *t = r->next1;
     r->next1 = r->next2;
     r->next2 = t;
 
-    Clue tc = r->clues[0];
-    r->clues[0] = r->clues[1];
-    r->clues[1] = tc;
+    swap(r->clueIndex[0], r->clueIndex[1]);
+    swap(r->trap[0], r->trap[1]);
+    swap(r->clues[0], r->clues[1]);
   }
 }
-void shuffleRooms(Room **arr, int n) {
+void shuffleRooms(GameRng &rng, Room **arr, int n) {
   for (int i = n - 1; i > 0; --i) {
-    int j = rand() % (i + 1);
+    int j = (int)rngBelow(rng, i + 1);
     Room *tmp = arr[i];
     arr[i] = arr[j];
     arr[j] = tmp;
   }
 }
 
+/* =========================
+ASSIGN ROOM CLUES
+(EASY rooms get two doors, EXIT gets the final gate)
+========================= */
+// Bank indices for a room's doors; returns how many doors have a clue
+int pickRoomClues(GameRng &rng, RoomType type, RoomDifficulty diff,
+                  int idx[MAX_CLUES_PER_ROOM]) {
+  if (type == ROOM_INTERMEDIATE && diff == DIFF_EASY) {
+    idx[0] = pickRandomClueIndexForRoom(rng, type, diff, false);
+    markClueUsed(idx[0]);
+
+    // idx[0] has left the pools, so idx[1] differs unless the bank ran dry
+    idx[1] = pickRandomClueIndexForRoom(rng, type, diff, false);
+    markClueUsed(idx[1]);
+    return 2;
+  }
+  if (type == ROOM_EXIT) {
+    idx[0] = FINAL_CLUE_INDEX;
+    return 1;
+  }
+  idx[0] = pickRandomClueIndexForRoom(rng, type, diff, false);
+  markClueUsed(idx[0]);
+  return 1;
+}
+
+void assignRoomClues(GameRng &rng, Room *r) {
+  r->clueCount = pickRoomClues(rng, r->roomType, r->difficulty, r->clueIndex);
+  for (int d = 0; d < r->clueCount; d++)
+    assignClue(r->clues[d], r->clueIndex[d]);
+}
+
 /* =========================
 BUILD MAP (Linked nodes)
 ========================= */
 struct GameMap {
-  Room *entrances[4];
-  Room *exits[2];
+  Room **entrances;
+  int entranceCount;
+  Room **exits;
+  int exitCount;
 
-  Room *all[20];
+  Room **all;
   int count;
+
+  GameArena *arena; // owner of the rooms, nullptr = heap
+  Room *roomBlock;  // heap: rooms allocated as one array (loaded maps)
+  Room **lists;     // heap: storage behind entrances/exits/all
 };
 
-void addToAll(GameMap &gm, Room *r) { gm.all[gm.count++] = r; }
+static const int BUILTIN_ROOM_COUNT = 14;
 
-GameMap buildMap() {
+// Empty map with room for the given numbers of entrances/exits/rooms
+GameMap newGameMap(int entrances, int exits, int rooms, GameArena *arena) {
   GameMap gm;
-  gm.count = 0;
+  gm.arena = arena;
+  gm.roomBlock = nullptr;
+  gm.lists = nullptr;
+  size_t total = (size_t)entrances + exits + rooms;
+  Room **base;
+  if (arena) {
+    reserveArenaRooms(*arena, rooms);
+    if (arena->lists.size() < total)
+      arena->lists.resize(total);
+    base = arena->lists.data();
+  } else {
+    base = gm.lists = new Room *[total];
+  }
+  gm.entrances = base;
+  gm.exits = base + entrances;
+  gm.all = base + entrances + exits;
+  gm.entranceCount = gm.exitCount = gm.count = 0;
+  return gm;
+}
+
+void addToAll(GameMap &gm, Room *r) { gm.all[gm.count++] = r; }
 
-  Room *EN1 = createRoom(1, "ENTRANCE", "");
-  Room *EN2 = createRoom(2, "ENTRANCE", "");
-  Room *EN3 = createRoom(3, "ENTRANCE", "");
-  Room *EN4 = createRoom(4, "ENTRANCE", "");
+GameMap buildMap(GameRng &rng, GameArena *arena = nullptr) {
+  METRIC_SPAN(SPAN_BUILD_MAP);
+  GameMap gm = newGameMap(4, 2, BUILTIN_ROOM_COUNT, arena);
 
-  Room *I1 = createRoom(5, "INTERMEDIATE", "HARD");
-  Room *I2 = createRoom(6, "INTERMEDIATE", "EASY");
-  Room *I3 = createRoom(7, "INTERMEDIATE", "EASY");
-  Room *I4 = createRoom(8, "INTERMEDIATE", "EASY");
-  Room *I5 = createRoom(9, "INTERMEDIATE", "HARD");
-  Room *I6 = createRoom(10, "INTERMEDIATE", "HARD");
-  Room *I7 = createRoom(11, "INTERMEDIATE", "EASY");
-  Room *I8 = createRoom(12, "INTERMEDIATE", "EASY");
+  Room *EN1 = createRoom(1, ROOM_ENTRANCE, DIFF_NONE, arena);
+  Room *EN2 = createRoom(2, ROOM_ENTRANCE, DIFF_NONE, arena);
+  Room *EN3 = createRoom(3, ROOM_ENTRANCE, DIFF_NONE, arena);
+  Room *EN4 = createRoom(4, ROOM_ENTRANCE, DIFF_NONE, arena);
 
-  Room *EX1 = createRoom(99, "EXIT", "");
-  Room *EX2 = createRoom(100, "EXIT", "");
+  Room *I1 = createRoom(5, ROOM_INTERMEDIATE, DIFF_HARD, arena);
+  Room *I2 = createRoom(6, ROOM_INTERMEDIATE, DIFF_EASY, arena);
+  Room *I3 = createRoom(7, ROOM_INTERMEDIATE, DIFF_EASY, arena);
+  Room *I4 = createRoom(8, ROOM_INTERMEDIATE, DIFF_EASY, arena);
+  Room *I5 = createRoom(9, ROOM_INTERMEDIATE, DIFF_HARD, arena);
+  Room *I6 = createRoom(10, ROOM_INTERMEDIATE, DIFF_HARD, arena);
+  Room *I7 = createRoom(11, ROOM_INTERMEDIATE, DIFF_EASY, arena);
+  Room *I8 = createRoom(12, ROOM_INTERMEDIATE, DIFF_EASY, arena);
+
+  Room *EX1 = createRoom(99, ROOM_EXIT, DIFF_NONE, arena);
+  Room *EX2 = createRoom(100, ROOM_EXIT, DIFF_NONE, arena);
 
   addToAll(gm, EN1);
   addToAll(gm, EN2);
@@ -808,11 +2829,14 @@ GameMap buildMap() {
   I2->next2 = I4;
 
   I3->next2 = I1;
+  I3->trap[1] = TRAP_SENT_BACK;
 
   I4->next1 = EX1;
   I4->next2 = I2; // optional loop
+  I4->trap[1] = TRAP_LOOP;
 
   I7->next2 = I5;
+  I7->trap[1] = TRAP_HARD_PATH;
 
   I8->next2 = EX2;
 
@@ -821,232 +2845,6798 @@ GameMap buildMap() {
   gm.entrances[1] = EN2;
   gm.entrances[2] = EN3;
   gm.entrances[3] = EN4;
+  gm.entranceCount = 4;
 
   gm.exits[0] = EX1;
   gm.exits[1] = EX2;
+  gm.exitCount = 2;
 
   // Assign clues per room
   Room *roomsToAssign[] = {EN1, EN2, EN3, EN4, I1, I2,  I3,
                            I4,  I5,  I6,  I7,  I8, EX1, EX2};
   int total = 14;
 
-  for (int i = 0; i < total; i++) {
-    Room *r = roomsToAssign[i];
-    if (r->roomType == "INTERMEDIATE" && r->difficulty == "EASY") {
-      r->clueCount = 2;
-
-      int idx1 = pickRandomClueIndexForRoom(r->roomType, r->difficulty, false);
-      USED_CLUES[idx1] = true;
-
-      int idx2 = pickRandomClueIndexForRoom(r->roomType, r->difficulty, false);
-      while (idx2 == idx1) { // زيادة أمان (غالبًا مش هتحصل)
-        idx2 = pickRandomClueIndexForRoom(r->roomType, r->difficulty, false);
-      }
-      USED_CLUES[idx2] = true;
-
-      r->clues[0] = CLUE_BANK[idx1];
-      r->clues[1] = CLUE_BANK[idx2];
-
-      r->clues[0].usedHint = false;
-      r->clues[0].attempts = DEFAULT_ATTEMPTS;
-      r->clues[1].usedHint = false;
-      r->clues[1].attempts = DEFAULT_ATTEMPTS;
-    } else if (r->roomType == "EXIT") {
-      r->clueCount = 1;
-      r->clues[0] = pickRandomClueForRoom(r->roomType, r->difficulty, true);
-    } else {
-      r->clueCount = 1;
-      r->clues[0] = pickRandomClueForRoom(r->roomType, r->difficulty, false);
-    }
-  }
+  for (int i = 0; i < total; i++)
+    assignRoomClues(rng, roomsToAssign[i]);
 
   // Randomize easy doors
-  randomizeEasyDoors(I2);
-  randomizeEasyDoors(I3);
-  randomizeEasyDoors(I4);
-  randomizeEasyDoors(I7);
-  randomizeEasyDoors(I8);
+  randomizeEasyDoors(rng, I2);
+  randomizeEasyDoors(rng, I3);
+  randomizeEasyDoors(rng, I4);
+  randomizeEasyDoors(rng, I7);
+  randomizeEasyDoors(rng, I8);
 
   return gm;
 }
 
 void freeMap(GameMap &gm) {
-  for (int i = 0; i < gm.count; i++) {
-    delete gm.all[i];
-    gm.all[i] = nullptr;
+  if (!gm.arena) {
+    if (gm.roomBlock)
+      delete[] gm.roomBlock;
+    else
+      for (int i = 0; i < gm.count; i++)
+        delete gm.all[i];
+    delete[] gm.lists;
   }
-  gm.count = 0;
+  gm.roomBlock = nullptr;
+  gm.lists = nullptr;
+  gm.all = gm.entrances = gm.exits = nullptr;
+  gm.count = gm.entranceCount = gm.exitCount = 0;
 }
 
 /* =========================
-GAME LOOP
+COMPACT MAP
+16-byte nodes: doors are room indices, clues are
+CLUE_BANK indices (text and options stay in the bank)
 ========================= */
-struct PathNode {
-  Room *r;
-  PathNode *next;
+static const int32_t NO_ROOM = -1;
+static const uint32_t NO_CLUE = 0xFFFFFF;
+
+struct CompactRoom {
+  int32_t next1; // door 1 (room index, NO_ROOM = none)
+  int32_t next2; // door 2
+  uint32_t clue1 : 24;     // CLUE_BANK index behind door 1
+  uint32_t type : 4;       // RoomType
+  uint32_t difficulty : 4; // RoomDifficulty
+  uint32_t clue2 : 24;     // CLUE_BANK index behind door 2
+  uint32_t clueCount : 2;
+  uint32_t visited : 1;
+  uint32_t cleared : 1;
+  uint32_t trap1 : 2; // TrapKind behind door 1
+  uint32_t trap2 : 2; // TrapKind behind door 2
 };
+static_assert(sizeof(CompactRoom) == 16, "CompactRoom must stay 16 bytes");
 
-void pushPath(PathNode *&top, Room *r) {
-  PathNode *n = new PathNode{r, top};
-  top = n;
-}
+struct CompactMap {
+  vector<CompactRoom> rooms;
+  vector<int> roomIDs; // cold: IDs shown to the player
+  vector<int> entrances;
+  vector<int> exits;
+};
 
-Room *popPath(PathNode *&top) {
-  if (!top)
-    return nullptr;
-  PathNode *n = top;
-  Room *r = n->r;
-  top = n->next;
-  delete n;
-  return r;
+// Same topology and clue assignment as gm, indexed like gm.all
+void buildCompactMap(const GameMap &gm, CompactMap &cm) {
+  unordered_map<const Room *, int> index;
+  index.reserve(gm.count);
+  for (int i = 0; i < gm.count; i++)
+    index[gm.all[i]] = i;
+  auto indexOf = [&](const Room *r) { return r ? index[r] : NO_ROOM; };
+
+  cm.rooms.resize(gm.count);
+  cm.roomIDs.resize(gm.count);
+  for (int i = 0; i < gm.count; i++) {
+    const Room *r = gm.all[i];
+    CompactRoom &c = cm.rooms[i];
+    c.next1 = indexOf(r->next1);
+    c.next2 = indexOf(r->next2);
+    c.clue1 = r->clueIndex[0] >= 0 ? (uint32_t)r->clueIndex[0] : NO_CLUE;
+    c.clue2 = r->clueIndex[1] >= 0 ? (uint32_t)r->clueIndex[1] : NO_CLUE;
+    c.type = r->roomType;
+    c.difficulty = r->difficulty;
+    c.clueCount = r->clueCount;
+    c.visited = r->visited;
+    c.cleared = r->cleared;
+    c.trap1 = r->trap[0];
+    c.trap2 = r->trap[1];
+    cm.roomIDs[i] = r->roomID;
+  }
+  cm.entrances.resize(gm.entranceCount);
+  for (int i = 0; i < gm.entranceCount; i++)
+    cm.entrances[i] = indexOf(gm.entrances[i]);
+  cm.exits.resize(gm.exitCount);
+  for (int i = 0; i < gm.exitCount; i++)
+    cm.exits[i] = indexOf(gm.exits[i]);
 }
 
-void freePath(PathNode *&top) {
-  while (top)
-    popPath(top);
+/* =========================
+MAP FILES
+Text graph, one statement per line ('#' starts a comment):
+  room <id> ENTRANCE|INTERMEDIATE|EXIT [EASY|HARD]
+  door <from-id> <to-id> [SENT_BACK|LOOP|HARD_PATH]
+The first door of a room is door 1, the second door 2.
+Rooms live in a CompactMap (one contiguous array);
+clues are picked when a game materializes the map.
+========================= */
+static CompactMap LOADED_MAP;          // --map FILE, empty = built-in map
+static bool HAVE_LOADED_MAP = false;
+
+// Doors a room of this kind may have (ENTRANCE/HARD 1, EASY 2, EXIT none)
+static int maxDoors(RoomType type, RoomDifficulty diff) {
+  if (type == ROOM_EXIT)
+    return 0;
+  return (type == ROOM_INTERMEDIATE && diff == DIFF_EASY) ? 2 : 1;
 }
 
-const char *getTrapMessage(Room *current, Room *nextRoom) {
-  if (!current || !nextRoom)
-    return nullptr;
-  if (current->roomID == 7 && nextRoom->roomID == 5) { // I3 -> I1
-    return "\n[TRAP TRIGGERED] OH NO! This door was a trap! You have been sent "
-           "back to the beginning of the sector!\n";
-  } else if (current->roomID == 8 && nextRoom->roomID == 6) { // I4 -> I2
-    return "\n[TRAP TRIGGERED] INFINITE LOOP! You are running in circles!\n";
-  } else if (current->roomID == 11 && nextRoom->roomID == 9) { // I7 -> I5
-    return "\n[TRAP TRIGGERED] HARD PATH! You fell into a high-difficulty "
-           "zone!\n";
+// Splits a line into at most n blank-separated words, returns the count
+static int splitWords(string_view line, string_view *w, int n) {
+  int count = 0;
+  size_t i = 0;
+  while (i < line.size()) {
+    while (i < line.size() && (line[i] == ' ' || line[i] == '\t'))
+      i++;
+    if (i == line.size() || line[i] == '#')
+      break;
+    size_t start = i;
+    while (i < line.size() && line[i] != ' ' && line[i] != '\t')
+      i++;
+    if (count == n)
+      return n + 1; // too many
+    w[count++] = line.substr(start, i - start);
   }
-  return nullptr;
+  return count;
 }
 
-int main() {
-  srand((unsigned)time(0));
-  initClueBank();
-  resetUsedClues();
-  GameMap gm = buildMap();
+static bool parseTrapKind(string_view w, TrapKind &out) {
+  if (w == "SENT_BACK")
+    out = TRAP_SENT_BACK;
+  else if (w == "LOOP")
+    out = TRAP_LOOP;
+  else if (w == "HARD_PATH")
+    out = TRAP_HARD_PATH;
+  else
+    return false;
+  return true;
+}
+
+static const char *trapKindName(TrapKind t) {
+  return t == TRAP_SENT_BACK ? "SENT_BACK"
+         : t == TRAP_LOOP    ? "LOOP"
+         : t == TRAP_HARD_PATH ? "HARD_PATH"
+                               : "";
+}
 
-  cout << "==== Escape Room Game (Linked List) ====\n";
-  cout << "Choose an entrance:\n";
-  cout << "  1) EN1\n  2) EN2\n  3) EN3\n  4) EN4\n";
-  cout << "Enter choice (1-4): ";
+struct PendingDoor {
+  int from;
+  int to;
+  TrapKind trap;
+  int line;
+};
 
-  int start = 0;
-  cin >> start;
-  flushInputLine();
+// Parses a map file into cm (doors may name rooms declared later)
+bool loadMapGraph(const char *path, CompactMap &cm, string &err) {
+  MappedFile mf = {nullptr, 0};
+  if (!mapFile(path, mf, err))
+    return false;
+  string_view text(mf.data ? mf.data : "", mf.size);
+
+  cm.rooms.clear();
+  cm.roomIDs.clear();
+  cm.entrances.clear();
+  cm.exits.clear();
+  unordered_map<int, int> indexOfID;
+  indexOfID.reserve(text.size() / 32); // ~2 statements per room
+  vector<PendingDoor> doors;
+
+  size_t pos = 0;
+  int lineNo = 0;
+  bool ok = true;
+  while (ok && pos < text.size()) {
+    size_t nl = text.find('\n', pos);
+    if (nl == string_view::npos)
+      nl = text.size();
+    string_view line = text.substr(pos, nl - pos);
+    pos = nl + 1;
+    lineNo++;
+    if (!line.empty() && line.back() == '\r')
+      line.remove_suffix(1);
+
+    string_view w[4];
+    int n = splitWords(line, w, 4);
+    if (n == 0)
+      continue;
 
-  if (start < 1 || start > 4) {
-    cout << "Invalid. Exiting.\n";
-    freeMap(gm);
-    return 0;
+    if (w[0] == "room" && (n == 3 || n == 4)) {
+      int id;
+      CompactRoom c;
+      memset(&c, 0, sizeof(c));
+      c.next1 = c.next2 = NO_ROOM;
+      c.clue1 = c.clue2 = NO_CLUE;
+      if (!parseTextInt(w[1], id)) {
+        err = "room id must be an integer";
+      } else if (w[2] == "ENTRANCE" && n == 3) {
+        c.type = ROOM_ENTRANCE;
+      } else if (w[2] == "EXIT" && n == 3) {
+        c.type = ROOM_EXIT;
+      } else if (w[2] == "INTERMEDIATE" && n == 4 &&
+                 (w[3] == "EASY" || w[3] == "HARD")) {
+        c.type = ROOM_INTERMEDIATE;
+        c.difficulty = w[3] == "EASY" ? DIFF_EASY : DIFF_HARD;
+      } else {
+        err = "expected ENTRANCE, EXIT or INTERMEDIATE EASY|HARD";
+      }
+      if (err.empty() && !indexOfID.emplace(id, (int)cm.rooms.size()).second)
+        err = "room " + to_string(id) + " declared twice";
+      if (err.empty()) {
+        if (c.type == ROOM_ENTRANCE)
+          cm.entrances.push_back((int)cm.rooms.size());
+        else if (c.type == ROOM_EXIT)
+          cm.exits.push_back((int)cm.rooms.size());
+        cm.rooms.push_back(c);
+        cm.roomIDs.push_back(id);
+      }
+    } else if (w[0] == "door" && (n == 3 || n == 4)) {
+      PendingDoor d;
+      d.trap = TRAP_NONE;
+      d.line = lineNo;
+      if (!parseTextInt(w[1], d.from) || !parseTextInt(w[2], d.to))
+        err = "door ends must be room ids";
+      else if (n == 4 && !parseTrapKind(w[3], d.trap))
+        err = "trap must be SENT_BACK, LOOP or HARD_PATH";
+      else
+        doors.push_back(d);
+    } else {
+      err = "expected 'room ID TYPE [DIFFICULTY]' or 'door FROM TO [TRAP]'";
+    }
+    if (!err.empty()) {
+      err = "line " + to_string(lineNo) + ": " + err;
+      ok = false;
+    }
+  }
+  unmapFile(mf);
+
+  for (size_t i = 0; ok && i < doors.size(); i++) {
+    const PendingDoor &d = doors[i];
+    unordered_map<int, int>::const_iterator from = indexOfID.find(d.from);
+    unordered_map<int, int>::const_iterator to = indexOfID.find(d.to);
+    if (from == indexOfID.end() || to == indexOfID.end()) {
+      err = "line " + to_string(d.line) + ": unknown room " +
+            to_string(from == indexOfID.end() ? d.from : d.to);
+      ok = false;
+      break;
+    }
+    CompactRoom &c = cm.rooms[from->second];
+    int used = (c.next1 != NO_ROOM) + (c.next2 != NO_ROOM);
+    if (used == maxDoors((RoomType)c.type, (RoomDifficulty)c.difficulty)) {
+      err = "line " + to_string(d.line) + ": room " + to_string(d.from) +
+            " has no free door";
+      ok = false;
+    } else if (used == 0) {
+      c.next1 = to->second;
+      c.trap1 = d.trap;
+    } else {
+      c.next2 = to->second;
+      c.trap2 = d.trap;
+    }
+  }
+  if (!ok) {
+    cm = CompactMap();
+    return false;
   }
+  for (size_t i = 0; i < cm.rooms.size(); i++) {
+    CompactRoom &c = cm.rooms[i];
+    c.clueCount =
+        (c.type == ROOM_INTERMEDIATE && c.difficulty == DIFF_EASY) ? 2 : 1;
+  }
+  return true;
+}
 
-  Room *current = gm.entrances[start - 1];
-  int score = 100;
-  PathNode *history = nullptr;
-  pushPath(history, current);
+/* Every entrance must reach an exit: one BFS from all exits
+   over reversed doors (CSR arrays), O(rooms + doors) */
+// Doors reversed as CSR: the rooms with a door into room r are
+// from[start[r] .. start[r + 1])
+void buildReverseDoors(const CompactMap &cm, vector<int> &start,
+                       vector<int> &from) {
+  int n = (int)cm.rooms.size();
+  start.assign(n + 1, 0);
+  for (int i = 0; i < n; i++) {
+    if (cm.rooms[i].next1 != NO_ROOM)
+      start[cm.rooms[i].next1 + 1]++;
+    if (cm.rooms[i].next2 != NO_ROOM)
+      start[cm.rooms[i].next2 + 1]++;
+  }
+  for (int i = 0; i < n; i++)
+    start[i + 1] += start[i];
+  from.resize(start[n]);
+  vector<int> fill(start.begin(), start.end() - 1);
+  for (int i = 0; i < n; i++) {
+    if (cm.rooms[i].next1 != NO_ROOM)
+      from[fill[cm.rooms[i].next1]++] = i;
+    if (cm.rooms[i].next2 != NO_ROOM)
+      from[fill[cm.rooms[i].next2]++] = i;
+  }
+}
 
-  while (true) {
-    current->visited = true;
+bool validateMapGraph(const CompactMap &cm, string &err) {
+  int n = (int)cm.rooms.size();
+  if (cm.entrances.empty() || cm.exits.empty()) {
+    err = "a map needs at least one entrance and one exit";
+    return false;
+  }
 
-    printRoom(current, score);
-    cout << "Enter choice: ";
+  vector<int> start, from;
+  buildReverseDoors(cm, start, from);
 
-    int choice;
-    cin >> choice;
-    flushInputLine();
+  vector<unsigned char> reaches(n, 0);
+  vector<int> queue;
+  queue.reserve(n);
+  for (size_t e = 0; e < cm.exits.size(); e++) {
+    reaches[cm.exits[e]] = 1;
+    queue.push_back(cm.exits[e]);
+  }
+  for (size_t q = 0; q < queue.size(); q++) {
+    int r = queue[q];
+    for (int k = start[r]; k < start[r + 1]; k++)
+      if (!reaches[from[k]]) {
+        reaches[from[k]] = 1;
+        queue.push_back(from[k]);
+      }
+  }
 
-    // Quit
-    if (choice == 9) {
-      score = 0;  
-      cout << "\n=== You have been kicked out of the game! ===\n";
-      cout << "Quitting... Final Score: " << score << "\n";
-      break;
+  for (size_t e = 0; e < cm.entrances.size(); e++)
+    if (!reaches[cm.entrances[e]]) {
+      err = "entrance " + to_string(cm.roomIDs[cm.entrances[e]]) +
+            " cannot reach any exit";
+      return false;
     }
+  return true;
+}
 
-    // Back
-    // Back (History Stack)
-    if (choice == 0) {
-      if (history && history->next) {
-        popPath(history);     // شيل الحالية
-        current = history->r; // ارجع للي قبلها
-      } else {
-        cout << "No previous room.\n";
-      }
-      continue;
+bool saveMapGraph(const CompactMap &cm, const char *path, string &err) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    err = string("cannot create ") + path;
+    return false;
+  }
+  fputs("# room <id> <type> [difficulty] / door <from> <to> [trap]\n", f);
+  for (size_t i = 0; i < cm.rooms.size(); i++) {
+    const CompactRoom &c = cm.rooms[i];
+    fprintf(f, "room %d %s", cm.roomIDs[i], roomTypeName((RoomType)c.type));
+    if (c.type == ROOM_INTERMEDIATE)
+      fprintf(f, " %s", difficultyName((RoomDifficulty)c.difficulty));
+    fputc('\n', f);
+  }
+  for (size_t i = 0; i < cm.rooms.size(); i++) {
+    const CompactRoom &c = cm.rooms[i];
+    int next[2] = {c.next1, c.next2};
+    TrapKind trap[2] = {(TrapKind)c.trap1, (TrapKind)c.trap2};
+    for (int d = 0; d < 2; d++) {
+      if (next[d] == NO_ROOM)
+        continue;
+      fprintf(f, "door %d %d", cm.roomIDs[i], cm.roomIDs[next[d]]);
+      if (trap[d] != TRAP_NONE)
+        fprintf(f, " %s", trapKindName(trap[d]));
+      fputc('\n', f);
     }
+  }
+  bool ok = fclose(f) == 0;
+  if (!ok)
+    err = string("write failed: ") + path;
+  return ok;
+}
 
-    // ✅ EXIT room behavior: door 1 solves final puzzle (NOT navigation)
-    if (current->roomType == "EXIT") {
-      if (choice == 1) {
-        bool win = solveClue(current->clues[0], score);
-        if (win) {
-          cout << "\nYOU ESCAPED! Final Score: " << score << "\n";
-          break;
-        } else {
-          cout << "Final gate locked. You remain at the exit room.\n";
-        }
-      } else {
-        cout << "Invalid door.\n";
-      }
-      continue;
-    }
+// Rooms for one game: contiguous block (heap) or the arena's array
+GameMap buildMapFromGraph(GameRng &rng, const CompactMap &cm,
+                          GameArena *arena = nullptr) {
+  METRIC_SPAN(SPAN_BUILD_MAP);
+  int n = (int)cm.rooms.size();
+  GameMap gm = newGameMap((int)cm.entrances.size(), (int)cm.exits.size(), n,
+                          arena);
+  Room *rooms = arena ? arena->rooms.data() : (gm.roomBlock = new Room[n]);
+  if (arena)
+    arena->roomsUsed = n;
+
+  for (int i = 0; i < n; i++) {
+    const CompactRoom &c = cm.rooms[i];
+    Room *r = &rooms[i];
+    initRoom(r, cm.roomIDs[i], (RoomType)c.type, (RoomDifficulty)c.difficulty);
+    r->next1 = c.next1 != NO_ROOM ? &rooms[c.next1] : nullptr;
+    r->next2 = c.next2 != NO_ROOM ? &rooms[c.next2] : nullptr;
+    r->trap[0] = (TrapKind)c.trap1;
+    r->trap[1] = (TrapKind)c.trap2;
+    assignRoomClues(rng, r);
+    randomizeEasyDoors(rng, r);
+    addToAll(gm, r);
+  }
+  for (size_t i = 0; i < cm.entrances.size(); i++)
+    gm.entrances[gm.entranceCount++] = &rooms[cm.entrances[i]];
+  for (size_t i = 0; i < cm.exits.size(); i++)
+    gm.exits[gm.exitCount++] = &rooms[cm.exits[i]];
+  return gm;
+}
 
-    // Determine door & next room
-    int doorIndex = -1;
-    Room *nextRoom = nullptr;
+// The map a game is played on: --map FILE or the built-in one
+GameMap buildGameMap(GameRng &rng, GameArena *arena = nullptr) {
+  return HAVE_LOADED_MAP ? buildMapFromGraph(rng, LOADED_MAP, arena)
+                         : buildMap(rng, arena);
+}
 
-    if (current->clueCount == 1) {
-      if (choice != 1) {
-        cout << "Invalid door.\n";
-        continue;
-      }
-      doorIndex = 0;
-      nextRoom = current->next1;
+/* =========================
+MAZE GENERATOR
+Seeded random maps of any size. Intermediates are laid out
+in a hidden order and door 1 always leads further along it
+(or to an exit), so every room reaches an exit by
+construction; validateMapGraph() re-checks it in O(n).
+EASY door 2 is a shortcut, a trap back down the order
+(LOOP if close, SENT_BACK if far) or a HARD_PATH trap into
+a HARD room.
+========================= */
+struct MazeConfig {
+  int rooms;               // total, entrances and exits included
+  int entrances;
+  int exits;
+  double easyRatio;        // share of intermediates that are EASY
+  double trapRate;         // share of EASY second doors that are traps
+  unsigned long long seed;
+};
+
+static const int MAZE_WINDOW = 8; // door 1 jumps 1..MAZE_WINDOW rooms ahead
+
+bool generateMaze(const MazeConfig &cfg, CompactMap &cm, string &err) {
+  int inner = cfg.rooms - cfg.entrances - cfg.exits;
+  if (cfg.entrances < 1 || cfg.exits < 1 || inner < 1) {
+    err = "a maze needs at least one entrance, one exit and one other room";
+    return false;
+  }
+  GameRng rng;
+  seedRng(rng, cfg.seed);
+  auto below = [&rng](int n) { return (int)rngBelow(rng, (uint32_t)n); };
+  auto chance = [&rng](double p) { return rngUnit(rng) < p; };
+
+  // indices: entrances, intermediates in walk order, exits
+  int firstInner = cfg.entrances;
+  int firstExit = firstInner + inner;
+  cm.rooms.assign(cfg.rooms, CompactRoom());
+  cm.roomIDs.resize(cfg.rooms);
+  cm.entrances.resize(cfg.entrances);
+  cm.exits.resize(cfg.exits);
+
+  // IDs: entrances 1..E, intermediates shuffled, exits last
+  for (int i = 0; i < cfg.rooms; i++)
+    cm.roomIDs[i] = i + 1;
+  for (int i = inner - 1; i > 0; --i)
+    swap(cm.roomIDs[firstInner + i], cm.roomIDs[firstInner + below(i + 1)]);
+
+  for (int i = 0; i < cfg.rooms; i++) {
+    CompactRoom &c = cm.rooms[i];
+    c.next1 = c.next2 = NO_ROOM;
+    c.clue1 = c.clue2 = NO_CLUE;
+    if (i < firstInner) {
+      c.type = ROOM_ENTRANCE;
+      cm.entrances[i] = i;
+    } else if (i < firstExit) {
+      c.type = ROOM_INTERMEDIATE;
+      c.difficulty = chance(cfg.easyRatio) ? DIFF_EASY : DIFF_HARD;
     } else {
-      if (choice != 1 && choice != 2) {
-        cout << "Invalid door.\n";
-        continue;
-      }
-      doorIndex = (choice == 1) ? 0 : 1;
-      nextRoom = (choice == 1) ? current->next1 : current->next2;
+      c.type = ROOM_EXIT;
+      cm.exits[i - firstExit] = i;
     }
+    c.clueCount =
+        (c.type == ROOM_INTERMEDIATE && c.difficulty == DIFF_EASY) ? 2 : 1;
+  }
 
-    if (!nextRoom) {
-      cout << "This door leads nowhere.\n";
+  // entrances start somewhere in the first half of the walk
+  for (int i = 0; i < firstInner; i++)
+    cm.rooms[i].next1 = firstInner + below((inner + 1) / 2);
+
+  for (int p = 0; p < inner; p++) {
+    CompactRoom &c = cm.rooms[firstInner + p];
+    int ahead = p + 1 + below(MAZE_WINDOW);
+    c.next1 = ahead < inner ? firstInner + ahead : firstExit + below(cfg.exits);
+    if (c.difficulty != DIFF_EASY)
       continue;
-    }
 
-    // Solve door puzzle
-    bool ok = solveClue(current->clues[doorIndex], score);
-    if (!ok) {
-      cout << "\n[FAILED] Door Locked! The room mechanism is RESETTING... the "
-              "puzzle has changed or reset!\n";
-      cout << "PENALTY: -" << WRONG_PENALTY << " pts\n";
-      score -= WRONG_PENALTY;
-      current->clues[doorIndex].attempts = DEFAULT_ATTEMPTS; // Restore attempts
-      // The clues might change if we re-randomized, but current logic just
-      // resets attempts
+    if (p > 0 && chance(cfg.trapRate)) {
+      int back = 1 + below(min(p, 4 * MAZE_WINDOW));
+      c.next2 = firstInner + p - back;
+      c.trap2 = back <= MAZE_WINDOW ? TRAP_LOOP : TRAP_SENT_BACK;
+      continue;
+    }
+    // two doors, two different rooms
+    int jump = p + 1 + below(4 * MAZE_WINDOW);
+    if (jump == c.next1 - firstInner)
+      jump++;
+    if (jump < inner) {
+      c.next2 = firstInner + jump;
+      if (cm.rooms[c.next2].difficulty == DIFF_HARD && chance(cfg.trapRate))
+        c.trap2 = TRAP_HARD_PATH;
       continue;
     }
+    int exit1 = c.next1 - firstExit; // < 0: door 1 leads to a room
+    if (exit1 < 0) {
+      c.next2 = firstExit + below(cfg.exits);
+    } else if (cfg.exits > 1) { // another exit
+      c.next2 = firstExit + (exit1 + 1 + below(cfg.exits - 1)) % cfg.exits;
+    } else if (p > 0) { // the only exit is taken: back into the walk
+      c.next2 = firstInner + p - 1 - below(min(p, MAZE_WINDOW));
+      c.trap2 = TRAP_LOOP;
+    } else { // a single room before a single exit: one door
+      c.difficulty = DIFF_HARD;
+      c.clueCount = 1;
+    }
+  }
+
+  return validateMapGraph(cm, err);
+}
 
-    // Check for traps before moving
-    const char *trapMessage = getTrapMessage(current, nextRoom);
-    if (trapMessage) {
-      cout << trapMessage;
-      // Depending on trap type, you might want to modify 'nextRoom' or 'score'
-      // For now, just display message and proceed to 'nextRoom' as if it's a
-      // normal move If the trap is meant to send you back, you'd modify
-      // 'nextRoom' here. The current trap messages imply a move, but with a
-      // warning.
+/* =========================
+MAP TEMPLATES
+A template is a CompactMap whose clues are already picked
+and whose EASY doors are already shuffled. Play never
+writes to it, so any number of sessions can share one.
+========================= */
+// Same picks and door swaps, in the same order, as buildMapFromGraph()
+void buildMapTemplate(GameRng &rng, const CompactMap &graph,
+                      CompactMap &tpl) {
+  METRIC_SPAN(SPAN_BUILD_MAP);
+  tpl = graph;
+  resetUsedClues();
+  for (size_t i = 0; i < tpl.rooms.size(); i++) {
+    CompactRoom &c = tpl.rooms[i];
+    int idx[MAX_CLUES_PER_ROOM] = {-1, -1};
+    c.clueCount = pickRoomClues(rng, (RoomType)c.type,
+                                (RoomDifficulty)c.difficulty, idx);
+    c.clue1 = idx[0] >= 0 ? (uint32_t)idx[0] : NO_CLUE;
+    c.clue2 = idx[1] >= 0 ? (uint32_t)idx[1] : NO_CLUE;
+    c.visited = c.cleared = 0;
+
+    if (c.clueCount == 2 && rngBelow(rng, 2) == 0) { // randomizeEasyDoors
+      swap(c.next1, c.next2);
+      uint32_t t = c.clue1;
+      c.clue1 = c.clue2;
+      c.clue2 = t;
+      t = c.trap1;
+      c.trap1 = c.trap2;
+      c.trap2 = t;
     }
+  }
+}
 
-    pushPath(history, nextRoom);
-    current = nextRoom;
+// Topology of the built-in map (door order does not matter:
+// every template shuffles the EASY doors again)
+const CompactMap &builtinMapGraph() {
+  static CompactMap graph;
+  if (graph.rooms.empty()) {
+    GameRng rng;
+    seedRng(rng, 0);
+    resetUsedClues();
+    GameMap gm = buildMap(rng);
+    buildCompactMap(gm, graph);
+    freeMap(gm);
   }
+  return graph;
+}
 
-  freeMap(gm);
-  freePath(history);
-  return 0;
+// --map / --maze if given, else the built-in map
+const CompactMap &gameMapGraph() {
+  return HAVE_LOADED_MAP ? LOADED_MAP : builtinMapGraph();
+}
+
+/* =========================
+ROUTE INDEX
+Built once per map (template) so guides and analytics do
+not search per request: for every room, the shortest route
+to the nearest exit and to each exit, and among shortest
+routes the one with the best expected score. One reverse
+BFS per target over the doors (CSR), then a DP pass in BFS
+order. Queries are array lookups.
+========================= */
+static const int ROUTE_MAX_EXITS = 16; // exits with their own table
+
+// Best route from one room toward one target
+struct RouteStep {
+  int32_t dist; // doors to go (0 at the exit), -1 = cannot get there
+  int32_t door; // first door (0/1) of the route, -1 at the exit / none
+  float score;  // expected points on the way, final gate included
+};
+
+struct RouteIndex {
+  int rooms;
+  int targets;             // 0 = nearest exit, t = exits[t - 1]
+  vector<RouteStep> steps; // steps[target * rooms + room]
+};
+
+// Doors a player can walk through (EXIT door 1 is the final gate)
+static inline int walkDoors(const CompactRoom &c) {
+  if (c.type == ROOM_EXIT)
+    return 0;
+  return c.type == ROOM_INTERMEDIATE && c.difficulty == DIFF_EASY ? 2 : 1;
+}
+
+// Expected score for getting through one door at `skill` per try:
+// its points, minus the penalty of every failed round of attempts
+// before it (attempts reset after a failed round). 0 without a clue.
+double expectedDoorScore(uint32_t clueIdx, double skill) {
+  if (clueIdx == NO_CLUE)
+    return 0;
+  Clue clue;
+  loadBankClue((int)clueIdx, clue);
+  double failRound = pow(1 - skill, DEFAULT_ATTEMPTS);
+  return clue.points - WRONG_PENALTY * failRound / (1 - failRound);
+}
+
+// Scores need picked clues (a template); on a bare graph they are 0
+void buildRouteIndex(const CompactMap &tpl, double skill, RouteIndex &ri) {
+  int n = (int)tpl.rooms.size();
+  skill = min(1.0, max(0.01, skill));
+  vector<int> start, from;
+  buildReverseDoors(tpl, start, from);
+
+  vector<float> doorScore(2 * (size_t)n);
+  for (int i = 0; i < n; i++) {
+    const CompactRoom &c = tpl.rooms[i];
+    doorScore[2 * i] = (float)expectedDoorScore(c.clue1, skill);
+    doorScore[2 * i + 1] =
+        c.clueCount == 2 ? (float)expectedDoorScore(c.clue2, skill) : 0.0f;
+  }
+
+  int exits = (int)min(tpl.exits.size(), (size_t)ROUTE_MAX_EXITS);
+  ri.rooms = n;
+  ri.targets = 1 + exits;
+  ri.steps.assign((size_t)ri.targets * n, RouteStep{-1, -1, 0.0f});
+
+  vector<int> queue;
+  queue.reserve(n);
+  for (int t = 0; t < ri.targets; t++) {
+    RouteStep *step = &ri.steps[(size_t)t * n];
+    queue.clear();
+    for (int e = 0; e < (int)tpl.exits.size(); e++) {
+      if (t != 0 && e != t - 1)
+        continue;
+      int x = tpl.exits[e];
+      step[x].dist = 0;
+      step[x].score = doorScore[2 * x];
+      queue.push_back(x);
+    }
+
+    // reverse BFS: dist to the target
+    for (size_t q = 0; q < queue.size(); q++) {
+      int r = queue[q];
+      for (int k = start[r]; k < start[r + 1]; k++) {
+        int p = from[k];
+        const CompactRoom &c = tpl.rooms[p];
+        int doors = walkDoors(c);
+        bool walks =
+            (doors >= 1 && c.next1 == r) || (doors == 2 && c.next2 == r);
+        if (walks && step[p].dist < 0) {
+          step[p].dist = step[r].dist + 1;
+          queue.push_back(p);
+        }
+      }
+    }
+
+    // BFS order = by dist: every room's next step is already scored
+    for (size_t q = 0; q < queue.size(); q++) {
+      int r = queue[q];
+      const CompactRoom &c = tpl.rooms[r];
+      int doors = walkDoors(c);
+      for (int d = 0; d < doors; d++) {
+        int next = d == 0 ? c.next1 : c.next2;
+        if (next == NO_ROOM || step[next].dist != step[r].dist - 1)
+          continue;
+        float score = doorScore[2 * r + d] + step[next].score;
+        if (step[r].door < 0 || score > step[r].score) {
+          step[r].door = d;
+          step[r].score = score;
+        }
+      }
+    }
+  }
+}
+
+// O(1): target 0 = nearest exit, t = exits[t - 1] (t < ri.targets)
+static inline const RouteStep &routeStep(const RouteIndex &ri, int room,
+                                         int target = 0) {
+  return ri.steps[(size_t)target * ri.rooms + room];
+}
+
+/* =========================
+GAME LOOP
+========================= */
+void pushPath(PathNode *&top, Room *r, GameArena *arena = nullptr) {
+  METRIC_SPAN(SPAN_PATH);
+  PathNode *n = arena ? arenaPathNode(*arena) : new PathNode;
+  n->r = r;
+  n->next = top;
+  top = n;
+}
+
+Room *popPath(PathNode *&top, GameArena *arena = nullptr) {
+  METRIC_SPAN(SPAN_PATH);
+  if (!top)
+    return nullptr;
+  PathNode *n = top;
+  Room *r = n->r;
+  top = n->next;
+  if (arena)
+    arenaReleasePath(*arena, n);
+  else
+    delete n;
+  return r;
+}
+
+void freePath(PathNode *&top, GameArena *arena = nullptr) {
+  if (arena) { // nodes go back with resetArena()
+    top = nullptr;
+    return;
+  }
+  while (top)
+    popPath(top);
+}
+
+const char *trapMessage(TrapKind trap);
+
+// Traps belong to doors (Room::trap), set when the map is built; by
+// door, not destination, since both doors may lead to the same room
+const char *getTrapMessage(Room *current, int doorIndex) {
+  METRIC_SPAN(SPAN_TRAP);
+  if (!current || doorIndex < 0 || doorIndex > 1)
+    return nullptr;
+  return trapMessage(current->trap[doorIndex]);
+}
+
+const char *trapMessage(TrapKind trap) {
+  if (trap == TRAP_SENT_BACK) { // I3 -> I1
+    METRIC_COUNT(METRIC_TRAPS);
+    return "\n[TRAP TRIGGERED] OH NO! This door was a trap! You have been sent "
+           "back to the beginning of the sector!\n";
+  } else if (trap == TRAP_LOOP) { // I4 -> I2
+    METRIC_COUNT(METRIC_TRAPS);
+    return "\n[TRAP TRIGGERED] INFINITE LOOP! You are running in circles!\n";
+  } else if (trap == TRAP_HARD_PATH) { // I7 -> I5
+    METRIC_COUNT(METRIC_TRAPS);
+    return "\n[TRAP TRIGGERED] HARD PATH! You fell into a high-difficulty "
+           "zone!\n";
+  }
+  return nullptr;
+}
+
+/* =========================
+DOOR RULES
+(shared by the interactive loop and the simulator)
+========================= */
+enum DoorResult { DOOR_OPEN, DOOR_INVALID, DOOR_NOWHERE };
+
+// choice 1/2 -> clue index for a non-EXIT room with clueCount doors
+DoorResult pickDoor(int clueCount, int choice, int &doorIndex) {
+  doorIndex = -1;
+  if (choice != 1 && (clueCount == 1 || choice != 2))
+    return DOOR_INVALID;
+  doorIndex = choice - 1;
+  return DOOR_OPEN;
+}
+
+// choice 1/2 -> clue index + destination for a non-EXIT room
+DoorResult selectDoor(Room *current, int choice, int &doorIndex,
+                      Room *&nextRoom) {
+  nextRoom = nullptr;
+  if (pickDoor(current->clueCount, choice, doorIndex) != DOOR_OPEN)
+    return DOOR_INVALID;
+  nextRoom = doorIndex == 0 ? current->next1 : current->next2;
+  return nextRoom ? DOOR_OPEN : DOOR_NOWHERE;
+}
+
+// failed door puzzle: score penalty, puzzle resets its attempts
+void lockDoorAfterFailure(Clue &clue, int &score) {
+  score -= WRONG_PENALTY;
+  clue.attempts = DEFAULT_ATTEMPTS; // Restore attempts
+}
+
+/* =========================
+LEADERBOARD
+Best final scores of finished games, overall, per entrance
+and per difficulty (the hardest room on the escape path).
+Sharded: each submitting thread keeps to the shard it was
+handed (round robin), so up to LEADER_SHARDS threads never
+share a lock; past that, threads on one shard take turns on
+its spin lock. A score below the shard's lowest kept score
+is turned away with a single load. A snapshot merges the
+shards, reading each under a seqlock: it retries if a writer
+was inside, but never stops one.
+========================= */
+static const int LEADER_K = 10;         // entries kept per view
+static const int LEADER_SHARDS = 64;
+static const int LEADER_ENTRANCES = 8;  // later entrances share the last view
+static const int LEADER_DIFFICULTIES = 3; // RoomDifficulty
+static const int LEADER_VIEWS = 1 + LEADER_ENTRANCES + LEADER_DIFFICULTIES;
+
+struct LeaderEntry {
+  int32_t score;
+  uint8_t entrance;   // 0-based
+  uint8_t difficulty; // RoomDifficulty
+  uint64_t game;      // submission number (shard in the low bits)
+};
+
+// Entries are kept as two atomic words so snapshot reads are
+// race-free: score | entrance | difficulty, and the game number
+struct alignas(64) LeaderShard {
+  atomic<uint32_t> seq;  // odd while a writer is changing the tables
+  atomic<bool> busy;     // writers sharing the shard take turns
+  atomic<uint64_t> submitted;
+  atomic<int64_t> floor[LEADER_VIEWS]; // lowest kept score once full
+  atomic<int32_t> count[LEADER_VIEWS];
+  atomic<uint64_t> top[LEADER_VIEWS][LEADER_K][2]; // best first
+};
+
+struct Leaderboard {
+  LeaderShard shards[LEADER_SHARDS];
+  atomic<uint32_t> nextShard; // handed out to threads round-robin
+};
+
+// Set by the drivers that keep one (--leaderboard)
+static Leaderboard *LEADERBOARD = nullptr;
+
+Leaderboard *createLeaderboard() {
+  Leaderboard *b = new Leaderboard;
+  for (LeaderShard &sh : b->shards) {
+    sh.seq.store(0, memory_order_relaxed);
+    sh.busy.store(false, memory_order_relaxed);
+    sh.submitted.store(0, memory_order_relaxed);
+    for (int v = 0; v < LEADER_VIEWS; v++) {
+      sh.floor[v].store(INT64_MIN, memory_order_relaxed);
+      sh.count[v].store(0, memory_order_relaxed);
+    }
+  }
+  b->nextShard.store(0, memory_order_relaxed);
+  return b;
+}
+
+static inline uint64_t packLeader(int32_t score, int entrance, int diff) {
+  return (uint64_t)(uint32_t)score << 32 | (uint64_t)entrance << 8 |
+         (uint64_t)diff;
+}
+
+static inline LeaderEntry unpackLeader(uint64_t w, uint64_t game) {
+  LeaderEntry e;
+  e.score = (int32_t)(uint32_t)(w >> 32);
+  e.entrance = (uint8_t)(w >> 8);
+  e.difficulty = (uint8_t)w;
+  e.game = game;
+  return e;
+}
+
+// Views a result counts in: all, its entrance, its difficulty
+static inline void leaderViews(int entrance, int diff, int views[3]) {
+  views[0] = 0;
+  views[1] = 1 + (entrance < LEADER_ENTRANCES ? entrance : LEADER_ENTRANCES - 1);
+  views[2] = 1 + LEADER_ENTRANCES + diff;
+}
+
+// Caller holds sh.busy and has made sh.seq odd
+static void insertLeader(LeaderShard &sh, int v, uint64_t w, uint64_t game) {
+  int32_t score = (int32_t)(uint32_t)(w >> 32);
+  int n = sh.count[v].load(memory_order_relaxed);
+  int at = n;
+  while (at > 0 && (int32_t)(uint32_t)(sh.top[v][at - 1][0].load(
+                       memory_order_relaxed) >> 32) < score)
+    at--;
+  if (at >= LEADER_K)
+    return;
+  for (int i = (n < LEADER_K ? n : LEADER_K - 1); i > at; i--) {
+    sh.top[v][i][0].store(sh.top[v][i - 1][0].load(memory_order_relaxed),
+                          memory_order_relaxed);
+    sh.top[v][i][1].store(sh.top[v][i - 1][1].load(memory_order_relaxed),
+                          memory_order_relaxed);
+  }
+  sh.top[v][at][0].store(w, memory_order_relaxed);
+  sh.top[v][at][1].store(game, memory_order_relaxed);
+  if (n < LEADER_K)
+    sh.count[v].store(++n, memory_order_relaxed);
+  if (n == LEADER_K)
+    sh.floor[v].store(
+        (int32_t)(uint32_t)(sh.top[v][LEADER_K - 1][0].load(
+                                memory_order_relaxed) >>
+                            32),
+        memory_order_relaxed);
+}
+
+// A finished game; entrance is 0-based, diff a RoomDifficulty
+void submitScore(Leaderboard &b, int32_t score, int entrance, int diff) {
+  static thread_local Leaderboard *board = nullptr;
+  static thread_local int shard = 0;
+  if (board != &b) {
+    board = &b;
+    shard = (int)(b.nextShard.fetch_add(1, memory_order_relaxed) %
+                  LEADER_SHARDS);
+  }
+  LeaderShard &sh = b.shards[shard];
+  uint64_t game = sh.submitted.fetch_add(1, memory_order_relaxed) *
+                      LEADER_SHARDS +
+                  (uint64_t)shard;
+
+  int views[3];
+  leaderViews(entrance, diff, views);
+  bool better = false;
+  for (int v : views)
+    better = better || score > sh.floor[v].load(memory_order_relaxed);
+  if (!better)
+    return;
+
+  // contended only when more threads than shards submit
+  while (sh.busy.exchange(true, memory_order_acquire))
+    while (sh.busy.load(memory_order_relaxed))
+      this_thread::yield();
+  uint32_t seq = sh.seq.load(memory_order_relaxed);
+  sh.seq.store(seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  uint64_t w = packLeader(score, entrance < 255 ? entrance : 255, diff);
+  for (int v : views)
+    insertLeader(sh, v, w, game);
+  sh.seq.store(seq + 2, memory_order_release);
+  sh.busy.store(false, memory_order_release);
+}
+
+struct LeaderSnapshot {
+  LeaderEntry top[LEADER_VIEWS][LEADER_K];
+  int count[LEADER_VIEWS];
+  uint64_t submitted;
+  uint64_t retries; // shard reads repeated because a writer was inside
+};
+
+// Merges every shard's tables; never blocks a writer
+void snapshotLeaderboard(const Leaderboard &b, LeaderSnapshot &snap) {
+  snap.submitted = snap.retries = 0;
+  for (int v = 0; v < LEADER_VIEWS; v++)
+    snap.count[v] = 0;
+  LeaderEntry local[LEADER_VIEWS][LEADER_K];
+  int counts[LEADER_VIEWS];
+
+  for (const LeaderShard &sh : b.shards) {
+    uint32_t s1, s2;
+    while (true) {
+      s1 = sh.seq.load(memory_order_acquire);
+      if (s1 & 1) {
+        snap.retries++;
+        continue;
+      }
+      for (int v = 0; v < LEADER_VIEWS; v++) {
+        counts[v] = sh.count[v].load(memory_order_relaxed);
+        for (int i = 0; i < counts[v]; i++)
+          local[v][i] = unpackLeader(sh.top[v][i][0].load(memory_order_relaxed),
+                                     sh.top[v][i][1].load(memory_order_relaxed));
+      }
+      atomic_thread_fence(memory_order_acquire);
+      s2 = sh.seq.load(memory_order_relaxed);
+      if (s1 == s2)
+        break;
+      snap.retries++;
+    }
+    snap.submitted += sh.submitted.load(memory_order_relaxed);
+
+    for (int v = 0; v < LEADER_VIEWS; v++)
+      for (int i = 0; i < counts[v]; i++) {
+        const LeaderEntry &e = local[v][i];
+        int n = snap.count[v], at = n;
+        while (at > 0 && snap.top[v][at - 1].score < e.score)
+          at--;
+        if (at >= LEADER_K)
+          break; // the rest of this shard's view is lower still
+        for (int j = (n < LEADER_K ? n : LEADER_K - 1); j > at; j--)
+          snap.top[v][j] = snap.top[v][j - 1];
+        snap.top[v][at] = e;
+        if (n < LEADER_K)
+          snap.count[v]++;
+      }
+  }
+}
+
+static string leaderViewName(int v) {
+  if (v == 0)
+    return "All games";
+  if (v <= LEADER_ENTRANCES)
+    return "EN" + to_string(v) + (v == LEADER_ENTRANCES ? "+" : "");
+  RoomDifficulty d = (RoomDifficulty)(v - 1 - LEADER_ENTRANCES);
+  return string("Hardest room ") + (d == DIFF_NONE ? "NONE" : difficultyName(d));
+}
+
+void printLeaderboard(const LeaderSnapshot &snap, ostream &out) {
+  out << "==== Leaderboard (" << snap.submitted << " games) ====\n";
+  for (int v = 0; v < LEADER_VIEWS; v++) {
+    if (snap.count[v] == 0)
+      continue;
+    out << leaderViewName(v) << ":";
+    for (int i = 0; i < snap.count[v]; i++)
+      out << (i ? ", " : " ") << snap.top[v][i].score << " (#"
+          << snap.top[v][i].game << ")";
+    out << "\n";
+  }
+}
+
+// --leaderboard FILE: the current snapshot, replaced atomically
+bool writeLeaderboard(const Leaderboard &b, const char *path, string &err) {
+  LeaderSnapshot snap;
+  snapshotLeaderboard(b, snap);
+  ostringstream text;
+  printLeaderboard(snap, text);
+  string tmp = string(path) + ".tmp";
+  FILE *f = fopen(tmp.c_str(), "wb");
+  if (!f) {
+    err = "cannot write " + tmp + ": " + strerror(errno);
+    return false;
+  }
+  string s = text.str();
+  bool ok = fwrite(s.data(), 1, s.size(), f) == s.size();
+  ok = fclose(f) == 0 && ok && rename(tmp.c_str(), path) == 0;
+  if (!ok)
+    err = string("cannot write ") + path;
+  return ok;
+}
+
+/* =========================
+GAME SESSION
+The turn loop as a state machine: startSession() prints
+the entrance menu, feedSession() takes one input line
+and answers with the next prompt. The terminal game and
+the server both drive it.
+A session plays on a shared, read-only map template and
+keeps only what play changes: one byte per room and the
+path-history stack.
+========================= */
+enum SessionState : unsigned char {
+  SESSION_ENTRANCE, // waiting for the entrance number
+  SESSION_DOOR,     // waiting for a door / ability
+  SESSION_ANSWER,   // waiting for an answer to the open puzzle
+  SESSION_OVER
+};
+
+// Per-room overlay byte
+enum : unsigned char {
+  ROOM_VISITED = 1,
+  ROOM_CLEARED = 2,
+  ROOM_HINT1 = 4,        // hint used on door 1 (ROOM_HINT1 << 1: door 2)
+  ROOM_ATTEMPTS_SHIFT = 4 // 2 bits of used attempts per door from bit 4
+};
+static_assert(DEFAULT_ATTEMPTS <= 3, "used attempts are stored in 2 bits");
+
+struct GameSession {
+  const CompactMap *tpl; // shared map template, never written
+  uint8_t *rooms;        // overlay byte per template room; the same
+  int32_t *path;         // allocation holds the history stack (room
+                         // indices, top = current room)
+  int32_t pathLen;
+  int32_t pathCap;
+  int32_t score;
+  SessionState state;
+  uint8_t doorIndex;     // open puzzle (SESSION_ANSWER); EXIT: final gate
+  time_t clueStart;
+};
+
+static inline int sessionRoom(const GameSession &s) {
+  return s.path[s.pathLen - 1];
+}
+
+// Overlay bytes rounded up so the path that follows is int-aligned
+static inline size_t overlayBytes(const GameSession &s) {
+  return (s.tpl->rooms.size() + 3) & ~(size_t)3;
+}
+
+// (Re)allocates rooms + path as one block with room for cap steps
+static void growSession(GameSession &s, int cap) {
+  size_t bytes = overlayBytes(s);
+  uint8_t *block = new uint8_t[bytes + cap * sizeof(int32_t)];
+  if (s.rooms) {
+    memcpy(block, s.rooms, bytes + s.pathLen * sizeof(int32_t));
+    delete[] s.rooms;
+  } else {
+    memset(block, 0, bytes);
+  }
+  s.rooms = block;
+  s.path = (int32_t *)(block + bytes);
+  s.pathCap = cap;
+}
+
+static void pushSessionPath(GameSession &s, int room) {
+  METRIC_SPAN(SPAN_PATH);
+  if (s.pathLen == s.pathCap)
+    growSession(s, s.pathCap * 2);
+  s.path[s.pathLen++] = room;
+}
+
+static inline int sessionAttempts(const GameSession &s, int room, int door) {
+  return DEFAULT_ATTEMPTS -
+         ((s.rooms[room] >> (ROOM_ATTEMPTS_SHIFT + 2 * door)) & 3);
+}
+
+// The template clue behind a door with this session's attempts/hint
+static void loadSessionClue(const GameSession &s, int room, int door,
+                            Clue &clue) {
+  const CompactRoom &c = s.tpl->rooms[room];
+  loadBankClue(door == 0 ? c.clue1 : c.clue2, clue);
+  clue.attempts = sessionAttempts(s, room, door);
+  clue.usedHint = (s.rooms[room] & (ROOM_HINT1 << door)) != 0;
+}
+
+static void storeSessionClue(GameSession &s, int room, int door,
+                             const Clue &clue) {
+  uint8_t bits = s.rooms[room];
+  int shift = ROOM_ATTEMPTS_SHIFT + 2 * door;
+  bits = (uint8_t)((bits & ~(3 << shift)) |
+                   ((DEFAULT_ATTEMPTS - clue.attempts) << shift));
+  bits = (uint8_t)(clue.usedHint ? bits | (ROOM_HINT1 << door)
+                                 : bits & ~(ROOM_HINT1 << door));
+  s.rooms[room] = bits;
+}
+
+static void showEntrances(const CompactMap &tpl, ostream &out) {
+  int entrances = (int)tpl.entrances.size();
+  out << "Choose an entrance:\n";
+  for (int i = 0; i < entrances; i++)
+    out << "  " << (i + 1) << ") EN" << (i + 1) << "\n";
+  out << "Enter choice (1-" << entrances << "): ";
+}
+
+void startSession(GameSession &s, const CompactMap &tpl,
+                  unsigned long long seed, ostream &out) {
+  s.tpl = &tpl;
+  s.rooms = nullptr;
+  s.pathLen = 0;
+  growSession(s, 4);
+  s.score = 100;
+  s.state = SESSION_ENTRANCE;
+  s.doorIndex = 0;
+  s.clueStart = 0;
+  journalEvent(JE_START, seed, zigzag(s.score));
+
+  out << "==== Escape Room Game (Linked List) ====\n";
+  out << "(seed " << seed << ", replay with --seed " << seed << ")\n";
+  showEntrances(tpl, out);
+}
+
+void endSession(GameSession &s) {
+  delete[] s.rooms;
+  s.rooms = nullptr;
+  s.path = nullptr;
+  s.pathLen = s.pathCap = 0;
+  s.state = SESSION_OVER;
+}
+
+// Reads a number like `cin >> n`: false for a blank line
+// (keep waiting), n = 0 if the line does not start with one
+static bool parseChoice(const string &line, int &n) {
+  size_t i = line.find_first_not_of(" \t\r");
+  if (i == string::npos)
+    return false;
+  n = 0;
+  bool neg = line[i] == '-' || line[i] == '+' ? line[i++] == '-' : false;
+  if (i < line.size() && isdigit((unsigned char)line[i])) {
+    long v = 0;
+    for (; i < line.size() && isdigit((unsigned char)line[i]) && v < 100000;
+         i++)
+      v = v * 10 + (line[i] - '0');
+    n = (int)(neg ? -v : v);
+  }
+  return true;
+}
+
+// Top of the turn loop
+static void showRoom(GameSession &s, ostream &out) {
+  int room = sessionRoom(s);
+  s.rooms[room] |= ROOM_VISITED;
+  const CompactMap &m = *s.tpl;
+  const CompactRoom &c = m.rooms[room];
+  RoomView v = {m.roomIDs[room],
+                (RoomType)c.type,
+                (RoomDifficulty)c.difficulty,
+                (int)c.clueCount,
+                c.next1 != NO_ROOM ? m.roomIDs[c.next1] : NO_ROOM_ID,
+                c.next2 != NO_ROOM ? m.roomIDs[c.next2] : NO_ROOM_ID};
+  printRoomView(v, s.score, out);
+  out << "Enter choice: ";
+}
+
+static void closePuzzle(GameSession &s, ClueStep step, ostream &out,
+                        bool spent = false);
+
+// Shows the puzzle behind s.doorIndex (state is SESSION_ANSWER)
+static void openPuzzle(GameSession &s, ostream &out) {
+  Clue clue;
+  loadSessionClue(s, sessionRoom(s), s.doorIndex, clue);
+  ClueStep step = beginClue(clue, s.clueStart, out);
+  if (step != CLUE_PENDING) // no attempts left before any answer
+    closePuzzle(s, step, out, true);
+}
+
+static bool choosePuzzle(GameSession &s, int doorIndex) {
+  int room = sessionRoom(s);
+  const CompactRoom &c = s.tpl->rooms[room];
+  // a spent final gate only shows itself again: not an opening
+  if (sessionAttempts(s, room, doorIndex) > 0)
+    journalEvent(JE_DOOR, (uint64_t)doorIndex, doorIndex ? c.clue2 : c.clue1);
+  s.doorIndex = (uint8_t)doorIndex;
+  s.state = SESSION_ANSWER;
+  return true;
+}
+
+// A door / ability choice; true if it opened a puzzle (not shown yet)
+static bool sessionDoor(GameSession &s, int choice, ostream &out) {
+  // Quit
+  if (choice == 9) {
+    s.score = 0;
+    journalEvent(JE_QUIT);
+    out << "\n=== You have been kicked out of the game! ===\n";
+    out << "Quitting... Final Score: " << s.score << "\n";
+    s.state = SESSION_OVER;
+    return false;
+  }
+
+  // Back (History Stack)
+  if (choice == 0) {
+    if (s.pathLen > 1) {
+      s.pathLen--; // ارجع للي قبلها
+      journalEvent(JE_UNDO, (uint64_t)s.tpl->roomIDs[sessionRoom(s)]);
+    } else
+      out << "No previous room.\n";
+    showRoom(s, out);
+    return false;
+  }
+
+  const CompactRoom &c = s.tpl->rooms[sessionRoom(s)];
+
+  // ✅ EXIT room behavior: door 1 solves final puzzle (NOT navigation)
+  if (c.type == ROOM_EXIT) {
+    if (choice == 1)
+      return choosePuzzle(s, 0);
+    out << "Invalid door.\n";
+    showRoom(s, out);
+    return false;
+  }
+
+  // Determine door & next room
+  int doorIndex = -1;
+  if (pickDoor(c.clueCount, choice, doorIndex) != DOOR_OPEN) {
+    out << "Invalid door.\n";
+    showRoom(s, out);
+    return false;
+  }
+  if ((doorIndex == 0 ? c.next1 : c.next2) == NO_ROOM) {
+    out << "This door leads nowhere.\n";
+    showRoom(s, out);
+    return false;
+  }
+
+  // Solve door puzzle
+  return choosePuzzle(s, doorIndex);
+}
+
+// An escaped session: its entrance and the hardest room on its path
+static void submitSessionScore(Leaderboard &b, const GameSession &s) {
+  const CompactMap &m = *s.tpl;
+  int entrance = 0, diff = DIFF_NONE;
+  while (entrance + 1 < (int)m.entrances.size() &&
+         m.entrances[entrance] != s.path[0])
+    entrance++;
+  for (int i = 0; i < s.pathLen; i++)
+    diff = max(diff, (int)m.rooms[s.path[i]].difficulty);
+  submitScore(b, s.score, entrance, diff);
+}
+
+// spent: the puzzle had no attempts left when it opened
+static void closePuzzle(GameSession &s, ClueStep step, ostream &out,
+                        bool spent) {
+  int room = sessionRoom(s);
+  const CompactRoom &c = s.tpl->rooms[room];
+  s.state = SESSION_DOOR;
+
+  if (c.type == ROOM_EXIT) {
+    if (step == CLUE_SOLVED) {
+      journalEvent(JE_ESCAPE, zigzag(s.score));
+      out << "\nYOU ESCAPED! Final Score: " << s.score << "\n";
+      s.state = SESSION_OVER;
+      if (LEADERBOARD)
+        submitSessionScore(*LEADERBOARD, s);
+      return;
+    }
+    if (!spent)
+      journalEvent(JE_LOCKED, 0);
+    out << "Final gate locked. You remain at the exit room.\n";
+    showRoom(s, out);
+    return;
+  }
+
+  if (step != CLUE_SOLVED) {
+    out << "\n[FAILED] Door Locked! The room mechanism is RESETTING... the "
+           "puzzle has changed or reset!\n";
+    out << "PENALTY: -" << WRONG_PENALTY << " pts\n";
+    journalEvent(JE_LOCKED, (uint64_t)WRONG_PENALTY);
+    Clue clue;
+    loadSessionClue(s, room, s.doorIndex, clue);
+    lockDoorAfterFailure(clue, s.score);
+    storeSessionClue(s, room, s.doorIndex, clue);
+    showRoom(s, out);
+    return;
+  }
+
+  // Check for traps before moving (the door still leads on)
+  TrapKind trap = (TrapKind)(s.doorIndex ? c.trap2 : c.trap1);
+  const char *message = trapMessage(trap);
+  if (message) {
+    journalEvent(JE_TRAP, (uint64_t)trap);
+    out << message;
+  }
+
+  pushSessionPath(s, s.doorIndex ? c.next2 : c.next1);
+  journalEvent(JE_MOVE, (uint64_t)s.tpl->roomIDs[sessionRoom(s)]);
+  showRoom(s, out);
+}
+
+static void sessionEntrance(GameSession &s, int choice, ostream &out) {
+  if (choice < 1 || choice > (int)s.tpl->entrances.size()) {
+    journalEvent(JE_QUIT);
+    out << "Invalid. Exiting.\n";
+    s.state = SESSION_OVER;
+    return;
+  }
+  pushSessionPath(s, s.tpl->entrances[choice - 1]);
+  journalEvent(JE_ENTRANCE, (uint64_t)s.tpl->roomIDs[sessionRoom(s)]);
+  s.state = SESSION_DOOR;
+  showRoom(s, out);
+}
+
+// One input line; false once the game is over
+bool feedSession(GameSession &s, const string &line, ostream &out) {
+  METRIC_SPAN(SPAN_TURN);
+  int n;
+  switch (s.state) {
+  case SESSION_ENTRANCE:
+    if (parseChoice(line, n))
+      sessionEntrance(s, n, out);
+    break;
+  case SESSION_DOOR:
+    if (parseChoice(line, n) && sessionDoor(s, n, out))
+      openPuzzle(s, out);
+    break;
+  case SESSION_ANSWER: {
+    int room = sessionRoom(s);
+    Clue clue;
+    loadSessionClue(s, room, s.doorIndex, clue);
+    ClueStep step = answerClue(clue, line, s.clueStart, s.score, out);
+    storeSessionClue(s, room, s.doorIndex, clue);
+    if (step != CLUE_PENDING)
+      closePuzzle(s, step, out);
+    break;
+  }
+  case SESSION_OVER:
+    break;
+  }
+  return s.state != SESSION_OVER;
+}
+
+// time() deadline of the open puzzle (clueDeadline), 0 = none
+time_t sessionDeadline(const GameSession &s) {
+  if (s.state != SESSION_ANSWER)
+    return 0;
+  Clue clue;
+  loadSessionClue(s, sessionRoom(s), s.doorIndex, clue);
+  return clueDeadline(clue, s.clueStart);
+}
+
+// The open puzzle's time limit ran out with no answer (a timer
+// callback): same penalty as a late answer, then the next prompt
+void expireSession(GameSession &s, ostream &out) {
+  if (s.state != SESSION_ANSWER)
+    return;
+  int room = sessionRoom(s);
+  Clue clue;
+  loadSessionClue(s, room, s.doorIndex, clue);
+  ClueStep step = expireClue(clue, s.clueStart, out);
+  storeSessionClue(s, room, s.doorIndex, clue);
+  if (step != CLUE_PENDING)
+    closePuzzle(s, step, out);
+}
+
+// The prompt a restored session was waiting at, for its player
+// coming back; an open puzzle's time limit starts over
+void resumeSession(GameSession &s, ostream &out) {
+  switch (s.state) {
+  case SESSION_ENTRANCE:
+    showEntrances(*s.tpl, out);
+    break;
+  case SESSION_DOOR:
+    showRoom(s, out);
+    break;
+  case SESSION_ANSWER:
+    openPuzzle(s, out);
+    break;
+  case SESSION_OVER:
+    break;
+  }
+}
+
+/* =========================
+SESSION RECORDING
+--record keeps a session's input lines (and the time limits
+that ran out) with the second each came, the seed of its map
+template and the state every event led to; --replay feeds a
+recording back through feedSession() and checks that each
+state comes out the same. A recording is text:
+  escape-room-recording 1
+  seed S              the template `--seed S` plays
+  template H          hash of that template
+  > T LINE            LINE typed T seconds after the start
+  ! T                 the open puzzle's time limit ran out
+  = STATE ROOM SCORE DEPTH H
+                      after startSession and after every
+                      event; H hashes the overlay bytes and
+                      everything the game printed
+========================= */
+static const char *const RECORDING_MAGIC = "escape-room-recording 1";
+
+struct SessionLog {
+  string text;  // the recording so far
+  time_t start; // second the session started
+  string path;  // where the server saves it
+};
+
+static inline uint64_t fnv1a(const void *p, size_t n,
+                             uint64_t h = 14695981039346656037ULL) {
+  const unsigned char *b = (const unsigned char *)p;
+  for (size_t i = 0; i < n; i++) {
+    h ^= b[i];
+    h *= 1099511628211ULL;
+  }
+  return h;
+}
+
+uint64_t templateHash(const CompactMap &tpl) {
+  uint64_t h = fnv1a(tpl.rooms.data(), tpl.rooms.size() * sizeof(CompactRoom));
+  h = fnv1a(tpl.roomIDs.data(), tpl.roomIDs.size() * sizeof(int), h);
+  return fnv1a(tpl.entrances.data(), tpl.entrances.size() * sizeof(int), h);
+}
+
+// The "= ..." line for the session as it is now; output: what the
+// event printed
+static void appendSessionState(string &to, const GameSession &s,
+                               string_view output) {
+  uint64_t h = fnv1a(output.data(), output.size());
+  if (s.rooms)
+    h = fnv1a(s.rooms, s.tpl->rooms.size(), h);
+  int room = s.pathLen > 0 ? s.tpl->roomIDs[sessionRoom(s)] : -1;
+  char buf[96];
+  snprintf(buf, sizeof(buf), "= %d %d %d %d %016llx\n", (int)s.state, room,
+           (int)s.score, (int)s.pathLen, (unsigned long long)h);
+  to += buf;
+}
+
+// Right after startSession(s, tpl, seed, ...) printed output
+void startSessionLog(SessionLog &log, const GameSession &s,
+                     unsigned long long seed, string_view output) {
+  char buf[96];
+  log.start = time(nullptr);
+  log.text = RECORDING_MAGIC;
+  snprintf(buf, sizeof(buf), "\nseed %llu\ntemplate %016llx\n", seed,
+           (unsigned long long)templateHash(*s.tpl));
+  log.text += buf;
+  appendSessionState(log.text, s, output);
+}
+
+// Before the session gets line: pins CLUE_CLOCK to this second so
+// the game and the recording agree on when it came
+void logSessionLine(SessionLog &log, const string &line) {
+  CLUE_CLOCK = time(nullptr);
+  log.text += "> ";
+  log.text += to_string((long long)(CLUE_CLOCK - log.start));
+  log.text += ' ';
+  log.text += line;
+  log.text += '\n';
+}
+
+// Before expireSession(), like logSessionLine
+void logSessionTimeout(SessionLog &log) {
+  CLUE_CLOCK = time(nullptr);
+  log.text += "! ";
+  log.text += to_string((long long)(CLUE_CLOCK - log.start));
+  log.text += '\n';
+}
+
+// After the event: what it printed and the state it left
+void logSessionState(SessionLog &log, const GameSession &s,
+                     string_view output) {
+  appendSessionState(log.text, s, output);
+  CLUE_CLOCK = 0;
+}
+
+bool saveSessionLog(const SessionLog &log, const char *path, string &err) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    err = string("cannot write ") + path + ": " + strerror(errno);
+    return false;
+  }
+  bool ok = fwrite(log.text.data(), 1, log.text.size(), f) == log.text.size();
+  ok = fclose(f) == 0 && ok;
+  if (!ok)
+    err = string("cannot write ") + path;
+  return ok;
+}
+
+/* =========================
+SESSION SNAPSHOTS
+--checkpoint: a live session as a flat record, no pointers.
+The map template is named by its seed (and hash, see
+--record): the clue behind every door was picked when the
+template was built, so only what play changed is stored:
+state, open door, score, the path stack as room indices and
+the overlay byte of every room (visited, cleared, attempts
+and hint per door). A checkpoint file is the 8-byte header
+then batches of records appended as one write each and
+synced once; a batch counts once its SNAP_COMMIT record is
+on disk, so a crash mid-batch loses that batch and no more.
+A later record for a session replaces the earlier one,
+SNAP_ENDED drops it. When the file is mostly stale records
+it is rewritten (tmp + rename) with only the live ones.
+========================= */
+static const char SNAPSHOT_FILE_MAGIC[4] = {'E', 'R', 'S', 'S'};
+static const uint32_t SNAPSHOT_FILE_VERSION = 1;
+static const size_t SNAPSHOT_FILE_HEADER = 8; // magic, version
+
+enum SnapshotKind : uint8_t {
+  SNAP_LIVE,  // a session's state
+  SNAP_ENDED, // the session is over
+  SNAP_COMMIT // end of a batch
+};
+
+struct SnapshotRecord {
+  uint32_t size;  // the whole record, checksum included
+  uint8_t kind;   // SnapshotKind
+  uint8_t state;  // SessionState
+  uint8_t doorIndex;
+  uint8_t reserved;
+  uint64_t id;      // the session (its resume code on the server)
+  uint64_t seed;    // its template is what `--seed seed` plays
+  uint64_t tplHash; // templateHash of that template
+  int64_t clueStart;
+  int32_t score;
+  uint32_t pathLen;   // int32_t path[pathLen] follows, then
+  uint32_t roomCount; // uint8_t rooms[roomCount], then the fnv1a
+};                    // of everything before it (uint64_t)
+
+static void appendSnapshotRecord(string &to, SnapshotRecord &r,
+                                 const int32_t *path, const uint8_t *rooms) {
+  r.size = (uint32_t)(sizeof(r) + r.pathLen * sizeof(int32_t) + r.roomCount +
+                      sizeof(uint64_t));
+  size_t at = to.size();
+  to.append((const char *)&r, sizeof(r));
+  to.append((const char *)path, r.pathLen * sizeof(int32_t));
+  to.append((const char *)rooms, r.roomCount);
+  uint64_t sum = fnv1a(to.data() + at, to.size() - at);
+  to.append((const char *)&sum, sizeof(sum));
+}
+
+// Session id's state as a SNAP_LIVE record; seed / tplHash: its template
+void appendSnapshot(string &to, uint64_t id, unsigned long long seed,
+                    uint64_t tplHash, const GameSession &s) {
+  SnapshotRecord r;
+  memset(&r, 0, sizeof(r));
+  r.kind = SNAP_LIVE;
+  r.state = (uint8_t)s.state;
+  r.doorIndex = s.doorIndex;
+  r.id = id;
+  r.seed = seed;
+  r.tplHash = tplHash;
+  r.clueStart = (int64_t)s.clueStart;
+  r.score = s.score;
+  r.pathLen = (uint32_t)s.pathLen;
+  r.roomCount = s.rooms ? (uint32_t)s.tpl->rooms.size() : 0;
+  appendSnapshotRecord(to, r, s.path, s.rooms);
+}
+
+// A SNAP_ENDED (id) or SNAP_COMMIT record
+void appendSnapshotMark(string &to, SnapshotKind kind, uint64_t id) {
+  SnapshotRecord r;
+  memset(&r, 0, sizeof(r));
+  r.kind = kind;
+  r.id = id;
+  appendSnapshotRecord(to, r, nullptr, nullptr);
+}
+
+/* The committed sessions of a checkpoint file: id -> offset of its
+   latest SNAP_LIVE record. Bytes after the last commit (a batch cut
+   short by a crash) are skipped and counted in torn */
+bool readCheckpoint(string_view data, unordered_map<uint64_t, size_t> &live,
+                    size_t &torn, string &err) {
+  live.clear();
+  torn = 0;
+  if (data.empty())
+    return true;
+  uint32_t version = 0;
+  if (data.size() < SNAPSHOT_FILE_HEADER ||
+      memcmp(data.data(), SNAPSHOT_FILE_MAGIC, 4) != 0) {
+    err = "not a checkpoint file";
+    return false;
+  }
+  memcpy(&version, data.data() + 4, 4);
+  if (version != SNAPSHOT_FILE_VERSION) {
+    err = "checkpoint version " + to_string(version) + ", expected " +
+          to_string(SNAPSHOT_FILE_VERSION);
+    return false;
+  }
+  vector<pair<uint64_t, size_t>> batch; // (id, offset or npos = ended)
+  size_t pos = SNAPSHOT_FILE_HEADER, committed = pos;
+  while (data.size() - pos >= sizeof(SnapshotRecord) + sizeof(uint64_t)) {
+    SnapshotRecord r;
+    memcpy(&r, data.data() + pos, sizeof(r));
+    if (r.size < sizeof(r) + sizeof(uint64_t) || r.size > data.size() - pos ||
+        r.size != sizeof(r) + (uint64_t)r.pathLen * sizeof(int32_t) +
+                      r.roomCount + sizeof(uint64_t))
+      break;
+    uint64_t sum;
+    memcpy(&sum, data.data() + pos + r.size - sizeof(sum), sizeof(sum));
+    if (sum != fnv1a(data.data() + pos, r.size - sizeof(sum)))
+      break;
+    if (r.kind == SNAP_COMMIT) {
+      for (const pair<uint64_t, size_t> &e : batch)
+        if (e.second == string::npos)
+          live.erase(e.first);
+        else
+          live[e.first] = e.second;
+      batch.clear();
+      committed = pos + r.size;
+    } else {
+      batch.push_back(
+          make_pair(r.id, r.kind == SNAP_LIVE ? pos : string::npos));
+    }
+    pos += r.size;
+  }
+  torn = data.size() - committed;
+  return true;
+}
+
+// The template `--seed seed` plays, built on first use
+const CompactMap &templateForSeed(map<unsigned long long, CompactMap> &templates,
+                                  unsigned long long seed) {
+  auto it = templates.find(seed);
+  if (it == templates.end()) {
+    GameRng rng;
+    seedRng(rng, seed);
+    it = templates.emplace(seed, CompactMap()).first;
+    buildMapTemplate(rng, gameMapGraph(), it->second);
+  }
+  return it->second;
+}
+
+/* The SNAP_LIVE record at offset (from readCheckpoint) as a session
+   on its template; tplHashes caches templateHash per seed. Checks
+   the path, the open door and every overlay byte's used attempts
+   against the template before trusting them */
+bool restoreSnapshot(string_view data, size_t offset,
+                     map<unsigned long long, CompactMap> &templates,
+                     map<unsigned long long, uint64_t> &tplHashes,
+                     GameSession &s, SnapshotRecord &r, string &err) {
+  memcpy(&r, data.data() + offset, sizeof(r));
+  const CompactMap &tpl = templateForSeed(templates, r.seed);
+  auto h = tplHashes.find(r.seed);
+  if (h == tplHashes.end())
+    h = tplHashes.emplace(r.seed, templateHash(tpl)).first;
+  if (h->second != r.tplHash) {
+    err = "map template differs (same --clues / --map / --maze?)";
+    return false;
+  }
+  int32_t rooms = (int32_t)tpl.rooms.size();
+  const char *path = data.data() + offset + sizeof(r);
+  bool ok = r.state < SESSION_OVER && r.doorIndex < 2 &&
+            r.roomCount == (uint32_t)rooms &&
+            (r.pathLen > 0 || r.state == SESSION_ENTRANCE);
+  for (uint32_t i = 0; ok && i < r.pathLen; i++) {
+    int32_t room;
+    memcpy(&room, path + i * sizeof(int32_t), sizeof(room));
+    ok = room >= 0 && room < rooms;
+  }
+  if (ok && r.state == SESSION_ANSWER) { // the open puzzle has a clue
+    int32_t room;
+    memcpy(&room, path + (r.pathLen - 1) * sizeof(int32_t), sizeof(room));
+    const CompactRoom &c = tpl.rooms[room];
+    ok = r.doorIndex < c.clueCount &&
+         (r.doorIndex ? c.clue2 : c.clue1) != NO_CLUE;
+  }
+  const uint8_t *overlay =
+      (const uint8_t *)path + r.pathLen * sizeof(int32_t);
+  for (int32_t i = 0; ok && i < rooms; i++)
+    for (int door = 0; ok && door < 2; door++)
+      ok = ((overlay[i] >> (ROOM_ATTEMPTS_SHIFT + 2 * door)) & 3) <=
+           DEFAULT_ATTEMPTS;
+  if (!ok) {
+    err = "session " + to_string(r.id) + ": snapshot does not fit its map";
+    return false;
+  }
+  s.tpl = &tpl;
+  s.rooms = nullptr;
+  s.pathLen = 0;
+  growSession(s, max(4, (int)r.pathLen));
+  memcpy(s.path, path, r.pathLen * sizeof(int32_t));
+  memcpy(s.rooms, path + r.pathLen * sizeof(int32_t), r.roomCount);
+  s.pathLen = (int32_t)r.pathLen;
+  s.score = r.score;
+  s.state = (SessionState)r.state;
+  s.doorIndex = r.doorIndex;
+  s.clueStart = (time_t)r.clueStart;
+  return true;
+}
+
+#ifndef _WIN32
+static bool syncFile(int fd) {
+#ifdef __linux__
+  return fdatasync(fd) == 0;
+#else
+  return fsync(fd) == 0;
+#endif
+}
+
+// Appends batches to a checkpoint file
+struct CheckpointWriter {
+  int fd;
+  string path;
+  string batch;    // records of the pass in progress
+  size_t fileSize; // bytes on disk
+};
+
+bool openCheckpoint(CheckpointWriter &w, const char *path, string &err) {
+  w.path = path;
+  w.batch.clear();
+  w.fd = open(path, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  struct stat st;
+  if (w.fd < 0 || fstat(w.fd, &st) != 0) {
+    err = string("cannot open ") + path + ": " + strerror(errno);
+    return false;
+  }
+  w.fileSize = (size_t)st.st_size;
+  if (w.fileSize == 0) {
+    char header[SNAPSHOT_FILE_HEADER];
+    memcpy(header, SNAPSHOT_FILE_MAGIC, 4);
+    memcpy(header + 4, &SNAPSHOT_FILE_VERSION, 4);
+    if (!writeAll(w.fd, header, sizeof(header)) || !syncFile(w.fd)) {
+      err = string("cannot write ") + path + ": " + strerror(errno);
+      return false;
+    }
+    w.fileSize = sizeof(header);
+  }
+  return true;
+}
+
+// Ends the batch: one write, one sync
+bool commitCheckpoint(CheckpointWriter &w, string &err) {
+  appendSnapshotMark(w.batch, SNAP_COMMIT, 0);
+  if (!writeAll(w.fd, w.batch.data(), w.batch.size()) || !syncFile(w.fd)) {
+    err = "cannot write " + w.path + ": " + strerror(errno);
+    return false;
+  }
+  w.fileSize += w.batch.size();
+  w.batch.clear();
+  return true;
+}
+
+// Replaces the file with w.batch (every live session) as one batch
+bool rewriteCheckpoint(CheckpointWriter &w, string &err) {
+  string tmp = w.path + ".tmp";
+  CheckpointWriter fresh;
+  fresh.batch.swap(w.batch);
+  remove(tmp.c_str());
+  bool ok = openCheckpoint(fresh, tmp.c_str(), err) &&
+            commitCheckpoint(fresh, err);
+  if (ok && rename(tmp.c_str(), w.path.c_str()) != 0) {
+    err = "cannot replace " + w.path + ": " + strerror(errno);
+    ok = false;
+  }
+  if (!ok) {
+    if (fresh.fd >= 0)
+      close(fresh.fd);
+    w.batch.clear();
+    return false;
+  }
+  close(w.fd);
+  w.fd = fresh.fd;
+  w.fileSize = fresh.fileSize;
+  return true;
+}
+#endif
+
+/* =========================
+JOURNAL FILES
+A journal is the 8-byte header then blocks, each one driver's
+events since its last block (JOURNAL EVENTS), behind a
+JournalBlockHeader with their checksum. Drivers hand sealed
+blocks to one JournalWriter; its thread writes whatever has
+queued up while the last sync ran as one write and one
+fdatasync (group commit), so many sessions share each sync
+and no driver waits for the disk unless it asks to.
+========================= */
+static const char JOURNAL_FILE_MAGIC[4] = {'E', 'R', 'J', 'L'};
+static const uint32_t JOURNAL_FILE_VERSION = 1;
+static const size_t JOURNAL_FILE_HEADER = 8; // magic, version
+
+struct JournalBlockHeader {
+  uint32_t size;   // event bytes that follow
+  uint32_t events;
+  uint64_t run;    // JournalBuffer::run
+  int64_t base;    // time() the event times count from
+  uint64_t sum;    // fnv1a of the event bytes
+};
+
+// Moves the buffer's events into to as one block
+void sealJournal(JournalBuffer &j, string &to) {
+  JournalBlockHeader h;
+  h.size = (uint32_t)j.bytes.size();
+  h.events = j.events;
+  h.run = j.run;
+  h.base = (int64_t)j.base;
+  h.sum = fnv1a(j.bytes.data(), j.bytes.size());
+  to.append((const char *)&h, sizeof(h));
+  to += j.bytes;
+  j.bytes.clear();
+  j.events = 0;
+}
+
+// Length of the whole blocks at the start of data (a crash can
+// leave half a block at the end); false if it is no journal
+static bool journalLength(string_view data, size_t &length, string &err) {
+  uint32_t version = 0;
+  if (data.size() < JOURNAL_FILE_HEADER ||
+      memcmp(data.data(), JOURNAL_FILE_MAGIC, 4) != 0) {
+    err = "not a journal";
+    return false;
+  }
+  memcpy(&version, data.data() + 4, 4);
+  if (version != JOURNAL_FILE_VERSION) {
+    err = "journal version " + to_string(version) + ", expected " +
+          to_string(JOURNAL_FILE_VERSION);
+    return false;
+  }
+  length = JOURNAL_FILE_HEADER;
+  JournalBlockHeader h;
+  while (data.size() - length >= sizeof(h)) {
+    memcpy(&h, data.data() + length, sizeof(h));
+    if (h.size > data.size() - length - sizeof(h))
+      break;
+    length += sizeof(h) + h.size;
+  }
+  return true;
+}
+
+#ifndef _WIN32
+struct JournalWriter {
+  int fd;
+  string path;
+  mutex lock;
+  condition_variable wake;    // blocks queued, or closing
+  condition_variable durable; // a sync finished
+  string queued;              // sealed blocks not written yet
+  uint64_t submitted;         // blocks handed in
+  uint64_t synced;            // blocks on disk
+  bool closing;
+  bool failed;
+  string error;
+  uint64_t syncs;             // write + fdatasync rounds
+  thread flusher;
+};
+
+static void journalFlusher(JournalWriter *w) {
+  string batch;
+  unique_lock<mutex> guard(w->lock);
+  while (true) {
+    w->wake.wait(guard, [w] { return w->closing || !w->queued.empty(); });
+    if (w->queued.empty())
+      break; // closing with nothing left
+    batch.swap(w->queued);
+    uint64_t upTo = w->submitted;
+    guard.unlock();
+    bool ok = writeAll(w->fd, batch.data(), batch.size()) && syncFile(w->fd);
+    batch.clear();
+    guard.lock();
+    if (!ok && !w->failed) {
+      w->failed = true;
+      w->error = "cannot write " + w->path + ": " + strerror(errno);
+    }
+    w->synced = upTo;
+    w->syncs++;
+    w->durable.notify_all();
+  }
+}
+
+// Opens (or creates) path for appending; a torn last block is cut off
+bool openJournal(JournalWriter &w, const char *path, string &err) {
+  w.path = path;
+  w.submitted = w.synced = w.syncs = 0;
+  w.closing = w.failed = false;
+  w.fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+  struct stat st;
+  if (w.fd < 0 || fstat(w.fd, &st) != 0) {
+    err = string("cannot open ") + path + ": " + strerror(errno);
+    return false;
+  }
+  if (st.st_size == 0) {
+    char header[JOURNAL_FILE_HEADER];
+    memcpy(header, JOURNAL_FILE_MAGIC, 4);
+    memcpy(header + 4, &JOURNAL_FILE_VERSION, 4);
+    if (!writeAll(w.fd, header, sizeof(header))) {
+      err = string("cannot write ") + path + ": " + strerror(errno);
+      return false;
+    }
+  } else {
+    MappedFile mf;
+    size_t length;
+    if (!mapFile(path, mf, err))
+      return false;
+    bool ok = journalLength(string_view(mf.data, mf.size), length, err);
+    unmapFile(mf);
+    if (!ok) {
+      err = string(path) + ": " + err;
+      return false;
+    }
+    if (length < (size_t)st.st_size && ftruncate(w.fd, (off_t)length) != 0) {
+      err = string("cannot truncate ") + path + ": " + strerror(errno);
+      return false;
+    }
+  }
+  w.flusher = thread(journalFlusher, &w);
+  return true;
+}
+
+// Seals j into a block for the flusher; the ticket is for waitJournal
+uint64_t submitJournal(JournalWriter &w, JournalBuffer &j) {
+  lock_guard<mutex> guard(w.lock);
+  if (j.events)
+    sealJournal(j, w.queued);
+  w.wake.notify_one();
+  return ++w.submitted;
+}
+
+// Until the block of ticket is on disk; false if a write failed
+bool waitJournal(JournalWriter &w, uint64_t ticket) {
+  unique_lock<mutex> guard(w.lock);
+  w.durable.wait(guard, [&w, ticket] { return w.synced >= ticket; });
+  return !w.failed;
+}
+
+// Writes what is queued and stops the flusher
+bool closeJournal(JournalWriter &w, string &err) {
+  {
+    lock_guard<mutex> guard(w.lock);
+    w.closing = true;
+    w.wake.notify_one();
+  }
+  w.flusher.join();
+  close(w.fd);
+  if (w.failed)
+    err = w.error;
+  return !w.failed;
+}
+#endif
+
+struct JournalRecord {
+  uint64_t run;
+  uint64_t session;
+  time_t time;
+  JournalKind kind;
+  uint64_t args[4];
+};
+
+/* Calls visit(const JournalRecord &) for every event of a journal
+   in file order. torn: bytes after the last whole block */
+template <class Visit>
+bool scanJournal(string_view data, Visit &&visit, size_t &torn, string &err) {
+  size_t length;
+  if (!journalLength(data, length, err))
+    return false;
+  torn = data.size() - length;
+  JournalRecord e;
+  size_t pos = JOURNAL_FILE_HEADER;
+  while (pos < length) {
+    JournalBlockHeader h;
+    memcpy(&h, data.data() + pos, sizeof(h));
+    const uint8_t *p = (const uint8_t *)data.data() + pos + sizeof(h);
+    const uint8_t *end = p + h.size;
+    if (fnv1a(p, h.size) != h.sum) {
+      err = "block at byte " + to_string(pos) + ": checksum mismatch";
+      return false;
+    }
+    e.run = h.run;
+    for (uint32_t i = 0; i < h.events; i++) {
+      uint64_t dt;
+      bool ok = getVarint(p, end, e.session) && p < end &&
+                (e.kind = (JournalKind)*p++) < JE_KINDS &&
+                getVarint(p, end, dt);
+      for (int a = 0; ok && a < JOURNAL_ARGS[e.kind]; a++)
+        ok = getVarint(p, end, e.args[a]);
+      if (!ok) {
+        err = "block at byte " + to_string(pos) + ": bad event " +
+              to_string(i);
+        return false;
+      }
+      e.time = (time_t)(h.base + unzigzag(dt));
+      visit(e);
+    }
+    pos += sizeof(h) + h.size;
+  }
+  return true;
+}
+
+// A session as its events leave it
+struct JournalGame {
+  int32_t score;
+  int32_t room;  // room ID, -1 before the entrance
+  int32_t depth; // history stack
+  uint8_t over;  // 0 while playing, else JE_ESCAPE, JE_QUIT or JE_END
+  uint8_t door;  // open puzzle
+  uint32_t clue;
+};
+
+struct JournalReplay {
+  unordered_map<uint64_t, vector<JournalGame>> runs; // by run, then session
+  uint64_t lastRun;
+  vector<JournalGame> *last; // runs[lastRun]
+  long long events[JE_KINDS];
+  long long unknown; // events of sessions with no JE_START / JE_RESUME
+};
+
+void initJournalReplay(JournalReplay &r) {
+  r.runs.clear();
+  r.last = nullptr;
+  r.lastRun = 0;
+  memset(r.events, 0, sizeof(r.events));
+  r.unknown = 0;
+}
+
+static inline vector<JournalGame> &journalRun(JournalReplay &r, uint64_t run) {
+  if (!r.last || run != r.lastRun) {
+    r.last = &r.runs[run];
+    r.lastRun = run;
+  }
+  return *r.last;
+}
+
+// The session an event is about, nullptr if it never started
+static inline JournalGame *findJournalGame(JournalReplay &r,
+                                           const JournalRecord &e) {
+  vector<JournalGame> &games = journalRun(r, e.run);
+  return e.session < games.size() ? &games[e.session] : nullptr;
+}
+
+// Rebuilds the session of one event
+void applyJournalEvent(JournalReplay &r, const JournalRecord &e) {
+  r.events[e.kind]++;
+  vector<JournalGame> &games = journalRun(r, e.run);
+  if (e.kind == JE_START || e.kind == JE_RESUME) {
+    if (games.size() <= e.session)
+      games.resize(e.session + 1, JournalGame{0, -1, 0, JE_END, 0, 0});
+    JournalGame &g = games[e.session];
+    g.over = 0;
+    g.room = e.kind == JE_START ? -1 : (int32_t)unzigzag(e.args[1]);
+    g.depth = e.kind == JE_START ? 0 : (int32_t)e.args[2];
+    g.score = (int32_t)unzigzag(e.args[e.kind == JE_START ? 1 : 3]);
+    return;
+  }
+  if (e.session >= games.size()) {
+    r.unknown++;
+    return;
+  }
+  JournalGame &g = games[e.session];
+  switch (e.kind) {
+  case JE_ENTRANCE:
+    g.room = (int32_t)e.args[0];
+    g.depth = 1;
+    break;
+  case JE_DOOR:
+    g.door = (uint8_t)e.args[0];
+    g.clue = (uint32_t)e.args[1];
+    break;
+  case JE_HINT:
+  case JE_LOCKED:
+    g.score -= (int32_t)e.args[0];
+    break;
+  case JE_SOLVED:
+    g.score += (int32_t)e.args[1];
+    break;
+  case JE_MOVE:
+    g.room = (int32_t)e.args[0];
+    g.depth++;
+    break;
+  case JE_UNDO:
+    g.room = (int32_t)e.args[0];
+    g.depth--;
+    break;
+  case JE_ESCAPE:
+    g.score = (int32_t)unzigzag(e.args[0]);
+    g.over = JE_ESCAPE;
+    break;
+  case JE_QUIT:
+    g.score = 0;
+    g.over = JE_QUIT;
+    break;
+  case JE_END:
+    if (!g.over)
+      g.over = JE_END;
+    break;
+  default:
+    break;
+  }
+}
+
+/* =========================
+TIMER WHEEL
+Clue time limits for many sessions: a hierarchical hashed
+wheel, 4 levels x 256 slots, 1 ms per tick (2^32 ms, about
+49 days, before a timer has to go round again). Arming and
+cancelling are O(1) list splices; advancing fires what is
+due and, once per turn of a level, cascades the next slot
+of the level above down. Ticks are monoMs() (steady clock).
+========================= */
+static inline long long monoMs() {
+  return chrono::duration_cast<chrono::milliseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// A time() deadline in seconds (clueDeadline) as a monoMs() tick
+static long long monoDeadline(time_t deadline) {
+  if (deadline == 0)
+    return 0;
+  long long wallMs = chrono::duration_cast<chrono::milliseconds>(
+                         chrono::system_clock::now().time_since_epoch())
+                         .count();
+  return monoMs() + max(0LL, (long long)deadline * 1000 - wallMs);
+}
+
+static const int WHEEL_LEVELS = 4;
+static const int WHEEL_BITS = 8;
+static const int WHEEL_SLOTS = 1 << WHEEL_BITS;
+
+struct WheelLink {
+  WheelLink *prev;
+  WheelLink *next;
+};
+
+// Embedded in its owner (data points back to it)
+struct WheelTimer {
+  WheelLink link;    // first member; next == nullptr: not armed
+  long long expires; // tick
+  void *data;
+  int level;
+};
+
+struct TimerWheel {
+  WheelLink slots[WHEEL_LEVELS][WHEEL_SLOTS]; // circular lists, head = slot
+  int count[WHEEL_LEVELS];
+  long long next; // first tick not processed yet
+};
+
+void initTimerWheel(TimerWheel &w, long long now) {
+  for (int l = 0; l < WHEEL_LEVELS; l++) {
+    for (int i = 0; i < WHEEL_SLOTS; i++)
+      w.slots[l][i].prev = w.slots[l][i].next = &w.slots[l][i];
+    w.count[l] = 0;
+  }
+  w.next = now;
+}
+
+void initWheelTimer(WheelTimer &t, void *data) {
+  t.link.prev = t.link.next = nullptr;
+  t.expires = 0;
+  t.data = data;
+  t.level = 0;
+}
+
+static inline bool timerArmed(const WheelTimer &t) {
+  return t.link.next != nullptr;
+}
+
+static inline int wheelSlot(long long tick, int level) {
+  return (int)((tick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+}
+
+// Level by distance: level l holds timers 256^l .. 256^(l+1) ticks
+// ahead, in the slot of their tick's level-l digit. Farther than the
+// top level reaches: top level, looked at again when it cascades.
+static void linkTimer(TimerWheel &w, WheelTimer &t) {
+  if (t.expires < w.next)
+    t.expires = w.next; // overdue: fires on the next tick
+  long long delta = t.expires - w.next;
+  int level = 0;
+  while (level < WHEEL_LEVELS - 1 &&
+         delta >= (1LL << (WHEEL_BITS * (level + 1))))
+    level++;
+  WheelLink &head = w.slots[level][wheelSlot(t.expires, level)];
+  t.link.prev = head.prev;
+  t.link.next = &head;
+  head.prev->next = &t.link;
+  head.prev = &t.link;
+  t.level = level;
+  w.count[level]++;
+}
+
+static void unlinkTimer(TimerWheel &w, WheelTimer &t) {
+  t.link.prev->next = t.link.next;
+  t.link.next->prev = t.link.prev;
+  t.link.prev = t.link.next = nullptr;
+  w.count[t.level]--;
+}
+
+// (Re)arms t to fire at tick `expires`
+void armTimer(TimerWheel &w, WheelTimer &t, long long expires) {
+  if (timerArmed(t))
+    unlinkTimer(w, t);
+  t.expires = expires;
+  linkTimer(w, t);
+}
+
+void cancelTimer(TimerWheel &w, WheelTimer &t) {
+  if (timerArmed(t))
+    unlinkTimer(w, t);
+}
+
+// Moves a slot's list to `to` (an empty list head)
+static void takeSlot(WheelLink &slot, WheelLink &to) {
+  if (slot.next == &slot) {
+    to.prev = to.next = &to;
+    return;
+  }
+  to.next = slot.next;
+  to.prev = slot.prev;
+  to.next->prev = &to;
+  to.prev->next = &to;
+  slot.prev = slot.next = &slot;
+}
+
+static void cascadeSlot(TimerWheel &w, int level, int slot) {
+  WheelLink list;
+  takeSlot(w.slots[level][slot], list);
+  while (list.next != &list) {
+    WheelTimer &t = *(WheelTimer *)list.next;
+    unlinkTimer(w, t);
+    linkTimer(w, t);
+  }
+}
+
+// Fires every timer due by tick `now` in tick order; fire(t) runs
+// with t already disarmed and may arm or cancel any timer.
+// Returns the number fired.
+template <class F> int advanceWheel(TimerWheel &w, long long now, F fire) {
+  int fired = 0;
+  while (w.next <= now) {
+    long long tick = w.next;
+    int idx = wheelSlot(tick, 0);
+    if (idx == 0) { // a level-0 turn: bring the next slots down
+      for (int l = 1; l < WHEEL_LEVELS; l++) {
+        int slot = wheelSlot(tick, l);
+        cascadeSlot(w, l, slot);
+        if (slot != 0)
+          break;
+      }
+    }
+    if (w.count[0] == 0) {
+      // nothing before the next turn: skip the empty slots
+      bool empty = true;
+      for (int l = 1; l < WHEEL_LEVELS; l++)
+        empty = empty && w.count[l] == 0;
+      long long turn = (tick | (WHEEL_SLOTS - 1)) + 1;
+      w.next = empty ? now + 1 : min(turn, now + 1);
+      continue;
+    }
+
+    WheelLink due;
+    takeSlot(w.slots[0][idx], due);
+    w.next = tick + 1; // timers armed from fire() land after this tick
+    while (due.next != &due) {
+      WheelTimer &t = *(WheelTimer *)due.next;
+      unlinkTimer(w, t);
+      fired++;
+      fire(t);
+    }
+  }
+  return fired;
+}
+
+// Earliest tick anything may fire (exact for level 0, the cascade
+// tick for higher levels), -1 = no timers
+long long wheelNextDue(const TimerWheel &w) {
+  if (w.count[0] != 0) {
+    for (int i = 0; i < WHEEL_SLOTS; i++) {
+      const WheelLink &slot = w.slots[0][wheelSlot(w.next + i, 0)];
+      if (slot.next != &slot)
+        return w.next + i;
+    }
+  }
+  long long best = -1;
+  for (int l = 1; l < WHEEL_LEVELS; l++) {
+    if (w.count[l] == 0)
+      continue;
+    int shift = WHEEL_BITS * l;
+    long long cur = w.next >> shift;
+    // the current block's slot is still due if its turn has not started
+    int k = (w.next & ((1LL << shift) - 1)) == 0 ? 0 : 1;
+    for (; k <= WHEEL_SLOTS; k++) {
+      const WheelLink &slot = w.slots[l][wheelSlot((cur + k) << shift, l)];
+      if (slot.next != &slot) {
+        long long at = (cur + k) << shift;
+        if (best < 0 || at < best)
+          best = at;
+        break;
+      }
+    }
+  }
+  return best;
+}
+
+// ms until the next timer may fire (a poll/epoll timeout), -1 = none
+int wheelTimeoutMs(const TimerWheel &w, long long now) {
+  long long due = wheelNextDue(w);
+  if (due < 0)
+    return -1;
+  return (int)min(max(0LL, due - now), (long long)INT32_MAX);
+}
+
+/* =========================
+COROUTINE PUZZLES
+(built with -std=c++20)
+solveClueAsync() and readChoiceAsync() read like the old
+blocking loops, but suspend while the player thinks. A
+puzzle resumes on an answer or when its time limit runs
+out (a real timer, not a check after the next answer).
+One CoScheduler on one thread drives any number of players.
+========================= */
+#ifdef HAVE_COROUTINES
+// Lazily started coroutine returning T; `co_await task` runs it
+// and resumes the awaiting coroutine when it finishes
+template <class T> struct CoTask {
+  struct promise_type;
+  using Handle = coroutine_handle<promise_type>;
+
+  struct FinalAwait {
+    bool await_ready() noexcept { return false; }
+    coroutine_handle<> await_suspend(Handle h) noexcept {
+      coroutine_handle<> caller = h.promise().caller;
+      return caller ? caller : noop_coroutine();
+    }
+    void await_resume() noexcept {}
+  };
+
+  struct promise_type {
+    T value{};
+    coroutine_handle<> caller; // null for a top-level task
+    CoTask get_return_object() { return CoTask(Handle::from_promise(*this)); }
+    suspend_always initial_suspend() noexcept { return {}; }
+    FinalAwait final_suspend() noexcept { return {}; }
+    void return_value(T v) { value = move(v); }
+    void unhandled_exception() { terminate(); }
+  };
+
+  Handle h;
+
+  CoTask() : h(nullptr) {}
+  explicit CoTask(Handle handle) : h(handle) {}
+  CoTask(CoTask &&o) noexcept : h(exchange(o.h, nullptr)) {}
+  CoTask &operator=(CoTask &&o) noexcept {
+    if (this != &o) {
+      if (h)
+        h.destroy();
+      h = exchange(o.h, nullptr);
+    }
+    return *this;
+  }
+  CoTask(const CoTask &) = delete;
+  CoTask &operator=(const CoTask &) = delete;
+  ~CoTask() {
+    if (h)
+      h.destroy(); // also frees awaited child tasks still suspended
+  }
+
+  // Top-level task: run until it first waits for input
+  void start() { h.resume(); }
+  bool done() const { return !h || h.done(); }
+
+  bool await_ready() const noexcept { return false; }
+  coroutine_handle<> await_suspend(coroutine_handle<> caller) noexcept {
+    h.promise().caller = caller;
+    return h;
+  }
+  T await_resume() { return move(h.promise().value); }
+};
+
+enum CoWait { WAIT_LINE, WAIT_TIMEOUT, WAIT_CLOSED };
+
+struct CoScheduler;
+
+// One player's input side: lines queue here until the game
+// coroutine asks for one
+struct CoPlayer {
+  CoScheduler *sched;
+  ostream *out; // where the game writes
+  void *user;   // driver data (the server's connection)
+  deque<string> lines;
+  coroutine_handle<> waiter; // suspended in readLine()
+  WheelTimer timer;          // the open puzzle's time limit
+  bool queued;               // in sched->ready
+  bool closed; // no more input will come
+};
+
+struct CoScheduler {
+  TimerWheel wheel;         // players' time limits
+  vector<CoPlayer *> ready; // resume these next
+};
+
+void initCoScheduler(CoScheduler &sched) {
+  initTimerWheel(sched.wheel, monoMs());
+  sched.ready.clear();
+}
+
+void initCoPlayer(CoPlayer &p, CoScheduler &sched, ostream &out,
+                  void *user) {
+  p.sched = &sched;
+  p.out = &out;
+  p.user = user;
+  p.waiter = nullptr;
+  initWheelTimer(p.timer, &p);
+  p.queued = false;
+  p.closed = false;
+}
+
+static void cancelCoTimer(CoPlayer &p) {
+  cancelTimer(p.sched->wheel, p.timer);
+}
+
+static void wakeCoPlayer(CoPlayer &p) {
+  cancelCoTimer(p);
+  if (p.waiter && !p.queued) {
+    p.queued = true;
+    p.sched->ready.push_back(&p);
+  }
+}
+
+// Before the player is freed while its game is still suspended
+void detachCoPlayer(CoPlayer &p) {
+  cancelCoTimer(p);
+  if (p.queued) {
+    vector<CoPlayer *> &ready = p.sched->ready;
+    ready.erase(find(ready.begin(), ready.end(), &p));
+    p.queued = false;
+  }
+}
+
+void deliverLine(CoPlayer &p, string line) {
+  p.lines.push_back(move(line));
+  wakeCoPlayer(p);
+}
+
+void closeCoPlayer(CoPlayer &p) {
+  p.closed = true;
+  wakeCoPlayer(p);
+}
+
+// `co_await readLine(p, line, deadline)`: the next line, or
+// WAIT_TIMEOUT once monoMs() reaches deadline (0 = no limit)
+struct LineAwait {
+  CoPlayer &p;
+  string &line;
+  long long deadline;
+
+  bool await_ready() const {
+    return !p.lines.empty() || p.closed ||
+           (deadline != 0 && monoMs() >= deadline);
+  }
+  void await_suspend(coroutine_handle<> h) {
+    p.waiter = h;
+    if (deadline != 0)
+      armTimer(p.sched->wheel, p.timer, deadline);
+  }
+  CoWait await_resume() {
+    p.waiter = nullptr;
+    if (!p.lines.empty()) { // an answer beats a timer in the same tick
+      line = move(p.lines.front());
+      p.lines.pop_front();
+      return WAIT_LINE;
+    }
+    return p.closed ? WAIT_CLOSED : WAIT_TIMEOUT;
+  }
+};
+
+static LineAwait readLine(CoPlayer &p, string &line, long long deadline) {
+  return LineAwait{p, line, deadline};
+}
+
+// Queues the players whose timers are due
+void fireTimers(CoScheduler &sched, long long now) {
+  advanceWheel(sched.wheel, now,
+               [](WheelTimer &t) { wakeCoPlayer(*(CoPlayer *)t.data); });
+}
+
+// Resumes every ready player; after(p) runs once its game waits
+// again (or has finished)
+template <class F> void runReady(CoScheduler &sched, F after) {
+  vector<CoPlayer *> batch;
+  while (!sched.ready.empty()) {
+    batch.swap(sched.ready);
+    for (CoPlayer *p : batch) {
+      p->queued = false;
+      coroutine_handle<> h = p->waiter;
+      h.resume();
+      after(*p);
+    }
+    batch.clear();
+  }
+}
+
+// solveClue() as a coroutine: same prompts and rules, but the
+// time limit fires on its own while the player is silent
+CoTask<ClueStep> solveClueAsync(Clue &clue, int &score, CoPlayer &p) {
+  time_t startTime;
+  ClueStep step = beginClue(clue, startTime, *p.out);
+  while (step == CLUE_PENDING) {
+    string line;
+    long long deadline = monoDeadline(clueDeadline(clue, startTime));
+    switch (co_await readLine(p, line, deadline)) {
+    case WAIT_LINE:
+      step = answerClue(clue, line, startTime, score, *p.out);
+      break;
+    case WAIT_TIMEOUT:
+      step = expireClue(clue, startTime, *p.out);
+      break;
+    case WAIT_CLOSED:
+      co_return CLUE_LOCKED;
+    }
+  }
+  co_return step;
+}
+
+// The door-choice step: the next number typed (blank lines
+// are skipped); false if the player left
+CoTask<bool> readChoiceAsync(CoPlayer &p, int &choice) {
+  string line;
+  while (co_await readLine(p, line, 0) == WAIT_LINE)
+    if (parseChoice(line, choice))
+      co_return true;
+  co_return false;
+}
+
+// The turn loop for a session from startSession(); true once the
+// game is over, false if the player left first
+CoTask<bool> playSessionAsync(GameSession &s, CoPlayer &p) {
+  ostream &out = *p.out;
+  int choice;
+  while (s.state == SESSION_ENTRANCE) {
+    if (!co_await readChoiceAsync(p, choice))
+      co_return false;
+    sessionEntrance(s, choice, out);
+  }
+  while (s.state != SESSION_OVER) {
+    if (!co_await readChoiceAsync(p, choice))
+      co_return false;
+    if (!sessionDoor(s, choice, out))
+      continue;
+
+    int room = sessionRoom(s);
+    Clue clue;
+    loadSessionClue(s, room, s.doorIndex, clue);
+    bool spent = clue.attempts <= 0;
+    ClueStep step = co_await solveClueAsync(clue, s.score, p);
+    storeSessionClue(s, room, s.doorIndex, clue);
+    if (p.closed)
+      co_return false;
+    closePuzzle(s, step, out, spent);
+  }
+  co_return true;
+}
+
+#ifdef __linux__
+// --timed: the terminal game on the coroutine path; stdin is
+// polled so a time limit can fire while the player is silent
+int playTimedGame(const CompactMap &tpl, unsigned long long seed) {
+  CoScheduler sched;
+  initCoScheduler(sched);
+  TurnFrame frame;
+  CoPlayer player;
+  initCoPlayer(player, sched, frame.out, nullptr);
+  GameSession session;
+  cout.flush();
+  startSession(session, tpl, seed, frame.out);
+  CoTask<bool> game = playSessionAsync(session, player);
+  game.start();
+
+  string pending;
+  char buf[4096];
+  while (!game.done()) {
+    emitFrame(frame);
+    pollfd pfd = {0, POLLIN, 0};
+    int n = poll(&pfd, 1, wheelTimeoutMs(sched.wheel, monoMs()));
+    if (n < 0 && errno != EINTR)
+      break;
+    if (n > 0) {
+      ssize_t got = read(0, buf, sizeof(buf));
+      if (got > 0) {
+        pending.append(buf, (size_t)got);
+        size_t start = 0, nl;
+        while ((nl = pending.find('\n', start)) != string::npos) {
+          deliverLine(player, pending.substr(start, nl - start));
+          start = nl + 1;
+        }
+        pending.erase(0, start);
+      } else if (got == 0 || errno != EINTR) {
+        if (!pending.empty())
+          deliverLine(player, pending);
+        pending.clear();
+        closeCoPlayer(player);
+      }
+    }
+    fireTimers(sched, monoMs());
+    runReady(sched, [](CoPlayer &) {});
+  }
+  emitFrame(frame);
+  game = CoTask<bool>();
+  endSession(session);
+  return 0;
+}
+#endif
+#endif
+
+/* =========================
+HEADLESS SIMULATION
+(--simulate: plays games with a scripted/random
+ player policy on a pool of threads)
+========================= */
+enum DoorPolicy { DOORS_RANDOM, DOORS_FIRST, DOORS_GUIDE };
+
+struct SimConfig {
+  long long games;
+  int threads;
+  unsigned long long seed;
+  DoorPolicy doors;
+  double skill;       // P(correct answer) per attempt
+  double hintRate;    // P(ask for a hint before answering)
+  double hintSkill;   // P(correct answer) once the hint is known
+  double timeoutRate; // P(an attempt runs past timeLimit)
+  double backRate;    // P(undo instead of opening a door)
+  double typoRate;    // P(a right TEXT answer has one wrong byte)
+  int maxTurns;       // games longer than this count as stuck
+  const RouteIndex *routes; // DOORS_GUIDE: index of the map graph
+};
+
+static const int SIM_SCORE_MIN = -2500;
+static const int SIM_SCORE_BUCKET = 10;
+static const int SIM_SCORE_BUCKETS = 500; // -2500 .. +2500
+
+static const int SIM_MAX_ENTRANCES = 16; // entrances reported one by one
+
+struct SimStats {
+  long long games;
+  long long escaped;
+  long long stuck;
+  long long turns;
+  long long hints;
+  long long wrong;
+  long long timeouts;
+  long long lockedDoors;
+  long long traps;
+  long long undos;
+  long long gamesByEntrance[SIM_MAX_ENTRANCES]; // last slot: all others
+  long long escapedByEntrance[SIM_MAX_ENTRANCES];
+  long long scoreSum;
+  double scoreSqSum;
+  int minScore;
+  int maxScore;
+  long long scoreHist[SIM_SCORE_BUCKETS];
+};
+
+void resetSimStats(SimStats &st) {
+  memset(&st, 0, sizeof(st));
+  st.minScore = numeric_limits<int>::max();
+  st.maxScore = numeric_limits<int>::min();
+}
+
+void mergeSimStats(SimStats &into, const SimStats &from) {
+  into.games += from.games;
+  into.escaped += from.escaped;
+  into.stuck += from.stuck;
+  into.turns += from.turns;
+  into.hints += from.hints;
+  into.wrong += from.wrong;
+  into.timeouts += from.timeouts;
+  into.lockedDoors += from.lockedDoors;
+  into.traps += from.traps;
+  into.undos += from.undos;
+  for (int i = 0; i < SIM_MAX_ENTRANCES; i++) {
+    into.gamesByEntrance[i] += from.gamesByEntrance[i];
+    into.escapedByEntrance[i] += from.escapedByEntrance[i];
+  }
+  into.scoreSum += from.scoreSum;
+  into.scoreSqSum += from.scoreSqSum;
+  if (from.minScore < into.minScore)
+    into.minScore = from.minScore;
+  if (from.maxScore > into.maxScore)
+    into.maxScore = from.maxScore;
+  for (int i = 0; i < SIM_SCORE_BUCKETS; i++)
+    into.scoreHist[i] += from.scoreHist[i];
+}
+
+// Builds the string a player with this policy would type for one attempt
+static void simAnswer(const Clue &clue, const SimConfig &cfg, GameRng &rng,
+                      string &out) {
+  if (!clue.usedHint && rngUnit(rng) < cfg.hintRate) {
+    out = "H";
+    return;
+  }
+  double p = clue.usedHint ? cfg.hintSkill : cfg.skill;
+  bool right = rngUnit(rng) < p;
+  if (clue.type == MCQ) {
+    char c = clue.correctOption;
+    if (!right)
+      c = (char)('A' + (c - 'A' + 1 + rngBelow(rng, 3)) % 4);
+    out.assign(1, c);
+  } else {
+    out = right ? clue.answer.substr(0, clue.answer.find('|'))
+                : string_view("?");
+    if (right && !out.empty() && cfg.typoRate > 0 &&
+        rngUnit(rng) < cfg.typoRate) {
+      size_t at = rngBelow(rng, (uint32_t)out.size());
+      out[at] = out[at] == 'x' ? 'y' : 'x';
+    }
+  }
+}
+
+// solveClue without a terminal: the policy types the answers
+static bool simSolveClue(Clue &clue, int &score, const SimConfig &cfg,
+                         GameRng &rng, SimStats &st) {
+  string input;
+  while (clue.attempts > 0) {
+    simAnswer(clue, cfg, rng, input);
+    int elapsed = 0;
+    if (clue.timeLimit > 0 && rngUnit(rng) < cfg.timeoutRate)
+      elapsed = clue.timeLimit + 1;
+    switch (applyAttempt(clue, input, elapsed, score)) {
+    case ATTEMPT_CORRECT:
+      return true;
+    case ATTEMPT_WRONG:
+      st.wrong++;
+      break;
+    case ATTEMPT_TIMEOUT:
+      st.timeouts++;
+      break;
+    case ATTEMPT_HINT:
+      st.hints++;
+      break;
+    case ATTEMPT_HINT_REUSED:
+    case ATTEMPT_INVALID:
+      break;
+    }
+  }
+  return false;
+}
+
+// DOORS_GUIDE: the door (0/1) closer to an exit. The arena holds
+// the rooms in map-graph order, so a room's index is its offset.
+static int guideDoor(const RouteIndex &ri, const GameArena &arena,
+                     const Room *r) {
+  int d1 = r->next1 ? routeStep(ri, (int)(r->next1 - arena.rooms.data())).dist
+                    : -1;
+  int d2 = r->next2 ? routeStep(ri, (int)(r->next2 - arena.rooms.data())).dist
+                    : -1;
+  return d2 >= 0 && (d1 < 0 || d2 < d1) ? 1 : 0;
+}
+
+// Mirrors the turn loop in main()
+void simulateGame(const SimConfig &cfg, GameRng &rng, SimStats &st,
+                  GameArena *arena) {
+  resetUsedClues();
+  resetArena(*arena);
+  GameMap gm = buildGameMap(rng, arena);
+
+  int entrance = (int)rngBelow(rng, gm.entranceCount);
+  Room *current = gm.entrances[entrance];
+  if (entrance >= SIM_MAX_ENTRANCES)
+    entrance = SIM_MAX_ENTRANCES - 1;
+  int score = 100;
+  PathNode *history = nullptr;
+  pushPath(history, current, arena);
+
+  bool escaped = false;
+  int turn = 0;
+  for (; turn < cfg.maxTurns && !escaped; turn++) {
+    METRIC_SPAN(SPAN_TURN);
+    current->visited = true;
+
+    // Back
+    if (history->next && rngUnit(rng) < cfg.backRate) {
+      popPath(history, arena);
+      current = history->r;
+      st.undos++;
+      continue;
+    }
+
+    if (current->roomType == ROOM_EXIT) {
+      if (simSolveClue(current->clues[0], score, cfg, rng, st))
+        escaped = true;
+      continue;
+    }
+
+    int choice = 1;
+    if (current->clueCount == 2 && cfg.doors == DOORS_RANDOM)
+      choice = 1 + (int)rngBelow(rng, 2);
+    else if (current->clueCount == 2 && cfg.doors == DOORS_GUIDE)
+      choice = 1 + guideDoor(*cfg.routes, *arena, current);
+
+    int doorIndex;
+    Room *nextRoom;
+    if (selectDoor(current, choice, doorIndex, nextRoom) != DOOR_OPEN)
+      continue;
+
+    if (!simSolveClue(current->clues[doorIndex], score, cfg, rng, st)) {
+      lockDoorAfterFailure(current->clues[doorIndex], score);
+      st.lockedDoors++;
+      continue;
+    }
+
+    if (getTrapMessage(current, doorIndex))
+      st.traps++;
+
+    pushPath(history, nextRoom, arena);
+    current = nextRoom;
+  }
+
+  st.games++;
+  st.turns += turn;
+  st.gamesByEntrance[entrance]++;
+  if (escaped) {
+    st.escaped++;
+    st.escapedByEntrance[entrance]++;
+    if (LEADERBOARD) {
+      int diff = DIFF_NONE;
+      for (PathNode *n = history; n; n = n->next)
+        diff = max(diff, (int)n->r->difficulty);
+      submitScore(*LEADERBOARD, score, entrance, diff);
+    }
+  } else {
+    st.stuck++;
+  }
+  st.scoreSum += score;
+  st.scoreSqSum += (double)score * score;
+  if (score < st.minScore)
+    st.minScore = score;
+  if (score > st.maxScore)
+    st.maxScore = score;
+  int b = (score - SIM_SCORE_MIN) / SIM_SCORE_BUCKET;
+  if (b < 0)
+    b = 0;
+  if (b >= SIM_SCORE_BUCKETS)
+    b = SIM_SCORE_BUCKETS - 1;
+  st.scoreHist[b]++;
+
+  freeMap(gm);
+  freePath(history, arena);
+}
+
+static const long long SIM_CHUNK = 1024; // games claimed per grab
+
+static void simWorker(const SimConfig *cfg, atomic<long long> *nextGame,
+                      int thread, SimStats *out) {
+  GameRng rng;
+  seedRngStream(rng, cfg->seed, (unsigned long long)thread);
+  resetSimStats(*out);
+  GameArena *arena = createArena();
+  while (true) {
+    long long begin = nextGame->fetch_add(SIM_CHUNK);
+    if (begin >= cfg->games)
+      break;
+    long long end = begin + SIM_CHUNK;
+    if (end > cfg->games)
+      end = cfg->games;
+    for (long long g = begin; g < end; g++)
+      simulateGame(*cfg, rng, *out, arena);
+  }
+  destroyArena(arena);
+}
+
+// lower edge of the bucket holding the q-th quantile
+static int simScorePercentile(const SimStats &st, double q) {
+  long long target = (long long)(q * (st.games - 1));
+  long long seen = 0;
+  for (int i = 0; i < SIM_SCORE_BUCKETS; i++) {
+    seen += st.scoreHist[i];
+    if (seen > target)
+      return SIM_SCORE_MIN + i * SIM_SCORE_BUCKET;
+  }
+  return st.maxScore;
+}
+
+void printSimReport(const SimConfig &cfg, const SimStats &st, double secs) {
+  double n = st.games ? (double)st.games : 1.0;
+  double mean = st.scoreSum / n;
+  double var = st.scoreSqSum / n - mean * mean;
+
+  cout << fixed << setprecision(2);
+  cout << "==== Simulation ====\n";
+  cout << "Games:        " << st.games << " on " << cfg.threads
+       << " thread(s)\n";
+  cout << "Time:         " << secs << " s (" << (st.games / secs)
+       << " games/sec)\n";
+  cout << "Escape rate:  " << 100.0 * st.escaped / n << "% (stuck "
+       << st.stuck << ")\n";
+  for (int i = 0; i < SIM_MAX_ENTRANCES; i++) {
+    if (!st.gamesByEntrance[i])
+      continue;
+    double g = (double)st.gamesByEntrance[i];
+    cout << "  EN" << (i + 1) << (i == SIM_MAX_ENTRANCES - 1 ? "+" : "")
+         << ": " << 100.0 * st.escapedByEntrance[i] / g << "% of "
+         << st.gamesByEntrance[i] << "\n";
+  }
+  cout << "Score:        mean " << mean << ", stddev "
+       << sqrt(var > 0 ? var : 0) << ", min " << st.minScore << ", max "
+       << st.maxScore << "\n";
+  cout << "  p10 " << simScorePercentile(st, 0.10) << ", p50 "
+       << simScorePercentile(st, 0.50) << ", p90 "
+       << simScorePercentile(st, 0.90) << "\n";
+  cout << "Per game:     turns " << st.turns / n << ", hints "
+       << st.hints / n << ", wrong " << st.wrong / n << ", timeouts "
+       << st.timeouts / n << ", locked doors " << st.lockedDoors / n
+       << ", traps " << st.traps / n << ", undos " << st.undos / n << "\n";
+}
+
+static const char *argValue(int argc, char **argv, const char *flag) {
+  for (int i = 0; i + 1 < argc; i++)
+    if (strcmp(argv[i], flag) == 0)
+      return argv[i + 1];
+  return nullptr;
+}
+
+static bool argFlag(int argc, char **argv, const char *flag) {
+  for (int i = 0; i < argc; i++)
+    if (strcmp(argv[i], flag) == 0)
+      return true;
+  return false;
+}
+
+static double argDouble(int argc, char **argv, const char *flag, double def) {
+  const char *v = argValue(argc, argv, flag);
+  return v ? atof(v) : def;
+}
+
+static long long argLong(int argc, char **argv, const char *flag,
+                         long long def) {
+  const char *v = argValue(argc, argv, flag);
+  return v ? atoll(v) : def;
+}
+
+// --metrics FILE: the metrics so far (see writeMetrics), if asked for
+bool saveMetrics(int argc, char **argv) {
+  const char *path = argValue(argc, argv, "--metrics");
+  string err;
+  if (path && !writeMetrics(path, err)) {
+    cerr << err << "\n";
+    return false;
+  }
+  return true;
+}
+
+// --clues FILE loads a bank file, otherwise the built-in sample is used
+bool setupClueBank(int argc, char **argv) {
+  FUZZY_ANSWERS = argFlag(argc, argv, "--fuzzy");
+#ifndef ESCAPE_METRICS
+  if (argValue(argc, argv, "--metrics")) {
+    cerr << "--metrics needs a build with -DESCAPE_METRICS\n";
+    return false;
+  }
+#endif
+  const char *path = argValue(argc, argv, "--clues");
+  if (!path) {
+    initClueBank();
+    return true;
+  }
+  string err;
+  if (!loadClueBankFile(path, err)) {
+    cerr << "Cannot load clue bank: " << err << "\n";
+    return false;
+  }
+  return true;
+}
+
+// Maze settings shared by --maze, --gen-map and the benchmarks
+static MazeConfig mazeConfigFromArgs(int argc, char **argv, int rooms) {
+  MazeConfig cfg;
+  cfg.rooms = rooms;
+  cfg.entrances = (int)argLong(argc, argv, "--entrances", 4);
+  cfg.exits = (int)argLong(argc, argv, "--exits", 2);
+  cfg.easyRatio = argDouble(argc, argv, "--easy-ratio", 0.6);
+  cfg.trapRate = argDouble(argc, argv, "--trap-rate", 0.25);
+  cfg.seed = (unsigned long long)argLong(argc, argv, "--maze-seed", 1);
+  return cfg;
+}
+
+// --map FILE or --maze N plays on that map instead of the built-in one
+bool setupMap(int argc, char **argv) {
+  const char *path = argValue(argc, argv, "--map");
+  long long mazeRooms = argLong(argc, argv, "--maze", 0);
+  if (!path && !mazeRooms)
+    return true;
+  string err;
+  bool ok;
+  if (path)
+    ok = loadMapGraph(path, LOADED_MAP, err) &&
+         validateMapGraph(LOADED_MAP, err);
+  else
+    ok = generateMaze(mazeConfigFromArgs(argc, argv, (int)mazeRooms),
+                      LOADED_MAP, err);
+  if (!ok) {
+    cerr << "Cannot load map: " << err << "\n";
+    return false;
+  }
+  HAVE_LOADED_MAP = true;
+  return true;
+}
+
+/* --simulate [--games N] [--threads T] [--seed S]
+              [--policy random|first|guide]
+              [--skill P] [--hint-rate P] [--hint-skill P]
+              [--timeout-rate P] [--back-rate P] [--typo-rate P]
+              [--max-turns N] [--hint-penalty N] [--wrong-penalty N]
+              [--fuzzy] [--leaderboard] [--clues FILE]
+              [--map FILE | --maze N [maze flags, see --gen-map]] */
+int runSimulation(int argc, char **argv) {
+  SimConfig cfg;
+  cfg.games = argLong(argc, argv, "--games", 1000000);
+  cfg.threads = (int)argLong(argc, argv, "--threads",
+                             (long long)thread::hardware_concurrency());
+  if (cfg.threads < 1)
+    cfg.threads = 1;
+  cfg.seed = (unsigned long long)argLong(argc, argv, "--seed",
+                                         (long long)time(nullptr));
+  const char *policy = argValue(argc, argv, "--policy");
+  cfg.doors = DOORS_RANDOM;
+  if (policy && strcmp(policy, "first") == 0)
+    cfg.doors = DOORS_FIRST;
+  else if (policy && strcmp(policy, "guide") == 0)
+    cfg.doors = DOORS_GUIDE;
+  cfg.routes = nullptr;
+  cfg.skill = argDouble(argc, argv, "--skill", 0.7);
+  cfg.hintRate = argDouble(argc, argv, "--hint-rate", 0.1);
+  cfg.hintSkill = argDouble(argc, argv, "--hint-skill", 0.9);
+  cfg.timeoutRate = argDouble(argc, argv, "--timeout-rate", 0.05);
+  cfg.backRate = argDouble(argc, argv, "--back-rate", 0.0);
+  cfg.typoRate = argDouble(argc, argv, "--typo-rate", 0.0);
+  cfg.maxTurns = (int)argLong(argc, argv, "--max-turns", 200);
+  HINT_PENALTY = (int)argLong(argc, argv, "--hint-penalty", HINT_PENALTY);
+  WRONG_PENALTY = (int)argLong(argc, argv, "--wrong-penalty", WRONG_PENALTY);
+
+  if (!setupClueBank(argc, argv) || !setupMap(argc, argv))
+    return 1;
+  if (argFlag(argc, argv, "--leaderboard"))
+    LEADERBOARD = createLeaderboard();
+  RouteIndex routes;
+  if (cfg.doors == DOORS_GUIDE) {
+    buildRouteIndex(gameMapGraph(), cfg.skill, routes);
+    cfg.routes = &routes;
+  }
+
+  vector<SimStats> perThread(cfg.threads);
+  vector<thread> pool;
+  atomic<long long> nextGame(0);
+
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  for (int t = 0; t < cfg.threads; t++)
+    pool.push_back(thread(simWorker, &cfg, &nextGame, t, &perThread[t]));
+  for (size_t t = 0; t < pool.size(); t++)
+    pool[t].join();
+  double secs =
+      chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+  SimStats total;
+  resetSimStats(total);
+  for (int t = 0; t < cfg.threads; t++)
+    mergeSimStats(total, perThread[t]);
+
+  cout << "Seed: " << cfg.seed << "\n";
+  printSimReport(cfg, total, secs);
+  if (LEADERBOARD) {
+    LeaderSnapshot snap;
+    snapshotLeaderboard(*LEADERBOARD, snap);
+    printLeaderboard(snap, cout);
+  }
+  return saveMetrics(argc, argv) ? 0 : 1;
+}
+
+/* =========================
+MDP SOLVER
+(--solve: exact expected final score by backward induction)
+A turn is what the simulator calls one: a round of up to
+DEFAULT_ATTEMPTS answers at one door (hints allowed), or
+the final gate. The state is (room, turns left) plus, in a
+round, (attempts left, hint used). Winning a round adds the
+clue's points and moves on; losing costs WRONG_PENALTY and
+the player stays; losing at the final gate leaves the
+player stuck there. A door is fresh each time it is opened;
+undo and quit are not modelled. Loops can be replayed for
+points, so the horizon is the simulator's --max-turns.
+========================= */
+enum SolvePolicy { SOLVE_OPTIMAL, SOLVE_RANDOM, SOLVE_FIRST };
+
+struct SolverConfig {
+  int turns;   // horizon (the simulator's --max-turns)
+  int threads;
+  SolvePolicy policy;
+  double skill;       // P(correct answer) per attempt
+  double hardSkill;   // same for HARD clues
+  double hintSkill;   // P(correct answer) once the hint is known
+  double hintRate;    // random/first: P(ask for a hint before answering)
+  double timeoutRate; // P(an attempt runs past timeLimit)
+};
+
+// One door as the solver sees it (next = NO_ROOM: the final gate)
+struct SolverDoor {
+  int32_t next;
+  float points;
+  float pass;     // P(an answer wins) without the hint
+  float hintPass; // with it
+};
+
+struct SolverResult {
+  vector<double> value;  // expected points still to come, per room
+  vector<double> escape; // P(escape), per room
+  vector<uint8_t> door;  // first turn: door taken (0/1), 255 = none
+  vector<uint8_t> hints; // first turn: bit a-1 = hint with a attempts left
+  long long states;
+  double secs;
+  int threads; // actually used: small maps stay on one
+};
+
+static void solverDoor(const SolverConfig &cfg, uint32_t clueIdx,
+                       int32_t next, SolverDoor &d) {
+  d.next = next;
+  d.points = 0;
+  d.pass = d.hintPass = 0;
+  if (clueIdx == NO_CLUE)
+    return;
+  Clue clue;
+  loadBankClue((int)clueIdx, clue);
+  double onTime = clue.timeLimit > 0 ? 1 - cfg.timeoutRate : 1;
+  double skill = clue.diffTag == HARD_CLUE ? cfg.hardSkill : cfg.skill;
+  d.points = (float)clue.points;
+  d.pass = (float)(onTime * skill);
+  d.hintPass = (float)(onTime * cfg.hintSkill);
+}
+
+// One round at a door: win = value after winning (points included),
+// lose = value after the round is lost. hint[a - 1] = P(ask for the
+// hint with a attempts left) while it is unknown.
+static double roundValue(const SolverDoor &d, double win, double lose,
+                         const double *hint, double hintPenalty) {
+  double noHint = lose, withHint = lose; // a - 1 attempts left
+  for (int a = 1; a <= DEFAULT_ATTEMPTS; a++) {
+    double known = d.hintPass * win + (1 - d.hintPass) * withHint;
+    double answer = d.pass * win + (1 - d.pass) * noHint;
+    noHint = hint[a - 1] * (known - hintPenalty) + (1 - hint[a - 1]) * answer;
+    withHint = known;
+  }
+  return noHint;
+}
+
+// Same, asking for the hint exactly when it pays; hint[] gets the choice
+static double bestRound(const SolverDoor &d, double win, double lose,
+                        double *hint) {
+  double noHint = lose, withHint = lose;
+  for (int a = 1; a <= DEFAULT_ATTEMPTS; a++) {
+    double known = d.hintPass * win + (1 - d.hintPass) * withHint;
+    double answer = d.pass * win + (1 - d.pass) * noHint;
+    hint[a - 1] = known - HINT_PENALTY > answer ? 1 : 0;
+    noHint = max(known - HINT_PENALTY, answer);
+    withHint = known;
+  }
+  return noHint;
+}
+
+// Threads meet here after every turn layer
+struct SpinBarrier {
+  atomic<int> waiting;
+  atomic<int> generation;
+  int count;
+};
+
+static void waitBarrier(SpinBarrier &b) {
+  int gen = b.generation.load();
+  if (b.waiting.fetch_add(1) + 1 == b.count) {
+    b.waiting.store(0);
+    b.generation.fetch_add(1);
+    return;
+  }
+  while (b.generation.load() == gen)
+    this_thread::yield();
+}
+
+// Solves all rooms of a template; layer t holds the values with t
+// turns left, computed from layer t - 1 (rooms split over threads)
+void solveGame(const CompactMap &tpl, const SolverConfig &cfg,
+               SolverResult &res) {
+  int n = (int)tpl.rooms.size();
+  vector<SolverDoor> doors(2 * (size_t)n);
+  vector<uint8_t> kind(n); // walkable doors, 3 = exit
+  for (int i = 0; i < n; i++) {
+    const CompactRoom &c = tpl.rooms[i];
+    kind[i] = c.type == ROOM_EXIT ? 3 : (uint8_t)walkDoors(c);
+    solverDoor(cfg, c.clue1, c.type == ROOM_EXIT ? NO_ROOM : c.next1,
+               doors[2 * i]);
+    solverDoor(cfg, c.clue2, c.next2, doors[2 * i + 1]);
+  }
+
+  // value and escape side by side: one cache miss per next room
+  struct SolverValue {
+    double value;
+    double escape;
+  };
+  vector<SolverValue> layer[2];
+  layer[0].assign(n, SolverValue{0, 0});
+  layer[1].assign(n, SolverValue{0, 0});
+  res.door.assign(n, 255);
+  res.hints.assign(n, 0);
+
+  int threads = max(1, min(cfg.threads, n / 4096 + 1));
+  res.threads = threads;
+  SpinBarrier barrier;
+  barrier.waiting.store(0);
+  barrier.generation.store(0);
+  barrier.count = threads;
+  double fixedHint[DEFAULT_ATTEMPTS];
+  for (int a = 0; a < DEFAULT_ATTEMPTS; a++)
+    fixedHint[a] = cfg.hintRate;
+
+  auto work = [&](int thread) {
+    int lo = (int)((long long)n * thread / threads);
+    int hi = (int)((long long)n * (thread + 1) / threads);
+    for (int t = 1; t <= cfg.turns; t++) {
+      const SolverValue *prev = layer[(t - 1) & 1].data();
+      SolverValue *out = layer[t & 1].data();
+      for (int r = lo; r < hi; r++) {
+        double hint[DEFAULT_ATTEMPTS] = {0};
+        if (kind[r] == 3) { // final gate: win ends the game
+          const SolverDoor &d = doors[2 * r];
+          if (cfg.policy == SOLVE_OPTIMAL)
+            out[r].value = bestRound(d, d.points, 0, hint);
+          else
+            out[r].value = roundValue(d, d.points, 0, fixedHint, HINT_PENALTY);
+          out[r].escape = roundValue(
+              d, 1, 0, cfg.policy == SOLVE_OPTIMAL ? hint : fixedHint, 0);
+          if (t == cfg.turns) {
+            res.door[r] = 0;
+            for (int a = 0; a < DEFAULT_ATTEMPTS; a++)
+              res.hints[r] |= (uint8_t)((hint[a] > 0) << a);
+          }
+          continue;
+        }
+
+        // a door that leads nowhere wastes the turn
+        double stayV = prev[r].value, stayE = prev[r].escape;
+        double lose = prev[r].value - WRONG_PENALTY;
+        double bestV = 0, bestE = 0;
+        int bestDoor = -1;
+        uint8_t bestHints = 0;
+        double sumV = 0, sumE = 0;
+        int choices = cfg.policy == SOLVE_FIRST ? min(1, (int)kind[r])
+                                                : (int)kind[r];
+        for (int k = 0; k < choices; k++) {
+          const SolverDoor &d = doors[2 * r + k];
+          double dv, de;
+          fill(hint, hint + DEFAULT_ATTEMPTS, 0.0);
+          if (d.next == NO_ROOM) {
+            dv = stayV;
+            de = stayE;
+          } else if (cfg.policy == SOLVE_OPTIMAL) {
+            dv = bestRound(d, d.points + prev[d.next].value, lose, hint);
+            de = roundValue(d, prev[d.next].escape, prev[r].escape, hint, 0);
+          } else {
+            dv = roundValue(d, d.points + prev[d.next].value, lose, fixedHint,
+                            HINT_PENALTY);
+            de = roundValue(d, prev[d.next].escape, prev[r].escape, fixedHint, 0);
+          }
+          sumV += dv;
+          sumE += de;
+          if (bestDoor < 0 || dv > bestV) {
+            bestDoor = k;
+            bestV = dv;
+            bestE = de;
+            bestHints = 0;
+            for (int a = 0; a < DEFAULT_ATTEMPTS; a++)
+              bestHints |= (uint8_t)((hint[a] > 0) << a);
+          }
+        }
+        if (choices == 0) {
+          out[r].value = stayV;
+          out[r].escape = stayE;
+        } else if (cfg.policy == SOLVE_OPTIMAL) {
+          out[r].value = bestV;
+          out[r].escape = bestE;
+        } else {
+          out[r].value = sumV / choices;
+          out[r].escape = sumE / choices;
+        }
+        if (t == cfg.turns && choices > 0 && cfg.policy == SOLVE_OPTIMAL) {
+          res.door[r] = (uint8_t)bestDoor;
+          res.hints[r] = bestHints;
+        }
+      }
+      waitBarrier(barrier);
+    }
+  };
+
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  vector<thread> pool;
+  for (int t = 1; t < threads; t++)
+    pool.push_back(thread(work, t));
+  work(0);
+  for (size_t t = 0; t < pool.size(); t++)
+    pool[t].join();
+  res.secs =
+      chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+
+  const vector<SolverValue> &last = layer[cfg.turns & 1];
+  res.value.resize(n);
+  res.escape.resize(n);
+  for (int i = 0; i < n; i++) {
+    res.value[i] = last[i].value;
+    res.escape[i] = last[i].escape;
+  }
+  res.states = 0;
+  for (int i = 0; i < n; i++) // rooms x turns x doors x (attempts x hint)
+    res.states += (long long)max(1, (int)(kind[i] == 3 ? 1 : kind[i])) *
+                  cfg.turns * DEFAULT_ATTEMPTS * 2;
+}
+
+/* --solve [--seed S] [--templates K] [--policy optimal|random|first]
+           [--max-turns N]
+           [--threads T] [--skill P] [--hard-skill P] [--hint-skill P]
+           [--hint-rate P] [--timeout-rate P] [--hint-penalty N]
+           [--wrong-penalty N] [--clues FILE] [--map FILE | --maze N]
+   expected final score and escape rate per entrance of the map
+   `--seed S` plays (averaged over seeds S .. S+K-1 with --templates);
+   same player model and defaults as --simulate */
+int runSolve(int argc, char **argv) {
+  SolverConfig cfg;
+  unsigned long long seed = (unsigned long long)argLong(argc, argv, "--seed", 1);
+  cfg.turns = (int)argLong(argc, argv, "--max-turns", 200);
+  cfg.threads = (int)argLong(argc, argv, "--threads",
+                             (long long)thread::hardware_concurrency());
+  if (cfg.threads < 1)
+    cfg.threads = 1;
+  const char *policy = argValue(argc, argv, "--policy");
+  cfg.policy = SOLVE_OPTIMAL;
+  if (policy && strcmp(policy, "random") == 0)
+    cfg.policy = SOLVE_RANDOM;
+  else if (policy && strcmp(policy, "first") == 0)
+    cfg.policy = SOLVE_FIRST;
+  cfg.skill = argDouble(argc, argv, "--skill", 0.7);
+  cfg.hardSkill = argDouble(argc, argv, "--hard-skill", cfg.skill);
+  cfg.hintSkill = argDouble(argc, argv, "--hint-skill", 0.9);
+  cfg.hintRate = argDouble(argc, argv, "--hint-rate", 0.1);
+  cfg.timeoutRate = argDouble(argc, argv, "--timeout-rate", 0.05);
+  HINT_PENALTY = (int)argLong(argc, argv, "--hint-penalty", HINT_PENALTY);
+  WRONG_PENALTY = (int)argLong(argc, argv, "--wrong-penalty", WRONG_PENALTY);
+  if (cfg.turns < 1) {
+    cerr << "--max-turns must be at least 1\n";
+    return 1;
+  }
+  if (!setupClueBank(argc, argv) || !setupMap(argc, argv))
+    return 1;
+
+  // the simulator draws a new template every game: average over K
+  int templates = (int)max(1LL, argLong(argc, argv, "--templates", 1));
+  const CompactMap &graph = gameMapGraph();
+  int entrances = (int)graph.entrances.size();
+  vector<double> score(entrances, 0.0), escape(entrances, 0.0);
+  CompactMap tpl;
+  SolverResult res;
+  long long states = 0;
+  double secs = 0;
+  int threads = 1;
+  for (int k = 0; k < templates; k++) {
+    GameRng rng;
+    seedRng(rng, seed + k);
+    buildMapTemplate(rng, graph, tpl);
+    solveGame(tpl, cfg, res);
+    states += res.states;
+    secs += res.secs;
+    threads = max(threads, res.threads);
+    for (int i = 0; i < entrances; i++) {
+      score[i] += (100 + res.value[tpl.entrances[i]]) / templates;
+      escape[i] += res.escape[tpl.entrances[i]] / templates;
+    }
+  }
+
+  static const char *names[] = {"optimal", "random", "first"};
+  cout << fixed << setprecision(2);
+  cout << "==== MDP solver (seed " << seed;
+  if (templates > 1)
+    cout << " .. " << seed + templates - 1;
+  cout << ", policy " << names[cfg.policy] << ", " << cfg.turns
+       << " turns) ====\n";
+  cout << "States:       " << states << " (" << graph.rooms.size()
+       << " rooms x " << templates << " template(s)), solved in " << secs
+       << " s on " << threads << " thread(s)\n";
+  double sumScore = 0, sumEscape = 0;
+  int best = 0;
+  for (int i = 0; i < entrances; i++) {
+    int r = tpl.entrances[i];
+    sumScore += score[i];
+    sumEscape += escape[i];
+    if (score[i] > score[best])
+      best = i;
+    if (i >= SIM_MAX_ENTRANCES)
+      continue;
+    cout << "  EN" << (i + 1) << " (room " << tpl.roomIDs[r] << "): score "
+         << score[i] << ", escape " << 100 * escape[i] << "%";
+    // first-turn choice of the optimal player (one template only)
+    if (templates == 1 && cfg.policy == SOLVE_OPTIMAL && res.door[r] != 255) {
+      cout << ", door " << res.door[r] + 1;
+      if (res.hints[r])
+        cout << ", hint with";
+      for (int a = DEFAULT_ATTEMPTS; a >= 1; a--)
+        if (res.hints[r] & (1 << (a - 1)))
+          cout << " " << a;
+      if (res.hints[r])
+        cout << " attempts left";
+    }
+    cout << "\n";
+  }
+  cout << "Random entrance: score " << sumScore / entrances << ", escape "
+       << 100 * sumEscape / entrances << "%\n";
+  cout << "Best entrance:   EN" << best + 1 << ", score " << score[best]
+       << "\n";
+  return 0;
+}
+
+/* =========================
+GAME SERVER
+--serve: one epoll loop hosts many GameSessions over a
+Unix socket (or TCP on 127.0.0.1). Each connection is a
+player; lines in, prompts out, nothing blocks.
+========================= */
+#ifdef __linux__
+struct ServerConn {
+  int fd;
+  GameSession session;
+  string in;     // received bytes, not yet a full line
+  string out;    // prompts not yet written
+  bool closing;  // session over: close once out is flushed
+  bool wantOut;  // EPOLLOUT registered
+  SessionLog *log; // --record: this session's recording, else nullptr
+  uint64_t id;     // --checkpoint: its resume code
+  unsigned long long seed; // its template is what `--seed seed` plays
+  uint64_t tplHash;
+  bool dirty;      // changed since its last snapshot
+  bool saved;      // the checkpoint file holds a snapshot of it
+  uint64_t number; // --journal: its session number in this run
+#ifdef HAVE_COROUTINES
+  CoPlayer player;   // --timed: the session runs as a coroutine
+  CoTask<bool> game;
+#else
+  WheelTimer clueTimer; // --timed: the open puzzle's time limit
+#endif
+};
+
+static const size_t SERVER_MAX_LINE = 4096;
+
+struct ServerConfig {
+  const char *socketPath; // Unix socket, or nullptr for TCP
+  int port;
+  unsigned long long seed;
+  int templates;      // shared map templates, session k plays k % templates
+  long long maxGames; // stop after this many finished sessions, 0 = never
+  bool timed;         // coroutine sessions with real time limits
+  const char *recordDir; // --record: one recording per session, or nullptr
+  const char *metricsPath; // --metrics: rewritten every second, or nullptr
+  const char *leaderboardPath; // --leaderboard: likewise
+  const char *checkpointPath;  // --checkpoint: live sessions, or nullptr
+  int checkpointMs;            // between checkpoint passes
+  const char *journalPath;     // --journal: every turn outcome, or nullptr
+};
+
+// --checkpoint: a session restored at startup, kept until its
+// player comes back with its resume code
+struct ParkedSession {
+  GameSession session;
+  unsigned long long seed;
+  uint64_t tplHash;
+};
+
+struct ServerCheckpoint {
+  CheckpointWriter writer;
+  size_t compactSize; // file size after the last rewrite
+  map<unsigned long long, CompactMap> templates; // of restored sessions
+  map<unsigned long long, uint64_t> tplHashes;
+  unordered_map<uint64_t, ParkedSession> parked; // by resume code
+  vector<uint64_t> ended; // saved sessions closed since the last pass
+  GameRng codes;          // resume codes
+};
+
+// Parks every session of the file, then rewrites it with just those
+static bool restoreServerCheckpoint(ServerCheckpoint &cp, const char *path,
+                                    string &err) {
+  cp.writer.fd = -1;
+  cp.writer.path = path;
+  seedRng(cp.codes, (unsigned long long)time(nullptr) ^
+                        (unsigned long long)getpid() << 32 ^
+                        (unsigned long long)monoMs());
+  MappedFile mf;
+  if (access(path, F_OK) == 0) {
+    if (!mapFile(path, mf, err))
+      return false;
+    string_view data(mf.data, mf.size);
+    unordered_map<uint64_t, size_t> live;
+    size_t torn;
+    bool ok = readCheckpoint(data, live, torn, err);
+    for (const pair<const uint64_t, size_t> &e : live) {
+      if (!ok)
+        break;
+      ParkedSession p;
+      SnapshotRecord r;
+      ok = restoreSnapshot(data, e.second, cp.templates, cp.tplHashes,
+                           p.session, r, err);
+      if (ok) {
+        p.seed = r.seed;
+        p.tplHash = r.tplHash;
+        cp.parked[r.id] = p;
+        appendSnapshot(cp.writer.batch, r.id, r.seed, r.tplHash, p.session);
+      }
+    }
+    unmapFile(mf);
+    if (!ok) {
+      err = string(path) + ": " + err;
+      return false;
+    }
+    if (torn)
+      cerr << path << ": dropped " << torn
+           << " bytes of an unfinished checkpoint\n";
+  }
+  if (!rewriteCheckpoint(cp.writer, err))
+    return false;
+  cp.compactSize = cp.writer.fileSize;
+  return true;
+}
+
+static uint64_t newResumeCode(ServerCheckpoint &cp) {
+  uint64_t code;
+  do
+    code = rngNext(cp.codes);
+  while (code == 0 || cp.parked.count(code));
+  return code;
+}
+
+// Appends the sessions changed since the last pass and the ones that
+// ended as one batch; rewrites the file once it is mostly stale
+static void checkpointPass(ServerCheckpoint &cp,
+                           const unordered_set<ServerConn *> &conns) {
+  CheckpointWriter &w = cp.writer;
+  for (uint64_t id : cp.ended)
+    appendSnapshotMark(w.batch, SNAP_ENDED, id);
+  cp.ended.clear();
+  for (ServerConn *c : conns)
+    if (c->dirty && !c->closing) {
+      appendSnapshot(w.batch, c->id, c->seed, c->tplHash, c->session);
+      c->dirty = false;
+      c->saved = true;
+    }
+  if (w.batch.empty())
+    return;
+  string err;
+  bool ok = commitCheckpoint(w, err);
+  if (ok && w.fileSize > max(4 * cp.compactSize, (size_t)1 << 20)) {
+    for (ServerConn *c : conns)
+      if (c->saved && !c->closing)
+        appendSnapshot(w.batch, c->id, c->seed, c->tplHash, c->session);
+    for (const pair<const uint64_t, ParkedSession> &e : cp.parked)
+      appendSnapshot(w.batch, e.first, e.second.seed, e.second.tplHash,
+                     e.second.session);
+    ok = rewriteCheckpoint(w, err);
+    if (ok)
+      cp.compactSize = w.fileSize;
+  }
+  if (!ok)
+    cerr << err << "\n";
+}
+
+// "resume CODE" as a session's first line: the connection takes
+// over the restored session with that code instead
+static void resumeConn(ServerConn &c, ServerCheckpoint &cp,
+                       const string &code, ostream &out) {
+  auto it = cp.parked.find(strtoull(code.c_str(), nullptr, 16));
+  if (it == cp.parked.end()) {
+    out << "No saved game with that code.\n";
+    resumeSession(c.session, out);
+    return;
+  }
+  if (c.saved)
+    cp.ended.push_back(c.id);
+  endSession(c.session);
+  c.session = it->second.session;
+  c.id = it->first;
+  c.seed = it->second.seed;
+  c.tplHash = it->second.tplHash;
+  c.saved = c.dirty = true;
+  cp.parked.erase(it);
+  delete c.log; // a recording has to start with the session
+  c.log = nullptr;
+  journalEvent(JE_RESUME, c.seed,
+               zigzag(c.session.pathLen
+                          ? c.session.tpl->roomIDs[sessionRoom(c.session)]
+                          : -1),
+               (uint64_t)c.session.pathLen, zigzag(c.session.score));
+  out << "Welcome back.\n";
+  resumeSession(c.session, out);
+}
+
+static bool setNonBlocking(int fd) {
+  int flags = fcntl(fd, F_GETFL, 0);
+  return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+static int openListener(const ServerConfig &cfg, string &err) {
+  int fd;
+  if (cfg.socketPath) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(cfg.socketPath) >= sizeof(addr.sun_path)) {
+      err = "socket path too long";
+      return -1;
+    }
+    strcpy(addr.sun_path, cfg.socketPath);
+    unlink(cfg.socketPath);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+      err = string("cannot bind ") + cfg.socketPath + ": " + strerror(errno);
+      if (fd >= 0)
+        close(fd);
+      return -1;
+    }
+  } else {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)cfg.port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    if (fd >= 0)
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+      err = "cannot bind 127.0.0.1:" + to_string(cfg.port) + ": " +
+            strerror(errno);
+      if (fd >= 0)
+        close(fd);
+      return -1;
+    }
+  }
+  if (listen(fd, SOMAXCONN) != 0 || !setNonBlocking(fd)) {
+    err = string("listen failed: ") + strerror(errno);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Writes what the socket takes; false if the peer is gone
+static bool flushConn(ServerConn &c) {
+  size_t done = 0;
+  while (done < c.out.size()) {
+    ssize_t n = send(c.fd, c.out.data() + done, c.out.size() - done,
+                     MSG_NOSIGNAL);
+    if (n > 0) {
+      done += (size_t)n;
+    } else if (n < 0 && errno == EINTR) {
+      continue;
+    } else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      break;
+    } else {
+      return false;
+    }
+  }
+  c.out.erase(0, done);
+  return true;
+}
+
+// Feeds every complete line to the session, collects its output
+static void feedConn(ServerConn &c, TurnFrame &frame, ServerCheckpoint *cp) {
+  size_t start = 0, nl;
+  JOURNAL_SESSION = c.number;
+  while (!c.closing && (nl = c.in.find('\n', start)) != string::npos) {
+    string line = c.in.substr(start, nl - start);
+    if (!line.empty() && line.back() == '\r')
+      line.pop_back();
+    start = nl + 1;
+#ifdef HAVE_COROUTINES
+    if (c.game.h) { // output comes when the scheduler resumes it
+      deliverLine(c.player, move(line));
+      continue;
+    }
+#endif
+    c.dirty = true;
+    if (cp && c.session.state == SESSION_ENTRANCE && c.session.pathLen == 0 &&
+        line.compare(0, 7, "resume ") == 0) {
+      resumeConn(c, *cp, line.substr(7), frame.out);
+      continue;
+    }
+    size_t mark = frame.buf.text.size();
+    if (c.log)
+      logSessionLine(*c.log, line);
+    if (!feedSession(c.session, line, frame.out))
+      c.closing = true;
+    if (c.log)
+      logSessionState(*c.log, c.session,
+                      string_view(frame.buf.text).substr(mark));
+  }
+  c.in.erase(0, start);
+  takeFrame(frame, c.out);
+}
+
+// --record: DIR exists, and sessions run on the state machine
+static bool checkRecordDir(const ServerConfig &cfg) {
+  if (!cfg.recordDir)
+    return true;
+#ifdef HAVE_COROUTINES
+  if (cfg.timed) {
+    cerr << "--record cannot record --timed sessions in a C++20 build\n";
+    return false;
+  }
+#endif
+  error_code ec;
+  filesystem::create_directories(cfg.recordDir, ec);
+  if (!filesystem::is_directory(cfg.recordDir, ec)) {
+    cerr << "cannot create " << cfg.recordDir << "\n";
+    return false;
+  }
+  return true;
+}
+
+int serveGames(const ServerConfig &cfg) {
+  string err;
+  ServerCheckpoint *cp = nullptr;
+  if (cfg.checkpointPath) {
+    cp = new ServerCheckpoint;
+    if (!restoreServerCheckpoint(*cp, cfg.checkpointPath, err)) {
+      cerr << err << "\n";
+      return 1;
+    }
+    cerr << "Restored " << cp->parked.size() << " sessions from "
+         << cfg.checkpointPath << "\n";
+  }
+  JournalWriter *journal = nullptr;
+  JournalBuffer events; // this loop's events, one block per round
+  if (cfg.journalPath) {
+    journal = new JournalWriter;
+    if (!openJournal(*journal, cfg.journalPath, err)) {
+      cerr << err << "\n";
+      return 1;
+    }
+    events.events = 0;
+    events.now = events.base = time(nullptr);
+    unsigned long long runSeed = (unsigned long long)events.now ^
+                                 (unsigned long long)getpid() << 32 ^
+                                 (unsigned long long)monoMs();
+    events.run = splitmix64(runSeed);
+    JOURNAL = &events;
+  }
+  int listener = openListener(cfg, err);
+  if (listener < 0) {
+    cerr << err << "\n";
+    return 1;
+  }
+  int ep = epoll_create1(0);
+  epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = nullptr; // nullptr = the listener
+  epoll_ctl(ep, EPOLL_CTL_ADD, listener, &ev);
+
+  // template t is what `--seed S + t` plays in the terminal game
+  vector<CompactMap> templates(cfg.templates);
+  vector<uint64_t> tplHashes(cfg.templates); // --checkpoint
+  for (int t = 0; t < cfg.templates; t++) {
+    GameRng rng;
+    seedRng(rng, cfg.seed + t);
+    buildMapTemplate(rng, gameMapGraph(), templates[t]);
+    if (cp)
+      tplHashes[t] = templateHash(templates[t]);
+  }
+
+  TurnFrame frame; // every session renders here, then into its out
+  ostream &render = frame.out;
+  unordered_set<ServerConn *> conns;
+  long long started = 0, finished = 0, live = 0;
+  epoll_event ready[256];
+  char buf[4096];
+#ifdef HAVE_COROUTINES
+  CoScheduler sched;
+  initCoScheduler(sched);
+  TimerWheel &wheel = sched.wheel;
+#else
+  TimerWheel wheel; // --timed: time limits of the open puzzles
+  initTimerWheel(wheel, monoMs());
+#endif
+
+  auto closeConn = [&](ServerConn *c) {
+    epoll_ctl(ep, EPOLL_CTL_DEL, c->fd, nullptr);
+    close(c->fd);
+#ifdef HAVE_COROUTINES
+    if (c->game.h)
+      detachCoPlayer(c->player);
+#else
+    cancelTimer(wheel, c->clueTimer);
+#endif
+    if (c->log) {
+      string err;
+      if (!saveSessionLog(*c->log, c->log->path.c_str(), err))
+        cerr << err << "\n";
+      delete c->log;
+    }
+    if (cp && c->saved)
+      cp->ended.push_back(c->id);
+    JOURNAL_SESSION = c->number;
+    journalEvent(JE_END);
+    conns.erase(c);
+    endSession(c->session);
+    delete c;
+    finished++;
+    live--;
+  };
+
+  // Writes pending output, closes finished or dead connections
+  auto settleConn = [&](ServerConn *c, bool alive) {
+    if (!flushConn(*c) || (!alive && !c->closing)) {
+      closeConn(c);
+      return;
+    }
+    if (c->out.empty() && c->closing) {
+      closeConn(c);
+      return;
+    }
+    bool wantOut = !c->out.empty();
+    if (wantOut != c->wantOut) {
+      c->wantOut = wantOut;
+      ev.events = wantOut ? EPOLLIN | EPOLLOUT : EPOLLIN;
+      ev.data.ptr = c;
+      epoll_ctl(ep, EPOLL_CTL_MOD, c->fd, &ev);
+    }
+  };
+
+#ifndef HAVE_COROUTINES
+  // --timed without coroutines: a wheel timer per open puzzle
+  auto armClueTimer = [&](ServerConn *c) {
+    time_t deadline = c->closing ? 0 : sessionDeadline(c->session);
+    if (deadline)
+      armTimer(wheel, c->clueTimer, monoDeadline(deadline));
+    else
+      cancelTimer(wheel, c->clueTimer);
+  };
+#endif
+
+  if (cfg.leaderboardPath && !LEADERBOARD)
+    LEADERBOARD = createLeaderboard();
+  // --metrics / --leaderboard files
+  auto writeStats = [&cfg]() {
+    string err;
+    bool ok = true;
+    if (cfg.metricsPath && !writeMetrics(cfg.metricsPath, err))
+      ok = false;
+    if (cfg.leaderboardPath &&
+        !writeLeaderboard(*LEADERBOARD, cfg.leaderboardPath, err))
+      ok = false;
+    if (!ok)
+      cerr << err << "\n";
+    return ok;
+  };
+  long long nextStats = 0, nextCheckpoint = 0;
+  while (cfg.maxGames == 0 || finished < cfg.maxGames) {
+    int timeoutMs = wheelTimeoutMs(wheel, monoMs());
+    if (cp) {
+      long long now = monoMs();
+      if (now >= nextCheckpoint) {
+        checkpointPass(*cp, conns);
+        nextCheckpoint = now + cfg.checkpointMs;
+      }
+      if (timeoutMs < 0 || timeoutMs > nextCheckpoint - now)
+        timeoutMs = (int)(nextCheckpoint - now);
+    }
+    if (cfg.metricsPath || cfg.leaderboardPath) { // once a second, even idle
+      long long now = monoMs();
+      if (now >= nextStats) {
+        writeStats();
+        nextStats = now + 1000;
+      }
+      if (timeoutMs < 0 || timeoutMs > nextStats - now)
+        timeoutMs = (int)(nextStats - now);
+    }
+    int n = epoll_wait(ep, ready, 256, timeoutMs);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      cerr << "epoll_wait: " << strerror(errno) << "\n";
+      break;
+    }
+    events.now = time(nullptr);
+    for (int i = 0; i < n; i++) {
+      ServerConn *c = (ServerConn *)ready[i].data.ptr;
+      if (!c) {
+        int fd;
+        while ((fd = accept(listener, nullptr, nullptr)) >= 0) {
+          setNonBlocking(fd);
+          c = new ServerConn;
+          c->fd = fd;
+          c->closing = false;
+          c->wantOut = false;
+          c->log = nullptr;
+          int t = (int)(started % cfg.templates);
+          c->number = (uint64_t)started;
+          JOURNAL_SESSION = c->number;
+          c->dirty = c->saved = false;
+          if (cp) {
+            c->id = newResumeCode(*cp);
+            c->seed = cfg.seed + t;
+            c->tplHash = tplHashes[t];
+            c->dirty = true;
+            char code[17];
+            snprintf(code, sizeof(code), "%016llx", (unsigned long long)c->id);
+            render << "(If the server restarts, reconnect and type: resume "
+                   << code << ")\n";
+          }
+          size_t mark = frame.buf.text.size();
+          startSession(c->session, templates[t], cfg.seed + t, render);
+          if (cfg.recordDir) {
+            c->log = new SessionLog;
+            c->log->path = string(cfg.recordDir) + "/session-" +
+                           to_string(started) + ".rec";
+            startSessionLog(*c->log, c->session, cfg.seed + t,
+                            string_view(frame.buf.text).substr(mark));
+          }
+          conns.insert(c);
+          started++;
+#ifdef HAVE_COROUTINES
+          if (cfg.timed) {
+            initCoPlayer(c->player, sched, render, c);
+            c->game = playSessionAsync(c->session, c->player);
+            c->game.start();
+          }
+#else
+          initWheelTimer(c->clueTimer, c);
+#endif
+          takeFrame(frame, c->out);
+          live++;
+          ev.events = EPOLLIN;
+          ev.data.ptr = c;
+          epoll_ctl(ep, EPOLL_CTL_ADD, fd, &ev);
+          if (!flushConn(*c))
+            closeConn(c);
+        }
+        continue;
+      }
+
+      bool alive = true;
+      if (ready[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+        while (true) {
+          ssize_t got = recv(c->fd, buf, sizeof(buf), 0);
+          if (got > 0) {
+            c->in.append(buf, (size_t)got);
+            continue;
+          }
+          if (got < 0 && errno == EINTR)
+            continue;
+          if (got == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+            alive = false;
+          break;
+        }
+        feedConn(*c, frame, cp);
+#ifndef HAVE_COROUTINES
+        if (cfg.timed)
+          armClueTimer(c);
+#endif
+        if (c->in.size() > SERVER_MAX_LINE)
+          alive = false; // not a player
+      }
+      settleConn(c, alive);
+    }
+
+#ifdef HAVE_COROUTINES
+    // answers that arrived and time limits that ran out
+    fireTimers(sched, monoMs());
+    runReady(sched, [&](CoPlayer &p) {
+      ServerConn *c = (ServerConn *)p.user;
+      takeFrame(frame, c->out);
+      if (c->game.done())
+        c->closing = true;
+      settleConn(c, true);
+    });
+#else
+    advanceWheel(wheel, monoMs(), [&](WheelTimer &t) {
+      ServerConn *c = (ServerConn *)t.data;
+      JOURNAL_SESSION = c->number;
+      if (c->log)
+        logSessionTimeout(*c->log);
+      expireSession(c->session, render);
+      c->dirty = true;
+      if (c->log)
+        logSessionState(*c->log, c->session, frame.buf.text);
+      takeFrame(frame, c->out);
+      armClueTimer(c);
+      settleConn(c, true);
+    });
+#endif
+    if (journal && events.events) // the flusher syncs it with its peers
+      submitJournal(*journal, events);
+  }
+  close(ep);
+  close(listener);
+  if (cfg.socketPath)
+    unlink(cfg.socketPath);
+  if (cp) { // what is still open is played on after a restart
+    checkpointPass(*cp, conns);
+    close(cp->writer.fd);
+    for (pair<const uint64_t, ParkedSession> &e : cp->parked)
+      endSession(e.second.session);
+    delete cp;
+  }
+  bool ok = true;
+  if (journal) {
+    submitJournal(*journal, events);
+    JOURNAL = nullptr;
+    if (!closeJournal(*journal, err)) {
+      cerr << err << "\n";
+      ok = false;
+    }
+    delete journal;
+  }
+  return writeStats() && ok ? 0 : 1;
+}
+#endif
+
+/* --serve [--socket PATH | --port N] [--seed S] [--templates K]
+           [--max-games N] [--timed] [--record DIR]
+           [--metrics FILE] [--leaderboard FILE]
+           [--checkpoint FILE [--checkpoint-ms N]] [--journal FILE]
+           [--clues FILE] [--map FILE | --maze N]
+   session k plays the template of seed S + k % K; --timed: clue
+   time limits fire on their own (coroutine sessions in a C++20
+   build, wheel timers on the state machine otherwise); --record:
+   DIR/session-k.rec for --replay once session k ends;
+   --leaderboard: best escapes so far, rewritten every second;
+   --checkpoint: live sessions saved every N ms (default 1000) and
+   restored on the next start, each for the player with its code;
+   --journal: every turn outcome appended to FILE (see JOURNAL FILES) */
+int runServer(int argc, char **argv) {
+#ifdef __linux__
+  ServerConfig cfg;
+  cfg.socketPath = argValue(argc, argv, "--socket");
+  cfg.port = (int)argLong(argc, argv, "--port", 0);
+  if (!cfg.socketPath && cfg.port == 0)
+    cfg.socketPath = "/tmp/escape-room.sock";
+  cfg.seed = (unsigned long long)argLong(argc, argv, "--seed",
+                                         (long long)time(nullptr));
+  cfg.maxGames = argLong(argc, argv, "--max-games", 0);
+  cfg.templates = (int)argLong(argc, argv, "--templates", 16);
+  if (cfg.templates < 1)
+    cfg.templates = 1;
+  cfg.timed = argFlag(argc, argv, "--timed");
+  cfg.recordDir = argValue(argc, argv, "--record");
+  cfg.metricsPath = argValue(argc, argv, "--metrics");
+  cfg.leaderboardPath = argValue(argc, argv, "--leaderboard");
+  cfg.checkpointPath = argValue(argc, argv, "--checkpoint");
+  cfg.checkpointMs = (int)argLong(argc, argv, "--checkpoint-ms", 1000);
+  if (cfg.checkpointMs < 1)
+    cfg.checkpointMs = 1;
+  cfg.journalPath = argValue(argc, argv, "--journal");
+#ifdef HAVE_COROUTINES
+  if (cfg.checkpointPath && cfg.timed) {
+    cerr << "--checkpoint cannot restore --timed sessions in a C++20 build\n";
+    return 1;
+  }
+  if (cfg.journalPath && cfg.timed) {
+    cerr << "--journal cannot follow --timed sessions in a C++20 build\n";
+    return 1;
+  }
+#endif
+  if (!checkRecordDir(cfg) || !setupClueBank(argc, argv) ||
+      !setupMap(argc, argv))
+    return 1;
+  if (cfg.socketPath)
+    cerr << "Serving on " << cfg.socketPath << "\n";
+  else
+    cerr << "Serving on 127.0.0.1:" << cfg.port << "\n";
+  return serveGames(cfg);
+#else
+  (void)argc;
+  (void)argv;
+  cerr << "--serve needs Linux (epoll)\n";
+  return 1;
+#endif
+}
+
+/* =========================
+BENCHMARKS
+========================= */
+typedef chrono::steady_clock BenchClock;
+
+static volatile long long BENCH_SINK; // keeps benchmark results observable
+
+static inline double nsSince(BenchClock::time_point t0) {
+  return (double)chrono::duration_cast<chrono::nanoseconds>(BenchClock::now() -
+                                                            t0)
+      .count();
+}
+
+// resident set size in KiB (-1 where /proc is unavailable)
+long residentKiB() {
+  FILE *f = fopen("/proc/self/statm", "r");
+  if (!f)
+    return -1;
+  long pages = 0, resident = 0;
+  int got = fscanf(f, "%ld %ld", &pages, &resident);
+  fclose(f);
+  if (got != 2)
+    return -1;
+#ifdef _WIN32
+  return -1;
+#else
+  return resident * (sysconf(_SC_PAGESIZE) / 1024);
+#endif
+}
+
+/* --bench-arena [--games N] [--moves M]
+   build map + M push/pop (undo) pairs + teardown, heap vs arena */
+int runArenaBenchmark(int argc, char **argv) {
+  long long games = argLong(argc, argv, "--games", 200000);
+  int moves = (int)argLong(argc, argv, "--moves", 64);
+  initClueBank();
+  GameRng rng;
+  seedRng(rng, 1);
+
+  GameArena *arena = createArena();
+  cout << fixed << setprecision(1);
+  cout << "==== Arena benchmark (" << games << " games, " << moves
+       << " moves/undos each) ====\n";
+  cout << "path    build ns   path ns    free ns    allocs/game\n";
+
+  for (int useArena = 0; useArena < 2; useArena++) {
+    GameArena *a = useArena ? arena : nullptr;
+    double buildNs = 0, pathNs = 0, freeNs = 0;
+    long long allocs0 = HEAP_ALLOCS;
+
+    for (long long g = 0; g < games; g++) {
+      BenchClock::time_point t0 = BenchClock::now();
+      resetUsedClues();
+      if (a)
+        resetArena(*a);
+      GameMap gm = buildMap(rng, a);
+      buildNs += nsSince(t0);
+
+      t0 = BenchClock::now();
+      PathNode *history = nullptr;
+      pushPath(history, gm.entrances[0], a);
+      for (int m = 0; m < moves; m++) {
+        pushPath(history, gm.all[m % gm.count], a);
+        if (m % 3 != 2) // two undos out of three moves
+          popPath(history, a);
+      }
+      pathNs += nsSince(t0);
+
+      t0 = BenchClock::now();
+      freeMap(gm);
+      freePath(history, a);
+      freeNs += nsSince(t0);
+    }
+
+    double perGame = (double)(HEAP_ALLOCS - allocs0) / games;
+    cout << (a ? "arena " : "heap  ") << setw(10) << buildNs / games
+         << setw(10) << pathNs / games << setw(11) << freeNs / games
+         << setw(15) << perGame << "\n";
+  }
+
+  destroyArena(arena);
+  return 0;
+}
+
+/* --bench-layout [--maps N] [--walks W]
+   random walks entrance -> exit over many maps:
+   pointer Room nodes vs CompactRoom nodes */
+static inline uint32_t benchXorshift(uint32_t &x) {
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x;
+}
+
+int runLayoutBenchmark(int argc, char **argv) {
+  int maps = (int)argLong(argc, argv, "--maps", 10000);
+  long long walks = argLong(argc, argv, "--walks", 2000000);
+  initClueBank();
+  GameRng rng;
+  seedRng(rng, 1);
+
+  vector<GameMap> heapMaps(maps);
+  vector<CompactMap> compactMaps(maps);
+  for (int m = 0; m < maps; m++) {
+    resetUsedClues();
+    heapMaps[m] = buildMap(rng);
+    buildCompactMap(heapMaps[m], compactMaps[m]);
+  }
+
+  cout << fixed << setprecision(2);
+  cout << "==== Layout benchmark (" << maps << " maps, " << walks
+       << " walks) ====\n";
+  cout << "node          bytes  nodes/64B line   ns/step\n";
+
+  for (int compact = 0; compact < 2; compact++) {
+    uint32_t rng = 2463534242u;
+    long long steps = 0, checksum = 0;
+    BenchClock::time_point t0 = BenchClock::now();
+    for (long long w = 0; w < walks; w++) {
+      int m = (int)(benchXorshift(rng) % (uint32_t)maps);
+      int e = (int)(benchXorshift(rng) & 3);
+      // one walk = doors picked at random until an exit (or 32 steps)
+      if (compact) {
+        const CompactMap &cm = compactMaps[m];
+        int cur = cm.entrances[e];
+        for (int k = 0; k < 32; k++, steps++) {
+          const CompactRoom &c = cm.rooms[cur];
+          if (c.type == ROOM_EXIT)
+            break;
+          bool second = c.clueCount == 2 && (benchXorshift(rng) & 1);
+          checksum += CLUE_BANK[second ? c.clue2 : c.clue1].points;
+          cur = second ? c.next2 : c.next1;
+        }
+      } else {
+        const Room *cur = heapMaps[m].entrances[e];
+        for (int k = 0; k < 32; k++, steps++) {
+          if (cur->roomType == ROOM_EXIT)
+            break;
+          bool second = cur->clueCount == 2 && (benchXorshift(rng) & 1);
+          checksum += cur->clues[second ? 1 : 0].points;
+          cur = second ? cur->next2 : cur->next1;
+        }
+      }
+    }
+    double ns = nsSince(t0);
+    size_t bytes = compact ? sizeof(CompactRoom) : sizeof(Room);
+    cout << (compact ? "CompactRoom " : "Room        ") << setw(7) << bytes
+         << setw(17) << 64.0 / bytes << setw(10) << ns / steps
+         << "   (checksum " << checksum << ")\n";
+  }
+
+  for (int m = 0; m < maps; m++)
+    freeMap(heapMaps[m]);
+  return 0;
+}
+
+/* --bench-clue-pools [--maps N]
+   clue selection for one map (4 entrance, 3 HARD, 5 EASY x2 picks)
+   against bank size: old linear scan vs persistent pools */
+static int legacyPickClue(const vector<ClueDifficulty> &tags,
+                          const vector<char> &used, vector<int> &valid,
+                          bool wantHard, GameRng &rng) {
+  int n = (int)tags.size(), cnt = 0;
+  for (int i = 0; i < n; i++) {
+    if (used[i])
+      continue;
+    if (wantHard ? tags[i] != EASY_CLUE : tags[i] != HARD_CLUE)
+      valid[cnt++] = i;
+  }
+  if (cnt == 0)
+    for (int i = 0; i < n; i++)
+      if (!used[i])
+        valid[cnt++] = i;
+  if (cnt == 0)
+    return (int)rngBelow(rng, n);
+  return valid[rngBelow(rng, cnt)];
+}
+
+int runCluePoolBenchmark(int argc, char **argv) {
+  long long maps = argLong(argc, argv, "--maps", 500);
+  static const int sizes[] = {52, 1000, 10000, 50000, 200000};
+  static const bool mapPicks[] = {false, false, false, false, // entrances
+                                  true,  true,  true,         // HARD
+                                  false, false, false, false, false,
+                                  false, false, false, false, false};
+  const int picks = sizeof(mapPicks) / sizeof(mapPicks[0]);
+  GameRng rng;
+  seedRng(rng, 1);
+
+  cout << fixed << setprecision(1);
+  cout << "==== Clue pool benchmark (" << maps << " map builds per size) ====\n";
+  cout << "bank size    scan us/map    pools us/map    speedup\n";
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    int n = sizes[s];
+    vector<ClueDifficulty> tags(n);
+    for (int i = 0; i < n; i++)
+      tags[i] = (ClueDifficulty)rngBelow(rng, 3);
+
+    // old: USED_CLUES flags + scan per pick
+    vector<char> used(n);
+    vector<int> valid(n);
+    long long sink = 0;
+    BenchClock::time_point t0 = BenchClock::now();
+    for (long long m = 0; m < maps; m++) {
+      fill(used.begin(), used.end(), 0);
+      for (int k = 0; k < picks; k++) {
+        int idx = legacyPickClue(tags, used, valid, mapPicks[k], rng);
+        used[idx] = 1;
+        sink += idx;
+      }
+    }
+    double scanUs = nsSince(t0) / 1000.0 / maps;
+
+    ClueBucketStore store;
+    ClueBuckets cb;
+    buildClueBuckets(store, cb, &tags[0], n);
+    CluePools cp;
+    initCluePools(cp, &cb);
+    t0 = BenchClock::now();
+    for (long long m = 0; m < maps; m++) {
+      resetCluePools(cp);
+      for (int k = 0; k < picks; k++) {
+        int idx =
+            sampleCluePool(cp, mapPicks[k] ? POOL_HARD : POOL_EASY, rng);
+        if (idx < 0)
+          idx = sampleCluePool(cp, POOL_ALL, rng);
+        takeFromCluePools(cp, idx);
+        sink += idx;
+      }
+    }
+    double poolUs = nsSince(t0) / 1000.0 / maps;
+
+    cout << setw(9) << n << setw(15) << scanUs << setw(16) << setprecision(3)
+         << poolUs << setw(11) << setprecision(1) << scanUs / poolUs
+         << "x\n";
+    BENCH_SINK = sink;
+  }
+  return 0;
+}
+
+/* --bench-answers [--checks N]
+   TEXT_ANSWER checks, for all TEXT clues of the built-in bank and for
+   the final gate alone (typed as is, in upper case, with extra spaces
+   and punctuation, with one typo, and wrong): old per-check lowercase
+   copies vs pre-normalised answers, exact and --fuzzy */
+static string legacyLower(string s) {
+  for (size_t i = 0; i < s.size(); i++) {
+    if (s[i] >= 'A' && s[i] <= 'Z')
+      s[i] = char(s[i] - 'A' + 'a');
+  }
+  return s;
+}
+
+int runAnswerBenchmark(int argc, char **argv) {
+  long long checks = argLong(argc, argv, "--checks", 4000000);
+  initClueBank();
+  static const int VARIANTS = 5;
+  static const char *matchers[] = {"lowercase", "normalised", "fuzzy"};
+
+  cout << fixed << setprecision(1);
+  cout << "==== Answer check benchmark (" << checks << " checks per row) ====\n";
+  cout << "clues         matcher      Mchecks/s   ns/check   allocs/check"
+          "   accepted\n";
+
+  for (int set = 0; set < 2; set++) {
+    vector<Clue> clues;
+    vector<string> inputs;
+    vector<int> owner;
+    for (int i = set ? FINAL_CLUE_INDEX : 0; i < clueBankSize(); i++) {
+      Clue c;
+      loadBankClue(i, c);
+      if (c.type != TEXT_ANSWER)
+        continue;
+      string typed(c.solution), upper = legacyLower(typed), spaced = "  ";
+      for (char &ch : upper)
+        ch = (char)toupper((unsigned char)ch);
+      for (char ch : typed) {
+        spaced += ch;
+        if (ch == ' ')
+          spaced += " ";
+      }
+      spaced += ".";
+      string typo = typed, wrong(typed.rbegin(), typed.rend());
+      typo[typo.size() / 2] = typo[typo.size() / 2] == 'x' ? 'y' : 'x';
+      string variants[VARIANTS] = {typed, upper, spaced, typo, wrong};
+      for (const string &v : variants) {
+        inputs.push_back(v);
+        owner.push_back((int)clues.size());
+      }
+      clues.push_back(c);
+    }
+    long long n = (long long)inputs.size();
+    string label = set ? "final gate" : to_string(clues.size()) + " TEXT";
+
+    for (int m = 0; m < 3; m++) {
+      FUZZY_ANSWERS = (m == 2);
+      long long accepted = 0, allocs0 = HEAP_ALLOCS;
+      BenchClock::time_point t0 = BenchClock::now();
+      for (long long k = 0, i = 0; k < checks;
+           k++, i = i + 1 == n ? 0 : i + 1) {
+        bool ok;
+        if (m == 0) {
+          string ans = legacyLower(inputs[i]);
+          ok = (ans == legacyLower(string(clues[owner[i]].solution)));
+        } else {
+          int score = 0;
+          Clue c = clues[owner[i]];
+          ok = applyAttempt(c, inputs[i], 0, score) == ATTEMPT_CORRECT;
+        }
+        accepted += ok;
+      }
+      double ns = nsSince(t0) / checks;
+      double allocs = (double)(HEAP_ALLOCS - allocs0) / checks;
+      cout << left << setw(14) << label << setw(12) << matchers[m] << right
+           << setw(10) << 1e3 / ns << setw(11) << ns << setw(15)
+           << setprecision(2) << allocs << setw(10) << setprecision(1)
+           << 100.0 * accepted / checks << "%\n";
+      BENCH_SINK = accepted;
+    }
+  }
+  FUZZY_ANSWERS = false;
+  return 0;
+}
+
+/* --bench-server [--sessions N] [--moves M] [--timed] [--record DIR]
+   forks a server, opens N players at once over a Unix socket,
+   then every player answers its prompts (door 1/2, answer "A")
+   and quits after M door choices: server RSS per live session,
+   round trips/sec and per-line latency */
+int runServerBenchmark(int argc, char **argv) {
+#ifdef __linux__
+  int sessions = (int)argLong(argc, argv, "--sessions", 2000);
+  int moves = (int)argLong(argc, argv, "--moves", 20);
+  bool timed = argFlag(argc, argv, "--timed");
+  string path = "/tmp/escape-room-bench-" + to_string(getpid()) + ".sock";
+
+  rlimit lim;
+  if (getrlimit(RLIMIT_NOFILE, &lim) == 0 && lim.rlim_cur < lim.rlim_max) {
+    lim.rlim_cur = lim.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &lim);
+  }
+  initClueBank();
+
+  ServerConfig cfg;
+  cfg.socketPath = path.c_str();
+  cfg.port = 0;
+  cfg.seed = 1;
+  cfg.templates = 16;
+  cfg.maxGames = sessions;
+  cfg.timed = timed;
+  cfg.recordDir = argValue(argc, argv, "--record");
+  cfg.metricsPath = nullptr;
+  cfg.leaderboardPath = nullptr;
+  cfg.checkpointPath = nullptr;
+  cfg.checkpointMs = 1000;
+  cfg.journalPath = nullptr;
+  if (!checkRecordDir(cfg))
+    return 1;
+
+  pid_t child = fork();
+  if (child == 0)
+    _exit(serveGames(cfg));
+  string statm = "/proc/" + to_string(child) + "/statm";
+  auto childKiB = [&statm]() {
+    FILE *f = fopen(statm.c_str(), "r");
+    long pages = 0, resident = 0;
+    if (f) {
+      if (fscanf(f, "%ld %ld", &pages, &resident) != 2)
+        resident = 0;
+      fclose(f);
+    }
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+  };
+
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path.c_str());
+
+  struct Player {
+    int fd;
+    int moves;
+    string in;
+    BenchClock::time_point sentAt;
+  };
+  vector<Player> players(sessions);
+  vector<double> latencyNs;
+  latencyNs.reserve((size_t)sessions * moves * 4);
+
+  long rss0 = 0;
+  BenchClock::time_point t0 = BenchClock::now();
+  for (int i = 0; i < sessions; i++) {
+    Player &p = players[i];
+    p.moves = 0;
+    p.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    while (connect(p.fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+      if (i != 0 || nsSince(t0) > 5e9) {
+        cerr << "cannot connect to the server: " << strerror(errno) << "\n";
+        kill(child, SIGTERM);
+        return 1;
+      }
+      this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    if (i == 0)
+      rss0 = childKiB();
+    setNonBlocking(p.fd);
+    p.sentAt = BenchClock::now();
+  }
+
+  int ep = epoll_create1(0);
+  for (int i = 0; i < sessions; i++) {
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u32 = (uint32_t)i;
+    epoll_ctl(ep, EPOLL_CTL_ADD, players[i].fd, &ev);
+  }
+
+  auto endsWith = [](const string &s, const char *tail) {
+    size_t n = strlen(tail);
+    return s.size() >= n && s.compare(s.size() - n, n, tail) == 0;
+  };
+
+  // every player sees its entrance menu: all sessions are live
+  int open = sessions, menus = 0;
+  long rss1 = 0;
+  double openMs = 0;
+  long long lines = 0;
+  epoll_event events[256];
+  char buf[8192];
+  BenchClock::time_point tPlay = BenchClock::now();
+  while (open > 0) {
+    int n = epoll_wait(ep, events, 256, 10000);
+    if (n <= 0) {
+      cerr << "server stopped answering\n";
+      break;
+    }
+    for (int e = 0; e < n; e++) {
+      Player &p = players[events[e].data.u32];
+      ssize_t got;
+      bool closed = false;
+      while ((got = recv(p.fd, buf, sizeof(buf), 0)) > 0)
+        p.in.append(buf, (size_t)got);
+      if (got == 0)
+        closed = true;
+      if (closed) {
+        epoll_ctl(ep, EPOLL_CTL_DEL, p.fd, nullptr);
+        close(p.fd);
+        open--;
+        continue;
+      }
+
+      const char *reply = nullptr;
+      if (endsWith(p.in, "): ")) {
+        reply = "1\n";
+        if (++menus == sessions) {
+          openMs = nsSince(t0) / 1e6;
+          rss1 = childKiB();
+          tPlay = BenchClock::now();
+        }
+      } else if (endsWith(p.in, "Enter choice: ")) {
+        reply = p.moves++ >= moves ? "9\n" : (p.moves % 2 ? "1\n" : "2\n");
+      } else if (endsWith(p.in, "for hint: ")) {
+        reply = "A\n";
+      }
+      if (!reply)
+        continue; // prompt not complete yet
+      BenchClock::time_point now = BenchClock::now();
+      if (menus == sessions)
+        latencyNs.push_back((double)chrono::duration_cast<chrono::nanoseconds>(
+                                now - p.sentAt)
+                                .count());
+      p.in.clear();
+      p.sentAt = now;
+      if (send(p.fd, reply, strlen(reply), MSG_NOSIGNAL) > 0)
+        lines++;
+    }
+  }
+  double playSecs = nsSince(tPlay) / 1e9;
+  close(ep);
+  int status = 0;
+  waitpid(child, &status, 0);
+
+  sort(latencyNs.begin(), latencyNs.end());
+  auto pct = [&latencyNs](double q) {
+    return latencyNs.empty()
+               ? 0.0
+               : latencyNs[(size_t)(q * (latencyNs.size() - 1))] / 1e3;
+  };
+  cout << fixed << setprecision(2);
+  cout << "==== Server benchmark (" << sessions << " concurrent sessions, "
+       << moves << " door choices each) ====\n";
+  cout << "All sessions live after " << openMs << " ms\n";
+  cout << "Server RSS:     " << rss0 / 1024.0 << " MiB idle, " << rss1 / 1024.0
+       << " MiB with all sessions (" << (rss1 - rss0) / (double)sessions
+       << " KiB/session)\n";
+  cout << "Lines:          " << lines << " in " << playSecs << " s ("
+       << lines / playSecs << " lines/sec, server on one core)\n";
+  cout << "Latency us:     p50 " << pct(0.50) << ", p90 " << pct(0.90)
+       << ", p99 " << pct(0.99) << ", max " << pct(1.0) << "\n";
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : 1;
+#else
+  (void)argc;
+  (void)argv;
+  cerr << "--bench-server needs Linux (epoll)\n";
+  return 1;
+#endif
+}
+
+/* --bench-render [--turns N] [--out FILE]
+   one input line per turn from a scripted player (door 1/2,
+   answer "A", quit after 20 doors and start again), rendered
+   three ways into FILE (default /dev/null): the old terminal
+   output (a write per line, the prompt when cin flushes cout),
+   the old server path (ostringstream, then a copy into the send
+   buffer) and a TurnFrame. Write syscalls per turn come from
+   /proc/self/io */
+#ifndef _WIN32
+// Old terminal output: each line written as it ends, the rest
+// when the next read flushes (sync)
+struct LineFlushBuf : streambuf {
+  int fd;
+  string line;
+  long long written = 0;
+
+protected:
+  int_type overflow(int_type c) override {
+    if (c != traits_type::eof()) {
+      line.push_back((char)c);
+      if (c == '\n')
+        sync();
+    }
+    return traits_type::not_eof(c);
+  }
+  streamsize xsputn(const char *s, streamsize n) override {
+    for (streamsize i = 0; i < n; i++)
+      overflow((unsigned char)s[i]);
+    return n;
+  }
+  int sync() override {
+    bool ok = writeAll(fd, line.data(), line.size());
+    written += (long long)line.size();
+    line.clear();
+    return ok ? 0 : -1;
+  }
+};
+
+// write syscalls made by this process so far (-1 without /proc)
+static long long writeSyscalls() {
+  FILE *f = fopen("/proc/self/io", "r");
+  if (!f)
+    return -1;
+  char key[32];
+  long long v, syscw = -1;
+  while (fscanf(f, "%31s %lld", key, &v) == 2)
+    if (strcmp(key, "syscw:") == 0)
+      syscw = v;
+  fclose(f);
+  return syscw;
+}
+#endif
+
+int runRenderBenchmark(int argc, char **argv) {
+#ifndef _WIN32
+  long long turns = argLong(argc, argv, "--turns", 200000);
+  const char *path = argValue(argc, argv, "--out");
+  if (!path)
+    path = "/dev/null";
+  if (turns < 1) {
+    cerr << "--turns must be positive\n";
+    return 1;
+  }
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    cerr << "cannot open " << path << ": " << strerror(errno) << "\n";
+    return 1;
+  }
+  initClueBank();
+  GameRng rng;
+  seedRng(rng, 1);
+  CompactMap tpl;
+  buildMapTemplate(rng, builtinMapGraph(), tpl);
+
+  static const char *sinks[] = {"line writes", "ostringstream", "frame"};
+  cout << fixed << setprecision(2);
+  cout << "==== Render benchmark (" << turns << " turns into " << path
+       << ") ====\n";
+  cout << "output          writes/turn   bytes/turn   ns/turn   p50 ns"
+          "   p99 ns   allocs/turn\n";
+
+  vector<double> latencyNs((size_t)turns);
+  for (int m = 0; m < 3; m++) {
+    LineFlushBuf lines;
+    lines.fd = fd;
+    ostream lineOut(&lines);
+    ostringstream legacy;
+    string sendBuf; // the server's per-connection out
+    TurnFrame frame;
+    ostream &out = m == 0 ? lineOut : m == 1 ? (ostream &)legacy : frame.out;
+
+    GameSession s;
+    int doors = 0;
+    long long bytes = 0, calls0 = writeSyscalls();
+    long long allocs0 = HEAP_ALLOCS;
+    BenchClock::time_point t0 = BenchClock::now();
+    for (long long k = 0; k < turns; k++) {
+      BenchClock::time_point tt = BenchClock::now();
+      if (k == 0 || s.state == SESSION_OVER) {
+        if (k != 0)
+          endSession(s);
+        startSession(s, tpl, 1, out);
+        doors = 0;
+      } else if (s.state == SESSION_ENTRANCE) {
+        feedSession(s, "1", out);
+      } else if (s.state == SESSION_DOOR) {
+        feedSession(s, doors++ >= 20 ? "9" : doors % 2 ? "1" : "2", out);
+      } else {
+        feedSession(s, "A", out);
+      }
+      if (m == 0) {
+        out.flush(); // cin tied to cout: flushed before each read
+      } else if (m == 1) {
+        sendBuf += legacy.str();
+        legacy.str("");
+        bytes += (long long)sendBuf.size();
+        writeAll(fd, sendBuf.data(), sendBuf.size());
+        sendBuf.clear();
+      } else {
+        bytes += (long long)frame.buf.text.size();
+        emitFrame(frame, fd);
+      }
+      latencyNs[(size_t)k] = nsSince(tt);
+    }
+    double ns = nsSince(t0) / turns;
+    double allocs = (double)(HEAP_ALLOCS - allocs0) / turns;
+    long long calls1 = writeSyscalls();
+    endSession(s);
+    if (m == 0)
+      bytes = lines.written;
+
+    sort(latencyNs.begin(), latencyNs.end());
+    cout << left << setw(16) << sinks[m] << right << setw(11);
+    if (calls0 < 0 || calls1 < 0)
+      cout << "n/a";
+    else
+      cout << (double)(calls1 - calls0) / turns;
+    cout << setw(13) << (double)bytes / turns << setw(10) << ns << setw(9)
+         << latencyNs[(size_t)(0.50 * (turns - 1))] << setw(9)
+         << latencyNs[(size_t)(0.99 * (turns - 1))] << setw(14) << allocs
+         << "\n";
+  }
+  close(fd);
+  return 0;
+#else
+  (void)argc;
+  (void)argv;
+  cerr << "--bench-render needs POSIX write()\n";
+  return 1;
+#endif
+}
+
+/* --bench-sessions [--sessions N] [--full N]
+   memory per live session: a shared map template + overlay,
+   against a full GameMap per session (rooms with copied clues) */
+int runSessionMemoryBenchmark(int argc, char **argv) {
+  long long sessions = argLong(argc, argv, "--sessions", 1000000);
+  long long full = argLong(argc, argv, "--full", 100000);
+  initClueBank();
+  GameRng rng;
+  seedRng(rng, 1);
+  ostream nowhere(nullptr); // prompts are rendered and dropped
+
+  CompactMap tpl;
+  buildMapTemplate(rng, builtinMapGraph(), tpl);
+
+  cout << fixed << setprecision(1);
+  cout << "==== Session memory benchmark ====\n";
+  cout << "model               sessions   bytes/session   sessions/GB"
+          "   ns/start\n";
+
+  // template + overlay: start, pick an entrance, open a door
+  vector<GameSession> overlay((size_t)sessions);
+  long rss0 = residentKiB();
+  BenchClock::time_point t0 = BenchClock::now();
+  for (long long i = 0; i < sessions; i++) {
+    startSession(overlay[i], tpl, 1, nowhere);
+    feedSession(overlay[i], "1", nowhere);
+  }
+  double ns = nsSince(t0) / sessions;
+  long rss1 = residentKiB();
+  double bytes = (rss1 - rss0) * 1024.0 / sessions + sizeof(GameSession);
+  cout << "template+overlay" << setw(13) << sessions << setw(16) << bytes
+       << setw(14) << 1073741824.0 / bytes << setw(11) << ns << "\n";
+  for (long long i = 0; i < sessions; i++)
+    endSession(overlay[i]);
+  vector<GameSession>().swap(overlay);
+
+  // one GameMap + history stack per session (before templates)
+  struct FullSession {
+    GameMap gm;
+    PathNode *history;
+  };
+  vector<FullSession> maps((size_t)full);
+  rss0 = residentKiB();
+  t0 = BenchClock::now();
+  for (long long i = 0; i < full; i++) {
+    resetUsedClues();
+    maps[i].gm = buildMap(rng);
+    maps[i].history = nullptr;
+    pushPath(maps[i].history, maps[i].gm.entrances[0]);
+  }
+  ns = nsSince(t0) / full;
+  rss1 = residentKiB();
+  bytes = (rss1 - rss0) * 1024.0 / full + sizeof(FullSession);
+  cout << "GameMap per session" << setw(10) << full << setw(16) << bytes
+       << setw(14) << 1073741824.0 / bytes << setw(11) << ns << "\n";
+  for (long long i = 0; i < full; i++) {
+    freeMap(maps[i].gm);
+    freePath(maps[i].history);
+  }
+
+  cout << "shared template: " << tpl.rooms.size() << " rooms, "
+       << tpl.rooms.size() * (sizeof(CompactRoom) + sizeof(int)) << " bytes\n";
+  return 0;
+}
+
+// A random but legal line for the session's prompt (benchmarks)
+static string randomSessionLine(const GameSession &s, GameRng &rng) {
+  switch (s.state) {
+  case SESSION_ENTRANCE:
+    return to_string(1 + rngBelow(rng, (uint32_t)s.tpl->entrances.size()));
+  case SESSION_DOOR:
+    return rngBelow(rng, 8) == 0 ? "0" : to_string(1 + rngBelow(rng, 2));
+  case SESSION_ANSWER: {
+    uint32_t r = rngBelow(rng, 4);
+    if (r == 0)
+      return "H";
+    Clue clue;
+    loadSessionClue(s, sessionRoom(s), s.doorIndex, clue);
+    if (r == 1)
+      return clue.type == MCQ ? (clue.correctOption == 'A' ? "B" : "A") : "?";
+    if (clue.type == MCQ)
+      return string(1, clue.correctOption);
+    return string(clue.solution.substr(0, clue.solution.find('|')));
+  }
+  case SESSION_OVER:
+    break;
+  }
+  return "";
+}
+
+/* --bench-snapshots [--sessions N] [--turns T] [--templates K] [--dir D]
+   N live sessions on K templates, T random turns each, saved as
+   one checkpoint batch (one write, one sync) and as a sync per
+   session (the first 1000, scaled up), then restored from the
+   file and compared with the originals */
+int runSnapshotBenchmark(int argc, char **argv) {
+#ifndef _WIN32
+  long long n = argLong(argc, argv, "--sessions", 100000);
+  int turns = (int)argLong(argc, argv, "--turns", 12);
+  int k = (int)argLong(argc, argv, "--templates", 16);
+  const char *dirArg = argValue(argc, argv, "--dir");
+  string dir = dirArg ? dirArg : "/tmp";
+  if (n < 1 || k < 1) {
+    cerr << "--sessions and --templates must be positive\n";
+    return 1;
+  }
+  initClueBank();
+  ostream nowhere(nullptr); // prompts are rendered and dropped
+  GameRng rng;
+  seedRng(rng, 1);
+  map<unsigned long long, CompactMap> templates;
+  vector<uint64_t> hashes(k);
+  for (int t = 0; t < k; t++)
+    hashes[t] = templateHash(templateForSeed(templates, t));
+  vector<GameSession> live((size_t)n);
+  for (long long i = 0; i < n; i++) {
+    GameSession &s = live[i];
+    startSession(s, templates[i % k], i % k, nowhere);
+    for (int t = 0; t < turns; t++) {
+      if (!feedSession(s, randomSessionLine(s, rng), nowhere)) {
+        endSession(s);
+        startSession(s, templates[i % k], i % k, nowhere);
+      }
+    }
+  }
+
+  cout << fixed << setprecision(1);
+  cout << "==== Snapshot benchmark (" << n << " sessions, " << turns
+       << " turns each) ====\n";
+  string path = dir + "/escape-bench.ckpt", err;
+  remove(path.c_str());
+  CheckpointWriter w;
+  BenchClock::time_point t0 = BenchClock::now();
+  if (!openCheckpoint(w, path.c_str(), err)) {
+    cerr << err << "\n";
+    return 1;
+  }
+  for (long long i = 0; i < n; i++)
+    appendSnapshot(w.batch, (uint64_t)i, i % k, hashes[i % k], live[i]);
+  double encodeNs = nsSince(t0);
+  size_t bytes = w.batch.size();
+  t0 = BenchClock::now();
+  bool ok = commitCheckpoint(w, err);
+  double commitNs = nsSince(t0);
+  close(w.fd);
+  if (!ok) {
+    cerr << err << "\n";
+    return 1;
+  }
+  cout << "Snapshot:       " << (double)bytes / n << " bytes/session, "
+       << encodeNs / n << " ns/session to encode\n";
+  cout << "Batched sync:   " << (encodeNs + commitNs) / 1e6 << " ms for all ("
+       << commitNs / 1e6 << " ms write + sync, "
+       << bytes / 1048576.0 / ((encodeNs + commitNs) / 1e9) << " MiB/s)\n";
+
+  string single = dir + "/escape-bench-single.ckpt";
+  remove(single.c_str());
+  long long m = min(n, 1000LL);
+  CheckpointWriter one;
+  ok = openCheckpoint(one, single.c_str(), err);
+  t0 = BenchClock::now();
+  for (long long i = 0; ok && i < m; i++) {
+    appendSnapshot(one.batch, (uint64_t)i, i % k, hashes[i % k], live[i]);
+    ok = commitCheckpoint(one, err);
+  }
+  double singleNs = nsSince(t0);
+  if (one.fd >= 0)
+    close(one.fd);
+  remove(single.c_str());
+  if (!ok) {
+    cerr << err << "\n";
+    return 1;
+  }
+  cout << "Sync/session:   " << singleNs / m / 1e3 << " us/session, about "
+       << singleNs / m * n / 1e6 << " ms for all\n";
+
+  // a restart: the file is all there is (templates rebuilt first)
+  map<unsigned long long, CompactMap> restoredTemplates;
+  map<unsigned long long, uint64_t> tplHashes;
+  t0 = BenchClock::now();
+  for (int t = 0; t < k; t++)
+    tplHashes[t] = templateHash(templateForSeed(restoredTemplates, t));
+  double templatesNs = nsSince(t0);
+  vector<GameSession> restored((size_t)n);
+  t0 = BenchClock::now();
+  MappedFile mf;
+  unordered_map<uint64_t, size_t> offsets;
+  size_t torn = 0;
+  ok = mapFile(path.c_str(), mf, err);
+  string_view data = ok ? string_view(mf.data, mf.size) : string_view();
+  ok = ok && readCheckpoint(data, offsets, torn, err);
+  for (const pair<const uint64_t, size_t> &e : offsets) {
+    SnapshotRecord r;
+    if (!ok || e.first >= (uint64_t)n)
+      break;
+    ok = restoreSnapshot(data, e.second, restoredTemplates, tplHashes,
+                         restored[e.first], r, err);
+  }
+  double restoreNs = nsSince(t0);
+  if (!ok) {
+    cerr << err << "\n";
+    return 1;
+  }
+  long long same = 0;
+  for (long long i = 0; i < n; i++) {
+    const GameSession &a = live[i], &b = restored[i];
+    same += b.rooms && a.state == b.state && a.score == b.score &&
+            a.doorIndex == b.doorIndex && a.clueStart == b.clueStart &&
+            a.pathLen == b.pathLen &&
+            memcmp(a.path, b.path, a.pathLen * sizeof(int32_t)) == 0 &&
+            memcmp(a.rooms, b.rooms, a.tpl->rooms.size()) == 0 &&
+            a.tpl->rooms.size() == b.tpl->rooms.size();
+  }
+  cout << "Restore:        " << restoreNs / 1e6 << " ms ("
+       << restoreNs / n << " ns/session, file cached; templates "
+       << templatesNs / 1e6 << " ms more)\n";
+  cout << "Verified:       " << same << " of " << n
+       << " sessions identical\n";
+
+  // a crash in the middle of the next batch
+  string tail;
+  appendSnapshot(tail, 0, 0, hashes[0], live[0]);
+  FILE *f = fopen(path.c_str(), "ab");
+  ok = f && fwrite(tail.data(), 1, tail.size() / 2, f) == tail.size() / 2;
+  if (f)
+    ok = fclose(f) == 0 && ok;
+  unmapFile(mf);
+  ok = ok && mapFile(path.c_str(), mf, err);
+  if (ok) {
+    ok = readCheckpoint(string_view(mf.data, mf.size), offsets, torn, err) &&
+         (long long)offsets.size() == n && torn == tail.size() / 2;
+    unmapFile(mf);
+  }
+  cout << "Torn batch:     " << (ok ? "skipped" : "NOT SKIPPED") << "\n";
+  remove(path.c_str());
+  for (long long i = 0; i < n; i++) {
+    endSession(live[i]);
+    endSession(restored[i]);
+  }
+  return ok && same == n ? 0 : 1;
+#else
+  (void)argc;
+  (void)argv;
+  cerr << "--bench-snapshots needs POSIX file I/O\n";
+  return 1;
+#endif
+}
+
+/* --bench-journal [--sessions N] [--threads T] [--turns M] [--out FILE]
+   N sessions split over T threads, each thread playing a round of
+   random turns over its sessions per block as the server does,
+   M rounds; once without and once with the journal (group-committed
+   to FILE, a temporary file unless given), then the journal is
+   replayed and every session compared with its rebuilt state */
+#ifndef _WIN32
+static void journalBenchWorker(vector<GameSession> *sessions, int t,
+                               int threads, int turns,
+                               const map<unsigned long long, CompactMap> *tpl,
+                               JournalWriter *w) {
+  GameRng rng;
+  seedRngStream(rng, 1, (unsigned long long)t);
+  ostream nowhere(nullptr);
+  JournalBuffer buf;
+  buf.events = 0;
+  buf.run = (uint64_t)t + 1;
+  buf.now = buf.base = 1000000000; // any fixed second: both runs alike
+  JOURNAL = w ? &buf : nullptr;
+  size_t k = tpl->size();
+  for (size_t i = (size_t)t, n = 0; i < sessions->size(); i += threads, n++) {
+    JOURNAL_SESSION = n;
+    startSession((*sessions)[i], tpl->at(i % k), i % k, nowhere);
+  }
+  uint64_t ticket = 0;
+  for (int round = 0; round < turns; round++) {
+    for (size_t i = (size_t)t, n = 0; i < sessions->size();
+         i += threads, n++) {
+      GameSession &s = (*sessions)[i];
+      if (s.state == SESSION_OVER)
+        continue;
+      JOURNAL_SESSION = n;
+      feedSession(s, randomSessionLine(s, rng), nowhere);
+    }
+    buf.now++;
+    if (w)
+      ticket = submitJournal(*w, buf);
+  }
+  if (w)
+    waitJournal(*w, ticket);
+  JOURNAL = nullptr;
+}
+#endif
+
+int runJournalBenchmark(int argc, char **argv) {
+#ifndef _WIN32
+  long long n = argLong(argc, argv, "--sessions", 100000);
+  int threads = (int)argLong(argc, argv, "--threads",
+                             max(1, (int)thread::hardware_concurrency()));
+  int turns = (int)argLong(argc, argv, "--turns", 40);
+  const char *out = argValue(argc, argv, "--out");
+  string path = out ? out : "/tmp/escape-bench.journal";
+  if (n < 1 || threads < 1 || turns < 1) {
+    cerr << "--sessions, --threads and --turns must be positive\n";
+    return 1;
+  }
+  initClueBank();
+  map<unsigned long long, CompactMap> templates;
+  for (int t = 0; t < 16; t++)
+    templateForSeed(templates, t);
+
+  // the same games twice: without the journal, then with it
+  double playNs[2];
+  vector<GameSession> sessions((size_t)n);
+  JournalWriter *w = nullptr;
+  string err;
+  for (int journaled = 0; journaled < 2; journaled++) {
+    if (journaled) {
+      for (GameSession &s : sessions)
+        endSession(s);
+      remove(path.c_str());
+      w = new JournalWriter;
+      if (!openJournal(*w, path.c_str(), err)) {
+        cerr << err << "\n";
+        return 1;
+      }
+    }
+    vector<thread> pool;
+    BenchClock::time_point t0 = BenchClock::now();
+    for (int t = 0; t < threads; t++)
+      pool.push_back(thread(journalBenchWorker, &sessions, t, threads, turns,
+                            &templates, w));
+    for (thread &th : pool)
+      th.join();
+    playNs[journaled] = nsSince(t0);
+  }
+  uint64_t syncs = w->syncs, blocks = w->submitted;
+  if (!closeJournal(*w, err)) {
+    cerr << err << "\n";
+    return 1;
+  }
+  delete w;
+
+  MappedFile mf;
+  if (!mapFile(path.c_str(), mf, err)) {
+    cerr << err << "\n";
+    return 1;
+  }
+  JournalReplay r;
+  initJournalReplay(r);
+  size_t torn = 0;
+  BenchClock::time_point t0 = BenchClock::now();
+  bool ok = scanJournal(
+      string_view(mf.data, mf.size),
+      [&r](const JournalRecord &e) { applyJournalEvent(r, e); }, torn, err);
+  double replayNs = nsSince(t0);
+  size_t bytes = mf.size;
+  unmapFile(mf);
+  if (!ok) {
+    cerr << err << "\n";
+    return 1;
+  }
+  long long events = 0;
+  for (int k = 0; k < JE_KINDS; k++)
+    events += r.events[k];
+
+  long long same = 0;
+  for (long long i = 0; i < n; i++) {
+    const GameSession &s = sessions[i];
+    vector<JournalGame> &games = r.runs[(uint64_t)(i % threads) + 1];
+    size_t number = (size_t)(i / threads);
+    if (number >= games.size())
+      continue;
+    const JournalGame &g = games[number];
+    int room = s.pathLen ? s.tpl->roomIDs[sessionRoom(s)] : -1;
+    same += g.score == s.score && g.room == room && g.depth == s.pathLen &&
+            (g.over != 0) == (s.state == SESSION_OVER);
+  }
+  for (GameSession &s : sessions)
+    endSession(s);
+  if (!out)
+    remove(path.c_str());
+
+  cout << fixed << setprecision(1);
+  cout << "==== Journal benchmark (" << n << " sessions, " << threads
+       << " threads, " << turns << " rounds) ====\n";
+  cout << "Play:     " << playNs[0] / 1e6 << " ms without the journal, "
+       << playNs[1] / 1e6 << " ms with it ("
+       << (playNs[1] - playNs[0]) / max(events, 1LL) << " ns/event)\n";
+  cout << "Journal:  " << events << " events, " << (double)bytes / events
+       << " bytes/event; " << blocks << " blocks in " << syncs
+       << " write + sync rounds\n";
+  cout << "Replay:   " << events / (replayNs / 1e9) / 1e6 << " M events/sec, "
+       << bytes / 1048576.0 / (replayNs / 1e9) << " MiB/s\n";
+  cout << "Verified: " << same << " of " << n
+       << " sessions rebuilt exactly\n";
+  return same == n ? 0 : 1;
+#else
+  (void)argc;
+  (void)argv;
+  cerr << "--bench-journal needs POSIX file I/O\n";
+  return 1;
+#endif
+}
+
+// --bench-timers [--timers N] [--span MS]: N clue time limits
+// outstanding at once; arm, re-arm on an answer, cancel, then
+// fire the rest. Timer wheel vs an ordered multimap.
+int runTimerBenchmark(int argc, char **argv) {
+  long long n = argLong(argc, argv, "--timers", 1000000);
+  long long span = argLong(argc, argv, "--span", 20000); // ms ahead
+  if (n < 1 || span < 1) {
+    cerr << "--timers and --span must be positive\n";
+    return 1;
+  }
+  GameRng rng;
+  seedRng(rng, 1);
+  vector<long long> first(n), second(n);
+  for (long long i = 0; i < n; i++) {
+    first[i] = 1 + (long long)rngBelow(rng, (uint32_t)span);
+    second[i] = 1 + (long long)rngBelow(rng, (uint32_t)span);
+  }
+
+  cout << fixed << setprecision(1);
+  cout << "==== Timer benchmark (" << n << " outstanding, " << span
+       << " ms ahead) ====\n";
+  cout << "model      ns/arm  ns/re-arm  ns/cancel  ns/fire   late  "
+          "bytes/timer\n";
+
+  // timers fire as clue timeouts: one attempt gone
+  struct WheelClue {
+    WheelTimer timer;
+    int attempts;
+  };
+  {
+    long rss0 = residentKiB();
+    vector<WheelClue> clues((size_t)n);
+    TimerWheel *w = new TimerWheel;
+    initTimerWheel(*w, 0);
+    BenchClock::time_point t0 = BenchClock::now();
+    for (long long i = 0; i < n; i++) {
+      clues[i].attempts = DEFAULT_ATTEMPTS;
+      initWheelTimer(clues[i].timer, &clues[i]);
+      armTimer(*w, clues[i].timer, first[i]);
+    }
+    double armNs = nsSince(t0) / n;
+    long rss1 = residentKiB();
+
+    t0 = BenchClock::now(); // every player answers (hint): limit restarts
+    for (long long i = 0; i < n; i++)
+      armTimer(*w, clues[i].timer, second[i]);
+    double rearmNs = nsSince(t0) / n;
+
+    t0 = BenchClock::now(); // every other puzzle solved
+    for (long long i = 0; i < n; i += 2)
+      cancelTimer(*w, clues[i].timer);
+    double cancelNs = nsSince(t0) / ((n + 1) / 2);
+
+    long long late = 0;
+    t0 = BenchClock::now();
+    int fired = 0;
+    for (long long tick = 1; tick <= span; tick++)
+      fired += advanceWheel(*w, tick, [&late, tick](WheelTimer &t) {
+        WheelClue &c = *(WheelClue *)t.data;
+        c.attempts--;
+        late += t.expires != tick;
+      });
+    double fireNs = nsSince(t0) / max(fired, 1);
+    for (long long i = 0; i < n; i++)
+      late += clues[i].attempts != DEFAULT_ATTEMPTS - (int)(i & 1);
+    double bytes = max((rss1 - rss0) * 1024.0 / n, (double)sizeof(WheelClue));
+    cout << "wheel" << setw(13) << armNs << setw(11) << rearmNs << setw(11)
+         << cancelNs << setw(9) << fireNs << setw(7) << late << setw(13)
+         << bytes << "\n";
+    delete w;
+  }
+
+  // the scheduler's old timers: deadline-ordered multimap
+  struct MapClue {
+    multimap<long long, MapClue *>::iterator it;
+    int attempts;
+  };
+  {
+    long rss0 = residentKiB();
+    vector<MapClue> clues((size_t)n);
+    multimap<long long, MapClue *> timers;
+    BenchClock::time_point t0 = BenchClock::now();
+    for (long long i = 0; i < n; i++) {
+      clues[i].attempts = DEFAULT_ATTEMPTS;
+      clues[i].it = timers.emplace(first[i], &clues[i]);
+    }
+    double armNs = nsSince(t0) / n;
+    long rss1 = residentKiB();
+
+    t0 = BenchClock::now();
+    for (long long i = 0; i < n; i++) {
+      timers.erase(clues[i].it);
+      clues[i].it = timers.emplace(second[i], &clues[i]);
+    }
+    double rearmNs = nsSince(t0) / n;
+
+    t0 = BenchClock::now();
+    for (long long i = 0; i < n; i += 2)
+      timers.erase(clues[i].it);
+    double cancelNs = nsSince(t0) / ((n + 1) / 2);
+
+    long long late = 0;
+    t0 = BenchClock::now();
+    int fired = 0;
+    for (long long tick = 1; tick <= span; tick++) {
+      while (!timers.empty() && timers.begin()->first <= tick) {
+        MapClue &c = *timers.begin()->second;
+        late += timers.begin()->first != tick;
+        timers.erase(timers.begin());
+        c.attempts--;
+        fired++;
+      }
+    }
+    double fireNs = nsSince(t0) / max(fired, 1);
+    for (long long i = 0; i < n; i++)
+      late += clues[i].attempts != DEFAULT_ATTEMPTS - (int)(i & 1);
+    double bytes = max((rss1 - rss0) * 1024.0 / n, (double)sizeof(MapClue));
+    cout << "multimap" << setw(10) << armNs << setw(11) << rearmNs
+         << setw(11) << cancelNs << setw(9) << fireNs << setw(7) << late
+         << setw(13) << bytes << "\n";
+  }
+  cout << "(late: timers that fired off their tick or clues with the "
+          "wrong attempts; should be 0)\n";
+  return 0;
+}
+
+/* =========================
+SESSION REPLAY
+========================= */
+// Replays log as a player: true if every state matches, else err
+// names the first line that does not. latencyNs gets the time each
+// event took in feedSession / expireSession
+bool replaySessionLog(string_view log,
+                      map<unsigned long long, CompactMap> &templates,
+                      vector<double> &latencyNs, long long &events,
+                      string &err) {
+  TurnFrame frame;
+  GameSession s;
+  s.rooms = nullptr;
+  string expect, input;
+  const CompactMap *tpl = nullptr;
+  unsigned long long seed = 0;
+  static const time_t REPLAY_EPOCH = 1000000000; // any second but 0
+  bool started = false, ok = true;
+  size_t pos = 0;
+  int lineNo = 0;
+
+  while (ok && pos < log.size()) {
+    size_t nl = log.find('\n', pos);
+    if (nl == string_view::npos)
+      nl = log.size();
+    string_view l = log.substr(pos, nl - pos);
+    pos = nl + 1;
+    lineNo++;
+    auto fail = [&](const string &why) {
+      err = "line " + to_string(lineNo) + ": " + why;
+      ok = false;
+    };
+
+    if (lineNo == 1) {
+      if (l != RECORDING_MAGIC)
+        fail("not a session recording");
+    } else if (l.substr(0, 5) == "seed ") {
+      seed = strtoull(string(l.substr(5)).c_str(), nullptr, 10);
+      tpl = &templateForSeed(templates, seed);
+    } else if (l.substr(0, 9) == "template ") {
+      if (!tpl) {
+        fail("template before seed");
+      } else if (strtoull(string(l.substr(9)).c_str(), nullptr, 16) !=
+                 templateHash(*tpl)) {
+        fail("map template differs (same --clues / --map / --maze?)");
+      } else {
+        startSession(s, *tpl, seed, frame.out);
+        started = true;
+      }
+    } else if (l.empty()) {
+      continue;
+    } else if (!started) {
+      fail("event before the template");
+    } else if (l[0] == '=') {
+      expect.clear();
+      appendSessionState(expect, s, frame.buf.text);
+      frame.buf.text.clear();
+      if (string_view(expect).substr(0, expect.size() - 1) != l)
+        fail("expected `" + string(l) + "`, replay gave `" +
+             expect.substr(0, expect.size() - 1) + "`");
+    } else if (l.size() >= 3 && (l[0] == '>' || l[0] == '!')) {
+      string_view rest = l.substr(2);
+      size_t sp = rest.find(' ');
+      CLUE_CLOCK = REPLAY_EPOCH + atoll(string(rest.substr(0, sp)).c_str());
+      if (sp == string_view::npos)
+        input.clear();
+      else
+        input.assign(rest.data() + sp + 1, rest.size() - sp - 1);
+      BenchClock::time_point t0 = BenchClock::now();
+      if (l[0] == '>')
+        feedSession(s, input, frame.out);
+      else
+        expireSession(s, frame.out);
+      latencyNs.push_back(nsSince(t0));
+      events++;
+    } else {
+      fail("unknown event");
+    }
+  }
+  CLUE_CLOCK = 0;
+  if (started)
+    endSession(s);
+  return ok;
+}
+
+/* --replay PATH... [--clues FILE] [--map FILE | --maze N ...]
+   PATH: a recording (see --record) or a directory of *.rec files.
+   Replays every one at full speed with the same --clues / --map
+   flags it was recorded with, lists those that diverged, and
+   reports events/sec and per-event latency */
+int runReplay(int argc, char **argv) {
+  int paths = 0;
+  while (paths < argc && strncmp(argv[paths], "--", 2) != 0)
+    paths++;
+  if (paths == 0) {
+    cerr << "--replay needs a recording or a directory of them\n";
+    return 1;
+  }
+  if (!setupClueBank(argc - paths, argv + paths) ||
+      !setupMap(argc - paths, argv + paths))
+    return 1;
+
+  vector<string> files;
+  for (int i = 0; i < paths; i++) {
+    error_code ec;
+    if (!filesystem::is_directory(argv[i], ec)) {
+      files.push_back(argv[i]);
+      continue;
+    }
+    size_t first = files.size();
+    for (const filesystem::directory_entry &e :
+         filesystem::directory_iterator(argv[i], ec))
+      if (e.path().extension() == ".rec")
+        files.push_back(e.path().string());
+    sort(files.begin() + (ptrdiff_t)first, files.end());
+  }
+
+  map<unsigned long long, CompactMap> templates;
+  vector<double> latencyNs;
+  long long events = 0, diverged = 0;
+  BenchClock::time_point t0 = BenchClock::now();
+  for (const string &path : files) {
+    MappedFile mf;
+    string err;
+    bool ok = mapFile(path.c_str(), mf, err);
+    if (ok) {
+      ok = replaySessionLog(string_view(mf.data, mf.size), templates,
+                            latencyNs, events, err);
+      unmapFile(mf);
+    }
+    if (!ok && ++diverged <= 10)
+      cerr << path << ": " << err << "\n";
+  }
+  double secs = nsSince(t0) / 1e9;
+
+  sort(latencyNs.begin(), latencyNs.end());
+  auto pct = [&latencyNs](double q) {
+    return latencyNs.empty() ? 0.0
+                             : latencyNs[(size_t)(q * (latencyNs.size() - 1))];
+  };
+  cout << fixed << setprecision(1);
+  cout << "==== Replay (" << files.size() << " recordings, " << events
+       << " events) ====\n";
+  cout << "Deterministic:  " << files.size() - diverged << " of "
+       << files.size() << " recordings (" << diverged << " diverged)\n";
+  cout << "Speed:          " << events / (secs > 0 ? secs : 1) / 1e6
+       << " M events/sec (" << secs * 1e3 << " ms, templates and "
+       << "file reads included)\n";
+  cout << "Event ns:       p50 " << pct(0.50) << ", p90 " << pct(0.90)
+       << ", p99 " << pct(0.99) << ", p99.9 " << pct(0.999) << ", max "
+       << pct(1.0) << "\n";
+  if (!saveMetrics(argc, argv))
+    return 1;
+  return diverged == 0 ? 0 : 1;
+}
+
+/* --replay-journal FILE...: rebuilds every session of the
+   journals (see --journal); games, how they ended, events by
+   kind and events/sec */
+int runReplayJournal(int argc, char **argv) {
+  int files = 0;
+  while (files < argc && strncmp(argv[files], "--", 2) != 0)
+    files++;
+  if (files == 0) {
+    cerr << "usage: --replay-journal FILE...\n";
+    return 1;
+  }
+  JournalReplay r;
+  initJournalReplay(r);
+  size_t bytes = 0;
+  BenchClock::time_point t0 = BenchClock::now();
+  for (int i = 0; i < files; i++) {
+    MappedFile mf;
+    string err;
+    size_t torn = 0;
+    bool ok = mapFile(argv[i], mf, err);
+    if (ok) {
+      bytes += mf.size;
+      ok = scanJournal(
+          string_view(mf.data, mf.size),
+          [&r](const JournalRecord &e) { applyJournalEvent(r, e); }, torn,
+          err);
+      unmapFile(mf);
+    }
+    if (!ok) {
+      cerr << argv[i] << ": " << err << "\n";
+      return 1;
+    }
+    if (torn)
+      cerr << argv[i] << ": " << torn << " bytes of an unfinished block\n";
+  }
+  double secs = nsSince(t0) / 1e9;
+
+  long long events = 0, ended[JE_KINDS] = {}, playing = 0, escapedScore = 0;
+  for (int k = 0; k < JE_KINDS; k++)
+    events += r.events[k];
+  for (const pair<const uint64_t, vector<JournalGame>> &run : r.runs)
+    for (const JournalGame &g : run.second) {
+      if (!g.over)
+        playing++;
+      else
+        ended[g.over]++;
+      if (g.over == JE_ESCAPE)
+        escapedScore += g.score;
+    }
+  long long games = r.events[JE_START] + r.events[JE_RESUME];
+  cout << fixed << setprecision(1);
+  cout << "==== Journal replay (" << files << " files, " << events
+       << " events) ====\n";
+  cout << "Games:    " << games << " in " << r.runs.size() << " runs: "
+       << ended[JE_ESCAPE] << " escaped (mean score "
+       << (ended[JE_ESCAPE] ? (double)escapedScore / ended[JE_ESCAPE] : 0.0)
+       << "), " << ended[JE_QUIT] << " quit, " << ended[JE_END]
+       << " left, " << playing << " still playing\n";
+  cout << "Events:  ";
+  for (int k = 0; k < JE_KINDS; k++)
+    cout << " " << JOURNAL_KIND_NAMES[k] << " " << r.events[k];
+  cout << "\n";
+  if (r.unknown)
+    cout << "Orphans:  " << r.unknown
+         << " events of sessions that start in no journal given\n";
+  cout << "Speed:    " << events / (secs > 0 ? secs : 1) / 1e6
+       << " M events/sec, " << bytes / 1048576.0 / (secs > 0 ? secs : 1)
+       << " MiB/s (" << secs * 1e3 << " ms)\n";
+  return 0;
+}
+
+/* =========================
+JOURNAL ANALYTICS
+--analyze: one streaming pass over journals (see --journal)
+with the replay rebuilding each session, so every hint,
+answer and lock is charged to the clue and door that were
+open. Counters are columns, one vector per measure indexed
+by clue or by room ID (* 2 + door for doors): an event adds
+to the few columns it touches, and the threads' tables (one
+per thread, files handed out in turn) merge as vector sums.
+========================= */
+struct ClueColumns { // by bank index
+  vector<uint64_t> opens, solves, misses, timeouts, hints, locks, seconds;
+};
+struct DoorColumns { // by room ID * 2 + door
+  vector<uint64_t> opens, passes, locks;
+};
+struct RoomColumns { // by room ID
+  vector<uint64_t> visits, undos, quits, left;
+};
+struct JournalStats {
+  ClueColumns clue;
+  DoorColumns door;
+  RoomColumns room;
+  long long events;
+  long long orphans; // events of sessions started in an earlier file
+};
+
+static inline void bump(vector<uint64_t> &col, int64_t i, uint64_t by = 1) {
+  if (i < 0)
+    return;
+  if ((size_t)i >= col.size())
+    col.resize(max((size_t)i + 1, col.size() * 2));
+  col[i] += by;
+}
+
+static void mergeColumn(vector<uint64_t> &into, const vector<uint64_t> &from) {
+  if (into.size() < from.size())
+    into.resize(from.size());
+  for (size_t i = 0; i < from.size(); i++)
+    into[i] += from[i];
+}
+
+void mergeJournalStats(JournalStats &into, const JournalStats &from) {
+  vector<uint64_t> ClueColumns::*clue[] = {
+      &ClueColumns::opens, &ClueColumns::solves, &ClueColumns::misses,
+      &ClueColumns::timeouts, &ClueColumns::hints, &ClueColumns::locks,
+      &ClueColumns::seconds};
+  for (auto col : clue)
+    mergeColumn(into.clue.*col, from.clue.*col);
+  mergeColumn(into.door.opens, from.door.opens);
+  mergeColumn(into.door.passes, from.door.passes);
+  mergeColumn(into.door.locks, from.door.locks);
+  mergeColumn(into.room.visits, from.room.visits);
+  mergeColumn(into.room.undos, from.room.undos);
+  mergeColumn(into.room.quits, from.room.quits);
+  mergeColumn(into.room.left, from.room.left);
+  into.events += from.events;
+  into.orphans += from.orphans;
+}
+
+static void analyzeEvent(JournalStats &st, JournalReplay &r,
+                         const JournalRecord &e) {
+  st.events++;
+  if (e.kind == JE_START || e.kind == JE_RESUME) {
+    applyJournalEvent(r, e);
+    return;
+  }
+  JournalGame *g = findJournalGame(r, e);
+  if (!g) {
+    st.orphans++;
+    return;
+  }
+  JournalGame was = *g; // room, door and clue before the event
+  applyJournalEvent(r, e);
+  int64_t door = was.room >= 0 ? was.room * 2LL + was.door : -1;
+  switch (e.kind) {
+  case JE_ENTRANCE:
+    bump(st.room.visits, (int64_t)e.args[0]);
+    break;
+  case JE_DOOR:
+    bump(st.clue.opens, (int64_t)e.args[1]);
+    bump(st.door.opens, was.room >= 0 ? was.room * 2LL + (int64_t)e.args[0]
+                                      : -1);
+    break;
+  case JE_HINT:
+    bump(st.clue.hints, was.clue);
+    break;
+  case JE_WRONG:
+    bump(st.clue.misses, was.clue);
+    break;
+  case JE_TIMEOUT:
+    bump(st.clue.timeouts, was.clue);
+    break;
+  case JE_SOLVED:
+    bump(st.clue.solves, was.clue);
+    bump(st.clue.seconds, was.clue, e.args[0]);
+    break;
+  case JE_LOCKED:
+    bump(st.clue.locks, was.clue);
+    bump(st.door.locks, door);
+    break;
+  case JE_MOVE:
+    bump(st.door.passes, door);
+    bump(st.room.visits, (int64_t)e.args[0]);
+    break;
+  case JE_UNDO:
+    bump(st.room.undos, was.room);
+    break;
+  case JE_ESCAPE: // through the final gate
+    bump(st.door.passes, door);
+    break;
+  case JE_QUIT:
+    bump(st.room.quits, was.room);
+    break;
+  case JE_END:
+    if (!was.over)
+      bump(st.room.left, was.room);
+    break;
+  default:
+    break;
+  }
+}
+
+static inline uint64_t column(const vector<uint64_t> &col, size_t i) {
+  return i < col.size() ? col[i] : 0;
+}
+
+static const double RETAG_MIN_GAP = 0.05; // solve rate, 5 points
+
+/* Suggested diffTag of a clue: an EASY clue solved no more often
+   than the HARD clues on average, and less often than the EASY
+   ones by more than 3 standard errors and RETAG_MIN_GAP, becomes
+   HARD, and the other way round. ANY clues, and clues opened fewer
+   than minOpens times, keep their tag */
+static ClueDifficulty suggestTag(ClueDifficulty tag, double rate,
+                                 uint64_t opens, double easyRate,
+                                 double hardRate, uint64_t minOpens) {
+  if (tag == ANY_CLUE || opens < minOpens)
+    return tag;
+  double own = tag == EASY_CLUE ? easyRate : hardRate;
+  double gap = max(3 * sqrt(max(own * (1 - own), 1e-6) / opens),
+                   RETAG_MIN_GAP);
+  if (tag == EASY_CLUE && rate <= hardRate && easyRate - rate > gap)
+    return HARD_CLUE;
+  if (tag == HARD_CLUE && rate >= easyRate && rate - hardRate > gap)
+    return EASY_CLUE;
+  return tag;
+}
+
+static const char *clueTagName(ClueDifficulty d) {
+  return d == EASY_CLUE ? "EASY" : d == HARD_CLUE ? "HARD" : "ANY";
+}
+
+static void analyzeWorker(const vector<string> *files, atomic<size_t> *next,
+                          JournalStats *st, mutex *errLock,
+                          vector<string> *errors) {
+  JournalReplay r;
+  for (size_t f; (f = next->fetch_add(1)) < files->size();) {
+    initJournalReplay(r); // sessions do not span files
+    MappedFile mf;
+    string err;
+    size_t torn = 0;
+    bool ok = mapFile((*files)[f].c_str(), mf, err);
+    if (ok) {
+      ok = scanJournal(
+          string_view(mf.data, mf.size),
+          [st, &r](const JournalRecord &e) { analyzeEvent(*st, r, e); }, torn,
+          err);
+      unmapFile(mf);
+    }
+    if (!ok) {
+      lock_guard<mutex> guard(*errLock);
+      errors->push_back((*files)[f] + ": " + err);
+    }
+  }
+}
+
+/* --analyze PATH... [--threads T] [--clues FILE] [--min-opens N]
+                     [--top N] [--retag OUT.tsv]
+   PATH: a journal or a directory of them. Per clue: solve rate,
+   attempts and hints per opening, seconds to a solve; per door:
+   openings, passes and locks; per room: visits, undos, quits and
+   players who left. --retag writes every clue with its suggested
+   diffTag (see suggestTag); --clues must name the bank the games
+   were played with */
+int runAnalyze(int argc, char **argv) {
+  int paths = 0;
+  while (paths < argc && strncmp(argv[paths], "--", 2) != 0)
+    paths++;
+  if (paths == 0) {
+    cerr << "--analyze needs a journal or a directory of them\n";
+    return 1;
+  }
+  int threads = (int)argLong(argc, argv, "--threads",
+                             max(1, (int)thread::hardware_concurrency()));
+  uint64_t minOpens = (uint64_t)argLong(argc, argv, "--min-opens", 50);
+  int top = (int)argLong(argc, argv, "--top", 10);
+  const char *retagPath = argValue(argc, argv, "--retag");
+  if (threads < 1 || !setupClueBank(argc - paths, argv + paths))
+    return 1;
+
+  vector<string> files;
+  size_t bytes = 0;
+  for (int i = 0; i < paths; i++) {
+    error_code ec;
+    if (!filesystem::is_directory(argv[i], ec)) {
+      files.push_back(argv[i]);
+      continue;
+    }
+    size_t first = files.size();
+    for (const filesystem::directory_entry &e :
+         filesystem::directory_iterator(argv[i], ec))
+      if (e.is_regular_file(ec))
+        files.push_back(e.path().string());
+    sort(files.begin() + (ptrdiff_t)first, files.end());
+  }
+  for (const string &f : files) {
+    error_code ec;
+    uintmax_t n = filesystem::file_size(f, ec);
+    bytes += ec ? 0 : (size_t)n;
+  }
+
+  vector<JournalStats> perThread(threads);
+  for (JournalStats &st : perThread)
+    st.events = st.orphans = 0;
+  atomic<size_t> next(0);
+  mutex errLock;
+  vector<string> errors;
+  vector<thread> pool;
+  BenchClock::time_point t0 = BenchClock::now();
+  for (int t = 0; t < threads; t++)
+    pool.push_back(thread(analyzeWorker, &files, &next, &perThread[t],
+                          &errLock, &errors));
+  for (thread &th : pool)
+    th.join();
+  JournalStats st = perThread[0];
+  for (int t = 1; t < threads; t++)
+    mergeJournalStats(st, perThread[t]);
+  double secs = nsSince(t0) / 1e9;
+  for (const string &e : errors)
+    cerr << e << "\n";
+
+  // clues: the tag means first, then the tables
+  int clues = clueBankSize();
+  vector<double> rate(clues, 0.0);
+  double tagSolves[2] = {0, 0}, tagOpens[2] = {0, 0};
+  vector<ClueDifficulty> tags(clues);
+  vector<int> seen;
+  for (int c = 0; c < clues; c++) {
+    Clue clue;
+    loadBankClue(c, clue);
+    tags[c] = clue.diffTag;
+    uint64_t opens = column(st.clue.opens, c);
+    if (opens == 0)
+      continue;
+    rate[c] = (double)column(st.clue.solves, c) / opens;
+    if (opens >= minOpens)
+      seen.push_back(c);
+    if (tags[c] != ANY_CLUE) {
+      tagSolves[tags[c]] += (double)column(st.clue.solves, c);
+      tagOpens[tags[c]] += (double)opens;
+    }
+  }
+  double easyRate = tagOpens[0] ? tagSolves[0] / tagOpens[0] : 0;
+  double hardRate = tagOpens[1] ? tagSolves[1] / tagOpens[1] : 0;
+
+  cout << fixed << setprecision(1);
+  cout << "==== Journal analytics (" << files.size() << " files, "
+       << st.events << " events, " << threads << " threads) ====\n";
+  cout << "Speed:  " << st.events / (secs > 0 ? secs : 1) / 1e6
+       << " M events/sec, " << bytes / 1048576.0 / (secs > 0 ? secs : 1)
+       << " MiB/s (" << secs * 1e3 << " ms)\n";
+  if (st.orphans)
+    cout << "Orphans: " << st.orphans
+         << " events of sessions that started in another file\n";
+  cout << "Solve rate by tag: EASY " << 100 * easyRate << "%, HARD "
+       << 100 * hardRate << "%\n";
+
+  auto clueRow = [&](int c) {
+    double opens = (double)column(st.clue.opens, c);
+    uint64_t solves = column(st.clue.solves, c);
+    cout << setw(7) << c << "  " << left << setw(5) << clueTagName(tags[c])
+         << right << setw(9) << (uint64_t)opens << setw(9) << 100 * rate[c]
+         << setw(10)
+         << (column(st.clue.misses, c) + column(st.clue.timeouts, c) + solves) /
+                opens
+         << setw(8) << 100 * column(st.clue.hints, c) / opens << setw(8)
+         << (solves ? (double)column(st.clue.seconds, c) / solves : 0.0)
+         << "\n";
+  };
+  sort(seen.begin(), seen.end(),
+       [&rate](int a, int b) { return rate[a] < rate[b]; });
+  int rows = min(top, (int)seen.size());
+  cout << "\nClues opened " << minOpens << "+ times: " << seen.size()
+       << " of " << clues << "\n";
+  auto clueHeader = [](const char *title) {
+    cout << left << setw(9) << title << setw(5) << "tag" << right << setw(9)
+         << "opens" << setw(9) << "solved%" << setw(10) << "att/open"
+         << setw(8) << "hint%" << setw(8) << "secs" << "\n";
+  };
+  clueHeader("Hardest");
+  for (int i = 0; i < rows; i++)
+    clueRow(seen[i]);
+  clueHeader("Easiest");
+  for (int i = 0; i < rows; i++)
+    clueRow(seen[seen.size() - 1 - i]);
+
+  // doors that lock the most, rooms players back out of or give up in
+  vector<size_t> doors, rooms;
+  for (size_t d = 0; d < st.door.opens.size(); d++)
+    if (st.door.opens[d] >= minOpens)
+      doors.push_back(d);
+  auto lockRate = [&st](size_t d) {
+    return (double)column(st.door.locks, d) / st.door.opens[d];
+  };
+  sort(doors.begin(), doors.end(),
+       [&](size_t a, size_t b) { return lockRate(a) > lockRate(b); });
+  cout << "\n" << left << setw(20) << "Doors locking most" << right << setw(6)
+       << "room" << setw(6) << "door" << setw(9) << "opens" << setw(9)
+       << "passes" << setw(9) << "locked%" << "\n";
+  for (int i = 0; i < min(top, (int)doors.size()); i++) {
+    size_t d = doors[i];
+    cout << setw(26) << d / 2 << setw(6) << d % 2 + 1 << setw(9)
+         << st.door.opens[d] << setw(9) << column(st.door.passes, d)
+         << setw(9) << 100 * lockRate(d) << "\n";
+  }
+  for (size_t r = 0; r < st.room.visits.size(); r++)
+    if (st.room.visits[r] >= minOpens)
+      rooms.push_back(r);
+  auto stuckRate = [&st](size_t r) {
+    return (double)(column(st.room.undos, r) + column(st.room.quits, r) +
+                    column(st.room.left, r)) /
+           st.room.visits[r];
+  };
+  sort(rooms.begin(), rooms.end(),
+       [&](size_t a, size_t b) { return stuckRate(a) > stuckRate(b); });
+  cout << left << setw(20) << "Dead ends" << right << setw(6) << "room"
+       << setw(9) << "visits" << setw(8) << "undo%" << setw(8) << "quit%"
+       << setw(8) << "left%" << "\n";
+  for (int i = 0; i < min(top, (int)rooms.size()); i++) {
+    size_t r = rooms[i];
+    double v = (double)st.room.visits[r];
+    cout << setw(26) << r << setw(9) << st.room.visits[r] << setw(8)
+         << 100 * column(st.room.undos, r) / v << setw(8)
+         << 100 * column(st.room.quits, r) / v << setw(8)
+         << 100 * column(st.room.left, r) / v << "\n";
+  }
+
+  int toHard = 0, toEasy = 0;
+  FILE *out = retagPath ? fopen(retagPath, "wb") : nullptr;
+  if (retagPath && !out) {
+    cerr << "cannot write " << retagPath << "\n";
+    return 1;
+  }
+  if (out)
+    fputs("# clue\ttag\tsuggested\topens\tsolveRate\tattemptsPerOpen"
+          "\thintRate\tsecondsToSolve\n",
+          out);
+  for (int c = 0; c < clues; c++) {
+    uint64_t opens = column(st.clue.opens, c);
+    ClueDifficulty tag = suggestTag(tags[c], rate[c], opens, easyRate,
+                                    hardRate, minOpens);
+    toHard += tags[c] == EASY_CLUE && tag == HARD_CLUE;
+    toEasy += tags[c] == HARD_CLUE && tag == EASY_CLUE;
+    if (!out || opens == 0)
+      continue;
+    uint64_t solves = column(st.clue.solves, c);
+    fprintf(out, "%d\t%s\t%s\t%llu\t%.4f\t%.3f\t%.4f\t%.1f\n", c,
+            clueTagName(tags[c]), clueTagName(tag), (unsigned long long)opens,
+            rate[c],
+            (double)(column(st.clue.misses, c) + column(st.clue.timeouts, c) +
+                     solves) /
+                opens,
+            (double)column(st.clue.hints, c) / opens,
+            solves ? (double)column(st.clue.seconds, c) / solves : 0.0);
+  }
+  cout << "\nRetag: " << toHard << " EASY -> HARD, " << toEasy
+       << " HARD -> EASY";
+  if (out) {
+    bool ok = fclose(out) == 0;
+    cout << (ok ? " (written to " : " (could not write ") << retagPath << ")";
+    if (!ok)
+      return 1;
+  }
+  cout << "\n";
+  return errors.empty() ? 0 : 1;
+}
+
+/* =========================
+CLUE FILE TOOLS
+========================= */
+// Synthetic text bank: n clues (mixed MCQ/TEXT, EASY/HARD/ANY) + final gate
+bool writeSyntheticClueText(const char *path, int n, string &err) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    err = string("cannot create ") + path;
+    return false;
+  }
+  static const char *diffs[] = {"EASY", "HARD", "ANY"};
+  fputs("# type\tdifficulty\tpoints\ttimeLimit\tcorrect\tproblem\tsolution"
+        "\thint\toptA\toptB\toptC\toptD\n",
+        f);
+  for (int i = 0; i < n; i++) {
+    if (i % 5 == 4)
+      fprintf(f, "TEXT\t%s\t10\t20\tA\tType the code word number %d\tword%d"
+                 "\tIt starts with 'word'.\n",
+              diffs[i % 3], i, i);
+    else
+      fprintf(f, "MCQ\t%s\t10\t20\t%c\tSynthetic question number %d?\t\t"
+                 "Think about %d.\tAlpha %d\tBeta %d\tGamma %d\tDelta %d\n",
+              diffs[i % 3], 'A' + i % 4, i, i, i, i, i, i);
+  }
+  fputs("TEXT\tANY\t15\t15\tA\tFinal Gate: type escape\tescape\t"
+        "The name of the game.\n",
+        f);
+  bool ok = fclose(f) == 0;
+  if (!ok)
+    err = string("write failed: ") + path;
+  return ok;
+}
+
+// --gen-clues N OUT: synthetic text bank for load tests
+int runGenClues(int argc, char **argv) {
+  if (argc < 2) {
+    cerr << "usage: --gen-clues N OUT.tsv\n";
+    return 1;
+  }
+  string err;
+  if (!writeSyntheticClueText(argv[1], atoi(argv[0]), err)) {
+    cerr << err << "\n";
+    return 1;
+  }
+  return 0;
+}
+
+// --save-clues OUT [--clues IN]: current bank as a binary bank
+int runSaveClues(int argc, char **argv) {
+  if (argc < 1) {
+    cerr << "usage: --save-clues OUT.bin [--clues IN]\n";
+    return 1;
+  }
+  if (!setupClueBank(argc, argv))
+    return 1;
+  string err;
+  if (!saveClueBankBinary(argv[0], err)) {
+    cerr << err << "\n";
+    return 1;
+  }
+  cout << "Wrote " << clueBankSize() << " clues to " << argv[0] << "\n";
+  return 0;
+}
+
+// --validate-clues FILE: full consistency check of a binary bank
+int runValidateClues(int argc, char **argv) {
+  if (argc < 1) {
+    cerr << "usage: --validate-clues FILE.bin\n";
+    return 1;
+  }
+  cout << "Validating " << argv[0] << "\n";
+  int problems = validateClueBankFile(argv[0], cout);
+  if (problems) {
+    cout << problems << " problem(s) found\n";
+    return 1;
+  }
+  cout << "OK\n";
+  return 0;
+}
+
+
+/* --bench-clue-load [--dir DIR]
+   startup (open + first map) and RSS for 10k..1M clue banks,
+   text vs binary (version 3) */
+int runClueLoadBenchmark(int argc, char **argv) {
+  const char *dirArg = argValue(argc, argv, "--dir");
+  string dir = dirArg ? dirArg : "/tmp";
+  static const int sizes[] = {10000, 100000, 1000000};
+  string err;
+  GameRng rng;
+  seedRng(rng, 1);
+
+  cout << fixed << setprecision(2);
+  cout << "==== Clue load benchmark ====\n";
+  cout << "clues      format   file MiB    open us   first map us   RSS +MiB\n";
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    int n = sizes[s];
+    string text = dir + "/clues_" + to_string(n) + ".tsv";
+    string bin = dir + "/clues_" + to_string(n) + ".bin";
+    if (!writeSyntheticClueText(text.c_str(), n, err) ||
+        !loadClueBankFile(text.c_str(), err) ||
+        !saveClueBankBinary(bin.c_str(), err)) {
+      cerr << err << "\n";
+      return 1;
+    }
+    unloadClueBank();
+
+    for (int b = 0; b < 2; b++) {
+      const string &path = b ? bin : text;
+      long rss0 = residentKiB();
+      BenchClock::time_point t0 = BenchClock::now();
+      if (!loadClueBankFile(path.c_str(), err)) {
+        cerr << err << "\n";
+        return 1;
+      }
+      double openUs = nsSince(t0) / 1e3;
+
+      t0 = BenchClock::now();
+      resetUsedClues();
+      GameMap gm = buildMap(rng);
+      double mapUs = nsSince(t0) / 1e3;
+      freeMap(gm);
+      long rss1 = residentKiB();
+
+      cout << setw(7) << n << (b ? "   binary " : "   text   ") << setw(9)
+           << BANK_FILE.size / 1048576.0 << setw(11) << openUs << setw(15)
+           << mapUs << setw(11) << (rss1 - rss0) / 1024.0 << "\n";
+      unloadClueBank();
+    }
+    remove(text.c_str());
+    remove(bin.c_str());
+  }
+  return 0;
+}
+
+/* =========================
+MAP FILE TOOLS
+========================= */
+/* --gen-map N OUT [--maze-seed S] [--easy-ratio R] [--trap-rate P]
+                 [--entrances E] [--exits X]: generated maze as a map file */
+int runGenMap(int argc, char **argv) {
+  if (argc < 2) {
+    cerr << "usage: --gen-map N OUT.map [--maze-seed S] [--easy-ratio R] "
+            "[--trap-rate P] [--entrances E] [--exits X]\n";
+    return 1;
+  }
+  CompactMap cm;
+  string err;
+  if (!generateMaze(mazeConfigFromArgs(argc, argv, atoi(argv[0])), cm, err) ||
+      !saveMapGraph(cm, argv[1], err)) {
+    cerr << err << "\n";
+    return 1;
+  }
+  cout << "Wrote " << cm.rooms.size() << " rooms to " << argv[1] << "\n";
+  return 0;
+}
+
+// --save-map OUT [--map IN]: current map (built-in by default) as a map file
+int runSaveMap(int argc, char **argv) {
+  if (argc < 1) {
+    cerr << "usage: --save-map OUT.map [--map IN]\n";
+    return 1;
+  }
+  if (!setupMap(argc, argv))
+    return 1;
+  CompactMap cm;
+  if (HAVE_LOADED_MAP) {
+    cm = LOADED_MAP;
+  } else {
+    initClueBank();
+    resetUsedClues();
+    GameRng rng;
+    seedRng(rng, 1);
+    GameMap gm = buildMap(rng);
+    buildCompactMap(gm, cm);
+    freeMap(gm);
+  }
+  string err;
+  if (!saveMapGraph(cm, argv[0], err)) {
+    cerr << err << "\n";
+    return 1;
+  }
+  cout << "Wrote " << cm.rooms.size() << " rooms to " << argv[0] << "\n";
+  return 0;
+}
+
+// --validate-map FILE: parse + entrance-to-exit reachability
+int runValidateMap(int argc, char **argv) {
+  if (argc < 1) {
+    cerr << "usage: --validate-map FILE.map\n";
+    return 1;
+  }
+  CompactMap cm;
+  string err;
+  if (!loadMapGraph(argv[0], cm, err) || !validateMapGraph(cm, err)) {
+    cout << argv[0] << ": " << err << "\n";
+    return 1;
+  }
+  cout << argv[0] << ": " << cm.rooms.size() << " rooms, "
+       << cm.entrances.size() << " entrances, " << cm.exits.size()
+       << " exits, OK\n";
+  return 0;
+}
+
+// Route from a room toward one target as "id -[door]-> id ..."
+static string describeRoute(const CompactMap &tpl, const RouteIndex &ri,
+                            int room, int target, int maxSteps) {
+  ostringstream s;
+  s << tpl.roomIDs[room];
+  for (int i = 0; routeStep(ri, room, target).door >= 0; i++) {
+    if (i == maxSteps) {
+      s << " ...";
+      break;
+    }
+    const CompactRoom &c = tpl.rooms[room];
+    int door = routeStep(ri, room, target).door;
+    room = door == 0 ? c.next1 : c.next2;
+    s << " -[" << door + 1 << "]-> " << tpl.roomIDs[room];
+  }
+  return s.str();
+}
+
+/* --routes [--seed S] [--skill P] [--room ID] [--clues FILE]
+            [--map FILE | --maze N]: route index of the map `--seed S`
+   plays; best routes from every entrance (or from room ID) */
+int runRoutes(int argc, char **argv) {
+  unsigned long long seed = (unsigned long long)argLong(argc, argv, "--seed", 1);
+  double skill = argDouble(argc, argv, "--skill", 0.7);
+  if (!setupClueBank(argc, argv) || !setupMap(argc, argv))
+    return 1;
+
+  GameRng rng;
+  seedRng(rng, seed);
+  CompactMap tpl;
+  buildMapTemplate(rng, gameMapGraph(), tpl);
+  RouteIndex ri;
+  chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+  buildRouteIndex(tpl, skill, ri);
+  double ms =
+      chrono::duration<double, milli>(chrono::steady_clock::now() - t0).count();
+
+  cout << fixed << setprecision(1);
+  cout << "==== Routes (seed " << seed << ", skill " << skill << ") ====\n";
+  cout << "Index: " << ri.rooms << " rooms x " << ri.targets
+       << " targets (nearest exit + " << ri.targets - 1 << " exits), "
+       << ri.steps.size() * sizeof(RouteStep) / 1048576.0 << " MiB, built in "
+       << ms << " ms\n";
+
+  vector<int> from;
+  const char *roomArg = argValue(argc, argv, "--room");
+  if (roomArg) {
+    int id = atoi(roomArg);
+    for (int i = 0; i < ri.rooms; i++)
+      if (tpl.roomIDs[i] == id)
+        from.push_back(i);
+    if (from.empty()) {
+      cerr << "no room " << id << "\n";
+      return 1;
+    }
+  } else {
+    from = tpl.entrances;
+  }
+
+  for (size_t k = 0; k < from.size(); k++) {
+    int room = from[k];
+    const RouteStep &best = routeStep(ri, room);
+    cout << "\nRoom " << tpl.roomIDs[room] << " ("
+         << roomTypeName((RoomType)tpl.rooms[room].type) << "): ";
+    if (best.dist < 0) {
+      cout << "no exit reachable\n";
+      continue;
+    }
+    cout << "nearest exit " << best.dist << " doors, expected score "
+         << showpos << best.score << noshowpos << "\n";
+    cout << "  route: " << describeRoute(tpl, ri, room, 0, 12) << "\n";
+    for (int t = 1; t < ri.targets; t++) {
+      const RouteStep &to = routeStep(ri, room, t);
+      cout << "  to exit " << tpl.roomIDs[tpl.exits[t - 1]] << ": ";
+      if (to.dist < 0)
+        cout << "unreachable\n";
+      else
+        cout << to.dist << " doors, expected score " << showpos << to.score
+             << noshowpos << "\n";
+    }
+  }
+  return 0;
+}
+
+/* --bench-map-load [--dir D]
+   generated maps of 10^5 and 10^6 rooms: parse, validate,
+   then materialize a game on the heap and (twice) in an arena */
+int runMapLoadBenchmark(int argc, char **argv) {
+  const char *dirArg = argValue(argc, argv, "--dir");
+  string dir = dirArg ? dirArg : "/tmp";
+  static const int sizes[] = {100000, 1000000};
+  string err;
+  initClueBank();
+  GameRng rng;
+  seedRng(rng, 1);
+
+  cout << fixed << setprecision(2);
+  cout << "==== Map load benchmark ====\n";
+  cout << "rooms     file MiB   parse ms  validate ms   heap ms  arena ms"
+          "  arena again ms  graph MiB  game MiB\n";
+
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    int n = sizes[s];
+    string path = dir + "/map_" + to_string(n) + ".map";
+    CompactMap generated;
+    if (!generateMaze(mazeConfigFromArgs(argc, argv, n), generated, err) ||
+        !saveMapGraph(generated, path.c_str(), err)) {
+      cerr << err << "\n";
+      return 1;
+    }
+    generated = CompactMap();
+    struct stat sb;
+    double fileMiB = stat(path.c_str(), &sb) == 0 ? sb.st_size / 1048576.0 : 0;
+
+    CompactMap cm;
+    long rss0 = residentKiB();
+    BenchClock::time_point t0 = BenchClock::now();
+    if (!loadMapGraph(path.c_str(), cm, err)) {
+      cerr << err << "\n";
+      return 1;
+    }
+    double parseMs = nsSince(t0) / 1e6;
+    long rss1 = residentKiB();
+
+    t0 = BenchClock::now();
+    if (!validateMapGraph(cm, err)) {
+      cerr << err << "\n";
+      return 1;
+    }
+    double validateMs = nsSince(t0) / 1e6;
+
+    resetUsedClues();
+    t0 = BenchClock::now();
+    GameMap gm = buildMapFromGraph(rng, cm);
+    double heapMs = nsSince(t0) / 1e6;
+    freeMap(gm);
+
+    double arenaMs[2];
+    long rss2 = residentKiB();
+    GameArena *arena = createArena();
+    for (int r = 0; r < 2; r++) {
+      resetUsedClues();
+      resetArena(*arena);
+      t0 = BenchClock::now();
+      gm = buildMapFromGraph(rng, cm, arena);
+      arenaMs[r] = nsSince(t0) / 1e6;
+      freeMap(gm);
+    }
+    long rss3 = residentKiB();
+    destroyArena(arena);
+
+    cout << setw(7) << n << setw(12) << fileMiB << setw(11) << parseMs
+         << setw(13) << validateMs << setw(10) << heapMs << setw(10)
+         << arenaMs[0] << setw(16) << arenaMs[1] << setw(11)
+         << (rss1 - rss0) / 1024.0 << setw(10) << (rss3 - rss2) / 1024.0
+         << "\n";
+    remove(path.c_str());
+  }
+  return 0;
+}
+
+/* --bench-maze [--maze-seed S] [--easy-ratio R] [--trap-rate P]
+   generate + validate mazes of 10^5 .. 4*10^6 rooms */
+int runMazeBenchmark(int argc, char **argv) {
+  static const int sizes[] = {100000, 1000000, 4000000};
+  string err;
+
+  cout << fixed << setprecision(2);
+  cout << "==== Maze generator benchmark ====\n";
+  cout << "rooms      generate ms  validate ms  Mrooms/s   EASY %   traps"
+          "   MiB\n";
+  for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+    int n = sizes[s];
+    CompactMap cm;
+    BenchClock::time_point t0 = BenchClock::now();
+    if (!generateMaze(mazeConfigFromArgs(argc, argv, n), cm, err)) {
+      cerr << err << "\n";
+      return 1;
+    }
+    double genMs = nsSince(t0) / 1e6; // includes one validation
+
+    t0 = BenchClock::now();
+    validateMapGraph(cm, err);
+    double validateMs = nsSince(t0) / 1e6;
+
+    long long easy = 0, inner = 0, traps = 0;
+    for (size_t i = 0; i < cm.rooms.size(); i++) {
+      const CompactRoom &c = cm.rooms[i];
+      inner += c.type == ROOM_INTERMEDIATE;
+      easy += c.difficulty == DIFF_EASY;
+      traps += (c.trap1 != TRAP_NONE) + (c.trap2 != TRAP_NONE);
+    }
+    double mib = (cm.rooms.size() * sizeof(CompactRoom) +
+                  cm.roomIDs.size() * sizeof(int)) /
+                 1048576.0;
+    cout << setw(8) << n << setw(14) << genMs << setw(13) << validateMs
+         << setw(10) << n / (genMs * 1e3) << setw(9)
+         << 100.0 * easy / (inner ? inner : 1) << setw(8) << traps << setw(8)
+         << mib << "\n";
+  }
+  return 0;
+}
+
+/* --bench-engine [--banks LIST] [--rooms LIST] [--ops N] [--dir D]
+   the engine's hot calls for every bank size x map size (LIST:
+   comma-separated; bank 0 = the built-in bank, map 14 = buildMap(),
+   other sizes a generated maze): bank load, map build with its
+   clue picks, pickRandomClueIndexForRoom, randomizeEasyDoors,
+   a scripted solve (hint, wrong answer, right answer), undo-heavy
+   pushPath/popPath and freeMap. ns, heap allocations and hardware
+   cache misses (perf_event_open; n/a if not allowed) per op */
+#ifdef __linux__
+// Cache misses of this thread; fd -1 where perf events are not allowed
+static int openCacheMissCounter() {
+  perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long readCacheMisses(int fd) {
+  long long v;
+  return fd >= 0 && read(fd, &v, sizeof(v)) == (ssize_t)sizeof(v) ? v : -1;
+}
+#else
+static int openCacheMissCounter() { return -1; }
+static long long readCacheMisses(int) { return -1; }
+#endif
+
+// "10,100,1000" -> {10, 100, 1000}
+static vector<long long> argList(int argc, char **argv, const char *flag,
+                                 const char *def) {
+  const char *v = argValue(argc, argv, flag);
+  string s = v ? v : def;
+  vector<long long> out;
+  for (size_t i = 0; i < s.size();) {
+    size_t comma = s.find(',', i);
+    if (comma == string::npos)
+      comma = s.size();
+    out.push_back(atoll(s.substr(i, comma - i).c_str()));
+    i = comma + 1;
+  }
+  return out;
+}
+
+// One row of --bench-engine: time, allocations and misses of the
+// spans between start() and stop()
+struct EngineSpan {
+  int missFd;
+  double ns;
+  long long ops, allocs, misses;
+  BenchClock::time_point t0;
+  long long allocs0, misses0;
+
+  void start() {
+    allocs0 = HEAP_ALLOCS;
+    misses0 = readCacheMisses(missFd);
+    t0 = BenchClock::now();
+  }
+  void stop(long long n = 1) {
+    ns += nsSince(t0);
+    allocs += HEAP_ALLOCS - allocs0;
+    long long m = readCacheMisses(missFd);
+    misses = m < 0 || misses < 0 ? -1 : misses + m - misses0;
+    ops += n;
+  }
+};
+
+static EngineSpan engineSpan(int missFd) {
+  EngineSpan s;
+  s.missFd = missFd;
+  s.ns = 0;
+  s.ops = s.allocs = s.misses = 0;
+  return s;
+}
+
+static void printEngineRow(long long bank, const char *rooms,
+                           const char *op, const EngineSpan &s) {
+  long long n = s.ops ? s.ops : 1;
+  cout << right << setw(8) << bank << setw(9) << rooms << "  " << left
+       << setw(22) << op << right << setw(15) << s.ns / n << setw(13)
+       << (double)s.allocs / n << setw(13);
+  if (s.misses < 0)
+    cout << "n/a";
+  else
+    cout << (double)s.misses / n;
+  cout << "\n";
+}
+
+int runEngineBenchmark(int argc, char **argv) {
+  vector<long long> banks = argList(argc, argv, "--banks", "0,10000,1000000");
+  vector<long long> sizes = argList(argc, argv, "--rooms", "14,10000,1000000");
+  long long budget = argLong(argc, argv, "--ops", 2000000); // rooms per row
+  const char *dirArg = argValue(argc, argv, "--dir");
+  string dir = dirArg ? dirArg : "/tmp";
+  int missFd = openCacheMissCounter();
+  ostream nowhere(nullptr);
+  GameRng rng;
+  seedRng(rng, 1);
+  string err;
+
+  cout << fixed << setprecision(1);
+  cout << "==== Engine benchmark (" << budget << " rooms per row) ====\n";
+  cout << "    bank    rooms  op                            ns/op    allocs/op"
+          "    misses/op\n";
+
+  for (long long bank : banks) {
+    // bank load: initClueBank(), or a synthetic text bank file
+    string path = dir + "/engine_clues_" + to_string(bank) + ".tsv";
+    if (bank > 0 && !writeSyntheticClueText(path.c_str(), (int)bank, err)) {
+      cerr << err << "\n";
+      return 1;
+    }
+    EngineSpan load = engineSpan(missFd);
+    int loads = bank > 0 ? 3 : 1000;
+    for (int i = 0; i < loads; i++) {
+      load.start();
+      bool ok = true;
+      if (bank > 0)
+        ok = loadClueBankFile(path.c_str(), err);
+      else
+        initClueBank();
+      load.stop();
+      if (!ok) {
+        cerr << err << "\n";
+        return 1;
+      }
+    }
+    printEngineRow(bank, "-", bank > 0 ? "loadClueBankFile" : "initClueBank",
+                   load);
+
+    for (long long rooms : sizes) {
+      CompactMap maze;
+      if (rooms != BUILTIN_ROOM_COUNT) {
+        MazeConfig mc = mazeConfigFromArgs(argc, argv, (int)rooms);
+        if (!generateMaze(mc, maze, err)) {
+          cerr << err << "\n";
+          return 1;
+        }
+      }
+      long long games = budget / rooms > 3 ? budget / rooms : 3;
+      string label = to_string(rooms);
+      EngineSpan build = engineSpan(missFd), pick = engineSpan(missFd),
+                 doors = engineSpan(missFd), solve = engineSpan(missFd),
+                 path = engineSpan(missFd), freed = engineSpan(missFd);
+
+      for (long long g = 0; g < games; g++) {
+        build.start();
+        resetUsedClues();
+        GameMap gm = rooms == BUILTIN_ROOM_COUNT
+                         ? buildMap(rng)
+                         : buildMapFromGraph(rng, maze);
+        build.stop();
+
+        // as many draws as the map made, on fresh pools
+        resetUsedClues();
+        pick.start();
+        long long sink = 0;
+        for (int i = 0; i < gm.count; i++) {
+          int idx = pickRandomClueIndexForRoom(
+              rng, ROOM_INTERMEDIATE, i % 3 ? DIFF_EASY : DIFF_HARD, false);
+          markClueUsed(idx);
+          sink += idx;
+        }
+        pick.stop(gm.count);
+        BENCH_SINK = sink;
+
+        doors.start();
+        for (int i = 0; i < gm.count; i++)
+          randomizeEasyDoors(rng, gm.all[i]);
+        doors.stop(gm.count);
+
+        // every room's first door: hint, wrong answer, right answer
+        static thread_local string right, wrong;
+        int solved = gm.count < 4096 ? gm.count : 4096;
+        for (int i = 0; i < solved; i++) {
+          Clue &c = gm.all[i]->clues[0];
+          if (c.type == MCQ) {
+            right.assign(1, c.correctOption);
+            wrong.assign(1, c.correctOption == 'A' ? 'B' : 'A');
+          } else {
+            right.assign(c.answer.substr(0, c.answer.find('|')));
+            wrong.assign("?");
+          }
+          int score = 100;
+          time_t startTime;
+          solve.start();
+          beginClue(c, startTime, nowhere);
+          answerClue(c, "H", startTime, score, nowhere);
+          answerClue(c, wrong, startTime, score, nowhere);
+          answerClue(c, right, startTime, score, nowhere);
+          solve.stop();
+        }
+
+        // two undos out of three moves across the whole map
+        PathNode *history = nullptr;
+        path.start();
+        pushPath(history, gm.entrances[0]);
+        for (int m = 0; m < gm.count; m++) {
+          pushPath(history, gm.all[m]);
+          if (m % 3 != 2)
+            popPath(history);
+        }
+        freePath(history);
+        path.stop(gm.count);
+
+        freed.start();
+        freeMap(gm);
+        freed.stop();
+      }
+      printEngineRow(bank, label.c_str(),
+                     rooms == BUILTIN_ROOM_COUNT ? "buildMap"
+                                                 : "buildMapFromGraph",
+                     build);
+      printEngineRow(bank, label.c_str(), "pickRandomClueIndex", pick);
+      printEngineRow(bank, label.c_str(), "randomizeEasyDoors", doors);
+      printEngineRow(bank, label.c_str(), "solveClue (H,wrong,ok)", solve);
+      printEngineRow(bank, label.c_str(), "pushPath/popPath", path);
+      printEngineRow(bank, label.c_str(), "freeMap", freed);
+    }
+    if (bank > 0) {
+      unloadClueBank();
+      remove(path.c_str());
+    }
+  }
+  if (missFd >= 0)
+    close(missFd);
+  return 0;
+}
+
+/* --bench-leaderboard [--threads N] [--results M]
+   M finished games per thread submitted from 1, 2, 4 .. N
+   threads while one more thread snapshots the board
+   continuously: the sharded board vs one mutex-guarded top-K.
+   Checks the final overall top 10 against a sort of every
+   submitted score */
+int runLeaderboardBenchmark(int argc, char **argv) {
+  int maxThreads = (int)argLong(argc, argv, "--threads",
+                                max(1, (int)thread::hardware_concurrency()));
+  long long perThread = argLong(argc, argv, "--results", 1000000);
+  if (maxThreads < 1 || perThread < 1) {
+    cerr << "--threads and --results must be positive\n";
+    return 1;
+  }
+  // finished games: score, entrance, hardest room
+  struct Result {
+    int32_t score;
+    uint8_t entrance, difficulty;
+  };
+  vector<vector<Result>> results(maxThreads);
+  for (int t = 0; t < maxThreads; t++) {
+    GameRng rng;
+    seedRngStream(rng, 1, t);
+    results[t].resize(perThread);
+    for (Result &r : results[t]) {
+      r.score = (int32_t)rngBelow(rng, 1500) + (int32_t)rngBelow(rng, 1500) -
+                600;
+      r.entrance = (uint8_t)rngBelow(rng, 4);
+      r.difficulty = (uint8_t)(1 + rngBelow(rng, 2));
+    }
+  }
+
+  // the baseline: every view's top K behind one lock
+  struct LockedBoard {
+    mutex lock;
+    vector<int32_t> top[LEADER_VIEWS];
+  };
+  auto lockedSubmit = [](LockedBoard &b, const Result &r) {
+    int views[3];
+    leaderViews(r.entrance, r.difficulty, views);
+    lock_guard<mutex> guard(b.lock);
+    for (int v : views) {
+      vector<int32_t> &top = b.top[v];
+      if ((int)top.size() == LEADER_K && r.score <= top.back())
+        continue;
+      top.insert(upper_bound(top.begin(), top.end(), r.score,
+                             greater<int32_t>()),
+                 r.score);
+      if ((int)top.size() > LEADER_K)
+        top.pop_back();
+    }
+  };
+
+  cout << fixed << setprecision(1);
+  cout << "==== Leaderboard benchmark (" << perThread
+       << " results per thread) ====\n";
+  cout << "threads  board     Msubmits/s  ns/submit  snapshots/s  retries  "
+          "top10\n";
+  for (int threads = 1;; threads = min(threads * 2, maxThreads)) {
+    vector<int32_t> all;
+    for (int t = 0; t < threads; t++)
+      for (const Result &r : results[t])
+        all.push_back(r.score);
+    partial_sort(all.begin(), all.begin() + min<size_t>(LEADER_K, all.size()),
+                 all.end(), greater<int32_t>());
+    all.resize(min<size_t>(LEADER_K, all.size()));
+
+    for (int sharded = 1; sharded >= 0; sharded--) {
+      Leaderboard *board = createLeaderboard();
+      LockedBoard locked;
+      atomic<int> running(threads);
+      atomic<bool> go(false);
+      long long snapshots = 0;
+      uint64_t retries = 0;
+      thread reader([&]() {
+        LeaderSnapshot snap;
+        while (!go.load(memory_order_acquire)) {
+        }
+        while (running.load(memory_order_acquire) > 0) {
+          if (sharded) {
+            snapshotLeaderboard(*board, snap);
+            retries += snap.retries;
+          } else {
+            lock_guard<mutex> guard(locked.lock);
+            snap.count[0] = (int)locked.top[0].size();
+            for (int i = 0; i < snap.count[0]; i++)
+              snap.top[0][i].score = locked.top[0][i];
+          }
+          snapshots++;
+        }
+      });
+      vector<thread> pool;
+      for (int t = 0; t < threads; t++)
+        pool.push_back(thread([&, t]() {
+          while (!go.load(memory_order_acquire)) {
+          }
+          for (const Result &r : results[t])
+            if (sharded)
+              submitScore(*board, r.score, r.entrance, r.difficulty);
+            else
+              lockedSubmit(locked, r);
+          running.fetch_sub(1, memory_order_release);
+        }));
+      BenchClock::time_point t0 = BenchClock::now();
+      go.store(true, memory_order_release);
+      for (thread &th : pool)
+        th.join();
+      double ns = nsSince(t0);
+      reader.join();
+
+      bool ok;
+      if (sharded) {
+        LeaderSnapshot snap;
+        snapshotLeaderboard(*board, snap);
+        ok = snap.count[0] == (int)all.size() &&
+             snap.submitted == (uint64_t)threads * perThread;
+        for (int i = 0; ok && i < snap.count[0]; i++)
+          ok = snap.top[0][i].score == all[i];
+      } else {
+        ok = locked.top[0] == all;
+      }
+      delete board;
+      long long submits = threads * perThread;
+      cout << setw(7) << threads << "  " << left << setw(8)
+           << (sharded ? "sharded" : "mutex") << right << setw(12)
+           << submits * 1e3 / ns << setw(11) << ns * threads / submits
+           << setw(13) << snapshots * 1e9 / ns << setw(9) << retries
+           << setw(7) << (ok ? "ok" : "WRONG") << "\n";
+      if (!ok)
+        return 1;
+    }
+    if (threads == maxThreads)
+      break;
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "--simulate") == 0)
+    return runSimulation(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--replay") == 0)
+    return runReplay(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--replay-journal") == 0)
+    return runReplayJournal(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--analyze") == 0)
+    return runAnalyze(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--solve") == 0)
+    return runSolve(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--serve") == 0)
+    return runServer(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-server") == 0)
+    return runServerBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-sessions") == 0)
+    return runSessionMemoryBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-snapshots") == 0)
+    return runSnapshotBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-journal") == 0)
+    return runJournalBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-render") == 0)
+    return runRenderBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-timers") == 0)
+    return runTimerBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-engine") == 0)
+    return runEngineBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-leaderboard") == 0)
+    return runLeaderboardBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-arena") == 0)
+    return runArenaBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-layout") == 0)
+    return runLayoutBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-clue-pools") == 0)
+    return runCluePoolBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-answers") == 0)
+    return runAnswerBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-clue-load") == 0)
+    return runClueLoadBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--gen-clues") == 0)
+    return runGenClues(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--save-clues") == 0)
+    return runSaveClues(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--validate-clues") == 0)
+    return runValidateClues(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-map-load") == 0)
+    return runMapLoadBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--bench-maze") == 0)
+    return runMazeBenchmark(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--gen-map") == 0)
+    return runGenMap(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--save-map") == 0)
+    return runSaveMap(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--validate-map") == 0)
+    return runValidateMap(argc - 2, argv + 2);
+  if (argc > 1 && strcmp(argv[1], "--routes") == 0)
+    return runRoutes(argc - 2, argv + 2);
+
+  // --seed S replays a game: same map, same doors, same clues
+  unsigned long long seed = (unsigned long long)argLong(
+      argc - 1, argv + 1, "--seed", (long long)time(0));
+  if (!setupClueBank(argc - 1, argv + 1) || !setupMap(argc - 1, argv + 1))
+    return 1;
+
+  GameRng rng;
+  seedRng(rng, seed);
+  CompactMap tpl;
+  buildMapTemplate(rng, gameMapGraph(), tpl);
+
+  // --record FILE: the session as a recording for --replay
+  const char *recordPath = argValue(argc - 1, argv + 1, "--record");
+
+  // --timed: clue time limits fire while the player is silent
+  if (argFlag(argc - 1, argv + 1, "--timed")) {
+    if (recordPath) {
+      cerr << "--record cannot record --timed games\n";
+      return 1;
+    }
+#if defined(HAVE_COROUTINES) && defined(__linux__)
+    return playTimedGame(tpl, seed);
+#else
+    cerr << "--timed needs a C++20 build (-std=c++20) on Linux\n";
+    return 1;
+#endif
+  }
+
+  // one frame per input line; cin no longer flushes cout before reads
+  cout.flush();
+  cin.tie(nullptr);
+  TurnFrame frame;
+  GameSession session;
+  SessionLog log;
+  startSession(session, tpl, seed, frame.out);
+  if (recordPath)
+    startSessionLog(log, session, seed, frame.buf.text);
+  emitFrame(frame);
+  string line;
+  bool more = true;
+  while (more && getline(cin, line)) {
+    if (recordPath)
+      logSessionLine(log, line);
+    more = feedSession(session, line, frame.out);
+    if (recordPath)
+      logSessionState(log, session, frame.buf.text);
+    emitFrame(frame);
+  }
+  endSession(session);
+  string err;
+  if (recordPath && !saveSessionLog(log, recordPath, err)) {
+    cerr << err << "\n";
+    return 1;
+  }
+  return saveMetrics(argc - 1, argv + 1) ? 0 : 1;
 }
\ No newline at end of file